@@ -0,0 +1,168 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * This file contains a benchmark of the voxel grid filter of the C++ Ouster
+ * SDK. It downsamples scans read from a pcap, or a synthetic 2048x128 scan,
+ * and reports the throughput in scans per second.
+ *
+ * Build ouster_client with OpenMP ('-fopenmp -DOUSTER_OMP') to benchmark the
+ * parallel path; OMP_NUM_THREADS sets the number of threads.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ouster_client/impl/build.h"
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+#include "ouster_client/voxel_grid.h"
+#include "ouster_pcap/os_pcap.h"
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#include <omp.h>
+#endif
+
+using namespace ouster;
+
+constexpr std::size_t BUF_SIZE = 65536;
+
+// complete scans of a pcap, skipping the first one, which may be partial
+std::vector<LidarScan> read_scans(const std::string& pcap_file,
+                                  const sensor::sensor_info& info,
+                                  size_t max_scans) {
+    auto handle = sensor_utils::replay_initialize(pcap_file);
+    auto pf = sensor::get_format(info);
+    ScanBatcher batch_to_scan(info.format.columns_per_frame, pf);
+    auto packet_buf = std::make_unique<uint8_t[]>(BUF_SIZE);
+    sensor_utils::packet_info packet_info;
+
+    std::vector<LidarScan> scans;
+    LidarScan scan(info.format.columns_per_frame,
+                   info.format.pixels_per_column,
+                   info.format.udp_profile_lidar);
+    bool first = true;
+    while (scans.size() < max_scans &&
+           sensor_utils::next_packet_info(*handle, packet_info)) {
+        auto packet_size = sensor_utils::read_packet(
+            *handle, packet_buf.get(), BUF_SIZE);
+        if (packet_size != pf.lidar_packet_size ||
+            packet_info.dst_port != info.udp_port_lidar)
+            continue;
+        if (batch_to_scan(packet_buf.get(), scan)) {
+            if (!first) scans.push_back(scan);
+            first = false;
+        }
+    }
+    return scans;
+}
+
+// a room of 40 x 40 m with a floor 1.8 m below the sensor and a few pillars,
+// seen by 128 beams spread over 45 degrees
+LidarScan synthetic_scan(const sensor::sensor_info& info, const XYZLut& lut) {
+    const size_t w = info.format.columns_per_frame;
+    const size_t h = info.format.pixels_per_column;
+    LidarScan scan(w, h, info.format.udp_profile_lidar);
+    auto range = scan.field(sensor::ChanField::RANGE);
+
+    for (size_t i = 0; i < w * h; i++) {
+        // directions are scaled to range units, offsets are in meters
+        const Eigen::Vector3d d =
+            lut.direction.row(i).transpose() / sensor::range_unit;
+        const Eigen::Vector3d o = lut.offset.row(i).transpose();
+        double t = 1e9;
+        if (d.z() < 0.0) t = std::min(t, (-1.8 - o.z()) / d.z());
+        for (int k = 0; k < 2; k++) {
+            if (d[k] > 0.0) t = std::min(t, (20.0 - o[k]) / d[k]);
+            if (d[k] < 0.0) t = std::min(t, (-20.0 - o[k]) / d[k]);
+        }
+        for (int p = 0; p < 8; p++) {
+            // pillars of 0.5 m radius on a circle of 8 m
+            const double a = p * M_PI / 4.0;
+            const double cx = 8.0 * std::cos(a) - o.x();
+            const double cy = 8.0 * std::sin(a) - o.y();
+            const double dd = d.x() * d.x() + d.y() * d.y();
+            const double dc = d.x() * cx + d.y() * cy;
+            const double disc = dc * dc - dd * (cx * cx + cy * cy - 0.25);
+            if (dd > 0.0 && disc >= 0.0) {
+                const double tp = (dc - std::sqrt(disc)) / dd;
+                if (tp > 0.0) t = std::min(t, tp);
+            }
+        }
+        range(i / w, i % w) =
+            t < 100.0 ? static_cast<uint32_t>(t / sensor::range_unit) : 0;
+    }
+    return scan;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2 && argc != 4) {
+        std::cerr << "Version: " << ouster::SDK_VERSION_FULL << " ("
+                  << ouster::BUILD_SYSTEM << ")"
+                  << "\n\nUsage: voxel_grid_benchmark <leaf_size> "
+                     "[<pcap_file> <json_file>]"
+                  << "\n\nWithout a pcap, a synthetic 2048x128 scan is used."
+                  << std::endl;
+        return argc == 1 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    const double leaf_size = std::stod(argv[1]);
+
+    sensor::sensor_info info;
+    std::vector<LidarScan> scans;
+    XYZLut lut;
+    if (argc == 4) {
+        info = sensor::metadata_from_json(argv[3]);
+        lut = make_xyz_lut(info);
+        scans = read_scans(argv[2], info, 100);
+        if (scans.empty()) {
+            std::cerr << "No complete scans in the pcap" << std::endl;
+            return EXIT_FAILURE;
+        }
+    } else {
+        info = sensor::default_sensor_info(sensor::MODE_2048x10);
+        const size_t h = 128;
+        info.format.pixels_per_column = h;
+        info.format.pixel_shift_by_row.assign(h, 0);
+        info.beam_azimuth_angles.assign(h, 0.0);
+        info.beam_altitude_angles.resize(h);
+        for (size_t u = 0; u < h; u++)
+            info.beam_altitude_angles[u] = 22.5 - 45.0 * u / (h - 1);
+        lut = make_xyz_lut(info);
+        scans.push_back(synthetic_scan(info, lut));
+    }
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+    const int n_threads = omp_get_max_threads();
+#else
+    const int n_threads = 1;
+#endif
+
+    VoxelGrid grid(leaf_size);
+    VoxelCloud cloud;
+
+    // warm up, so that tables are sized by a previous frame
+    for (const auto& scan : scans) grid(scan, lut, cloud);
+
+    const size_t n_runs = std::max<size_t>(200, scans.size());
+    size_t voxels = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < n_runs; r++) {
+        grid(scans[r % scans.size()], lut, cloud);
+        voxels += cloud.points.rows();
+    }
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    const double ms_per_scan = 1e3 * elapsed.count() / n_runs;
+    std::cout << info.format.columns_per_frame << "x"
+              << info.format.pixels_per_column << ", leaf " << leaf_size
+              << " m, " << n_threads << " thread(s): " << ms_per_scan
+              << " ms/scan, " << 1e3 / ms_per_scan << " scans/s, "
+              << voxels / n_runs << " voxels/scan" << std::endl;
+}
@@ -0,0 +1,127 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Per-pixel background model for change detection with fixed sensors
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <vector>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/**
+ * Running background model of a staggered range image, for sensors mounted
+ * on a fixed structure.
+ *
+ * Each pixel keeps an exponentially weighted mean and variance of its range.
+ * A return is foreground if it differs from the mean by more than
+ * `threshold_sigma` standard deviations and by more than `min_delta`, or if
+ * the pixel had no background return yet once the model has seen `warmup`
+ * scans. Pixels without a return are never foreground and leave the model
+ * unchanged.
+ *
+ * Background returns update the model at `rate`; foreground returns at
+ * `foreground_rate`, which lets objects that stop moving fade into the
+ * background. During warmup, the first return of a pixel initializes it.
+ * After warmup, the first return of a pixel without background seeds it at
+ * its range with zero variance. Returns of a seeded pixel are foreground and
+ * averaged into it until it has seen about 1 / `foreground_rate` of them,
+ * when it becomes background; a return far from the seeded mean seeds it
+ * anew. With the default rate of zero, seeded pixels never become
+ * background.
+ *
+ * State is kept in flat float arrays and updated by a branch-free loop over
+ * pixels, which compilers vectorize. No memory is allocated after
+ * construction.
+ */
+class BackgroundModel {
+    size_t w_, h_;
+    float rate_;
+    float foreground_rate_;
+    float sq_sigma_;
+    float sq_min_delta_;
+    uint32_t warmup_;
+    uint32_t scans_{0};
+    float absorb_age_;  // returns after which seeded pixels are background
+
+    std::vector<float> mean_;  // mm, zero if the pixel has no background
+    std::vector<float> var_;   // mm^2
+    std::vector<float> age_;   // returns of seeded pixels, zero otherwise
+    std::vector<uint32_t> changed_;
+
+   public:
+    /**
+     * Create a background model.
+     *
+     * @param[in] w horizontal resolution, i.e. the number of columns.
+     * @param[in] h vertical resolution, i.e. the number of pixels per column.
+     * @param[in] rate learning rate for background returns, in (0, 1].
+     * @param[in] threshold_sigma foreground threshold in standard deviations.
+     * @param[in] min_delta smallest range change in meters that is considered
+     * foreground.
+     * @param[in] warmup number of scans after which returns in pixels without
+     * background are foreground.
+     * @param[in] foreground_rate learning rate for foreground returns.
+     */
+    BackgroundModel(size_t w, size_t h, double rate = 0.02,
+                    double threshold_sigma = 3.0, double min_delta = 0.2,
+                    uint32_t warmup = 20, double foreground_rate = 0.0);
+
+    /**
+     * Classify the returns of a range image and update the model.
+     *
+     * @throw std::invalid_argument if image dimensions don't match the model.
+     *
+     * @param[in] range staggered range image, as the RANGE field of a
+     * LidarScan.
+     * @param[out] foreground staggered mask set to 1 for foreground returns and
+     * 0 otherwise.
+     *
+     * @return number of foreground returns.
+     */
+    size_t operator()(const Eigen::Ref<const img_t<uint32_t>>& range,
+                      Eigen::Ref<img_t<uint8_t>> foreground);
+
+    /**
+     * Classify the returns of a scan, update the model and store the
+     * foreground mask in one of the scan's fields.
+     *
+     * @throw std::invalid_argument if the mask field is missing or not UINT8,
+     * or if the scan dimensions don't match the model.
+     *
+     * @param[in, out] scan the scan.
+     * @param[in] mask_field the UINT8 field receiving the mask.
+     *
+     * @return number of foreground returns.
+     */
+    size_t operator()(LidarScan& scan, sensor::ChanField mask_field =
+                                           sensor::ChanField::CUSTOM0);
+
+    /**
+     * Get the foreground pixels of the last update.
+     *
+     * @return staggered pixel indices row * w + col, in increasing order.
+     */
+    const std::vector<uint32_t>& changed() const;
+
+    /**
+     * Get the background range of each pixel.
+     *
+     * @return staggered image of mean ranges in millimeters, zero for pixels
+     * without background; seeded pixels have the mean of their returns.
+     */
+    Eigen::Map<const img_t<float>> background() const;
+
+    /** Forget the background and restart the warmup. */
+    void reset();
+};
+
+}  // namespace ouster
@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Bird's-eye-view rasterization of lidar scans
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <vector>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/**
+ * Rasterizes lidar scans into a bird's-eye-view grid with three channels: the
+ * maximum height, the point density and the mean reflectivity of each cell,
+ * as consumed by BEV detection networks.
+ *
+ * The grid covers [x_min, x_max) x [y_min, y_max) in the frame of the XYZLut
+ * and keeps points with z in [z_min, z_max). Row 0 is at x_max and column 0
+ * at y_max, so that with the sensor frame x points up and y points left in
+ * the image. Cells without points are zero in all channels. The channels are
+ * separate images; blocks of a single (3 * rows) x cols image may be passed
+ * to get a channel-major tensor.
+ *
+ * Ranges are projected on the fly and points are sorted by bands of grid rows
+ * with a counting sort. With OpenMP enabled, each thread projects a block of
+ * pixels and rasterizes whole bands into its own tile, so no atomics are
+ * needed and every output cell is written once. No memory is allocated after
+ * the first call.
+ */
+class BevRasterizer {
+    size_t rows_, cols_;
+    float x_max_, y_max_, z_min_, z_max_;
+    float inv_res_;
+    std::vector<float> density_lut_;  // density by number of points
+
+    size_t band_rows_;
+    size_t n_bands_;
+
+    std::vector<uint32_t> cell_;        // per pixel, rows_ * cols_ if dropped
+    std::vector<float> height_;         // per pixel, above z_min
+    img_t<float> reflectivity_;         // per pixel
+    std::vector<uint32_t> order_;       // pixels sorted by band
+    std::vector<size_t> offsets_;       // per thread and band
+    std::vector<size_t> band_begin_;    // first entry of each band in order_
+    std::vector<float> tile_max_;       // per thread, one band of cells
+    std::vector<float> tile_sum_;       // per thread, one band of cells
+    std::vector<int32_t> tile_count_;   // per thread, one band of cells
+
+    template <typename T>
+    void rasterize(const LidarScan& scan, const XYZLut& lut,
+                   Eigen::Ref<img_t<T>> height, Eigen::Ref<img_t<T>> density,
+                   Eigen::Ref<img_t<T>> reflectivity, float height_scale,
+                   float density_scale);
+
+   public:
+    /**
+     * Create a rasterizer.
+     *
+     * @throw std::invalid_argument if the extent is empty, the resolution
+     * isn't positive or max_density isn't above one.
+     *
+     * @param[in] x_min, x_max extent of the grid along x in meters.
+     * @param[in] y_min, y_max extent of the grid along y in meters.
+     * @param[in] z_min, z_max heights of the points to keep in meters.
+     * @param[in] resolution cell size in meters.
+     * @param[in] max_density number of points at which the density of a
+     * cell saturates to one.
+     */
+    BevRasterizer(double x_min, double x_max, double y_min, double y_max,
+                  double z_min, double z_max, double resolution,
+                  double max_density = 64.0);
+
+    /** Number of rows of the grid, along x. */
+    size_t rows() const;
+
+    /** Number of columns of the grid, along y. */
+    size_t cols() const;
+
+    /**
+     * Rasterize a scan into float channels.
+     *
+     * The height channel holds the height of the highest point above z_min
+     * in meters, the density channel min(1, log(n + 1) / log(max_density))
+     * for n points and the reflectivity channel the mean of the REFLECTIVITY
+     * field.
+     *
+     * @throw std::invalid_argument if the lut or the outputs don't match the
+     * dimensions of the scan and the grid, or the scan has no REFLECTIVITY
+     * field.
+     *
+     * @param[in] scan the scan; pixels with zero range are skipped.
+     * @param[in] lut lookup tables generated by make_xyz_lut.
+     * @param[out] height rows() x cols() height channel.
+     * @param[out] density rows() x cols() density channel.
+     * @param[out] reflectivity rows() x cols() reflectivity channel.
+     */
+    void operator()(const LidarScan& scan, const XYZLut& lut,
+                    Eigen::Ref<img_t<float>> height,
+                    Eigen::Ref<img_t<float>> density,
+                    Eigen::Ref<img_t<float>> reflectivity);
+
+    /**
+     * Rasterize a scan into 8-bit channels.
+     *
+     * Like the float overload, with height scaled so that z_max maps to 255,
+     * density scaled so that one maps to 255 and reflectivity clamped to 255.
+     *
+     * @throw std::invalid_argument if the lut or the outputs don't match the
+     * dimensions of the scan and the grid, or the scan has no REFLECTIVITY
+     * field.
+     *
+     * @param[in] scan the scan; pixels with zero range are skipped.
+     * @param[in] lut lookup tables generated by make_xyz_lut.
+     * @param[out] height rows() x cols() height channel.
+     * @param[out] density rows() x cols() density channel.
+     * @param[out] reflectivity rows() x cols() reflectivity channel.
+     */
+    void operator()(const LidarScan& scan, const XYZLut& lut,
+                    Eigen::Ref<img_t<uint8_t>> height,
+                    Eigen::Ref<img_t<uint8_t>> density,
+                    Eigen::Ref<img_t<uint8_t>> reflectivity);
+};
+
+}  // namespace ouster
@@ -0,0 +1,127 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Edge and planar feature extraction by local curvature
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <vector>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/** Labels of feature pixels. */
+enum class FeatureLabel : uint8_t {
+    NONE = 0,     ///< not a feature
+    EDGE = 1,     ///< high curvature, e.g. a corner or a pole
+    PLANAR = 2,   ///< low curvature, on a flat surface
+};
+
+/** Features of a scan, as indices of pixels in the staggered image. */
+struct ScanFeatures {
+    std::vector<uint32_t> edges;   ///< edge pixels, u * w + v
+    std::vector<uint32_t> planes;  ///< planar pixels, u * w + v
+};
+
+/**
+ * Selects edge and planar features along the beams of a scan, as in LOAM.
+ *
+ * Each destaggered row is processed as a ring. The curvature of a return is
+ * the magnitude of the sum of range differences to the returns within
+ * `half_window` columns on either side, divided by the number of neighbours
+ * and by its range. Returns are rejected if their window contains a missing
+ * return, if they lie on the far side of a depth discontinuity within the
+ * window, where they may be occluded in the next scan, or if the ranges to
+ * both neighbours jump by more than `max_parallel` of the range, which happens
+ * when the beam is nearly parallel to the surface.
+ *
+ * Each row is split into `n_sectors` sectors of columns. In each sector, up to
+ * `max_edges` returns with the highest curvature above `edge_threshold` are
+ * picked as edges, and up to `max_planes` with the lowest curvature below
+ * `plane_threshold` as planar features. Picking a feature excludes the returns
+ * within `half_window` columns from further picks. Each pick scans its sector
+ * for the best remaining candidate instead of sorting the candidates.
+ *
+ * Curvature is computed with loops over whole rows that compilers vectorize.
+ * Rows are processed in parallel when OpenMP is enabled.
+ */
+class FeatureExtraction {
+    size_t w_, h_;
+    std::vector<int> shift_;  // destaggering shift of each row, in [0, w)
+    int n_sectors_;
+    int max_edges_, max_planes_;
+    int half_window_;
+    float edge_threshold_, plane_threshold_;
+    float max_occlusion_, max_parallel_;
+
+    // features of each row
+    std::vector<std::vector<uint32_t>> row_edges_, row_planes_;
+
+   public:
+    /**
+     * Create a feature extractor for a sensor.
+     *
+     * @throw std::invalid_argument if there are no sectors, the window is
+     * empty or wider than a sector, or a threshold is negative.
+     *
+     * @param[in] info sensor metadata.
+     * @param[in] n_sectors number of sectors per row.
+     * @param[in] max_edges maximum number of edges per sector.
+     * @param[in] max_planes maximum number of planar features per sector.
+     * @param[in] half_window neighbours on either side for the curvature.
+     * @param[in] edge_threshold minimum curvature of an edge.
+     * @param[in] plane_threshold maximum curvature of a planar feature.
+     * @param[in] max_occlusion relative depth change between neighbours
+     * treated as a discontinuity.
+     * @param[in] max_parallel relative depth change to both neighbours
+     * rejecting a return as seen at a grazing angle.
+     */
+    explicit FeatureExtraction(const sensor::sensor_info& info,
+                               int n_sectors = 6, int max_edges = 2,
+                               int max_planes = 4, int half_window = 5,
+                               double edge_threshold = 0.02,
+                               double plane_threshold = 0.002,
+                               double max_occlusion = 0.1,
+                               double max_parallel = 0.02);
+
+    /**
+     * Extract the features of a staggered range image.
+     *
+     * @throw std::invalid_argument if image dimensions don't match the sensor.
+     *
+     * @param[in] range staggered range image, as the RANGE field of a
+     * LidarScan.
+     * @param[out] labels staggered FeatureLabel of each pixel.
+     *
+     * @return the features, ordered by row, then by sector and pick.
+     */
+    ScanFeatures operator()(const Eigen::Ref<const img_t<uint32_t>>& range,
+                            Eigen::Ref<img_t<uint8_t>> labels);
+
+    /**
+     * Extract the features of a scan and store their labels in one of its
+     * fields.
+     *
+     * The scan must have been constructed with the label field, e.g. by
+     * appending {ChanField::CUSTOM0, ChanFieldType::UINT8} to the field types
+     * returned by get_field_types().
+     *
+     * @throw std::invalid_argument if the label field is missing or not UINT8.
+     *
+     * @param[in, out] scan the scan to process.
+     * @param[in] label_field the UINT8 field receiving the labels.
+     *
+     * @return the features, ordered by row, then by sector and pick.
+     */
+    ScanFeatures operator()(LidarScan& scan, sensor::ChanField label_field =
+                                                 sensor::ChanField::CUSTOM0);
+};
+
+}  // namespace ouster
@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Masking of ghost and blooming returns
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <vector>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/** Reasons a return is masked by GhostFilter, combined as bits. */
+enum GhostMask : uint8_t {
+    GHOST_FLAGGED = 1,       ///< flagged by the sensor
+    GHOST_BLOOMING = 2,      ///< halo around a retroreflector
+    GHOST_INCONSISTENT = 4,  ///< no support along its beam
+};
+
+/**
+ * Masks returns that are likely not from real targets: returns flagged by
+ * the sensor, blooming around retroreflectors and isolated returns such as
+ * range aliasing ghosts.
+ *
+ * - A return is flagged if any of the `flag_mask` bits is set in its FLAGS
+ *   field; the bits set by the sensor depend on the firmware.
+ * - Retroreflectors are returns of a reflectivity of at least
+ *   `retro_reflectivity`; the calibrated reflectivity of FW 2.1+ is above 100
+ *   only for retroreflectors. Other returns within `bloom_cols` columns and
+ *   `bloom_rows` beams of a retroreflector and within `bloom_range` times its
+ *   range of it are blooming.
+ * - A return is inconsistent if fewer than `min_support` returns within
+ *   `support_cols` columns along its beam are within `max_range_change`
+ *   times its range of it.
+ *
+ * The mask is meant to be computed right after a scan is batched. Masks are
+ * computed on the staggered image, with neighbouring beams aligned by the
+ * pixel shifts. The loops over columns are written so that compilers
+ * vectorize them; rows without retroreflectors are skipped by the blooming
+ * check. Rows are processed in parallel when OpenMP is enabled.
+ */
+class GhostFilter {
+    std::ptrdiff_t w_, h_;
+    std::vector<std::ptrdiff_t> shift_;  // pixel shifts within [0, w)
+    uint8_t flag_mask_;
+    uint32_t retro_reflectivity_;
+    int bloom_cols_, bloom_rows_;
+    float bloom_range_;
+    int support_cols_, min_support_;
+    float max_range_change_;
+
+    // per pixel: range of retroreflectors, zero elsewhere, and rows with any
+    std::vector<float> retro_;
+    std::vector<uint8_t> has_retro_;
+
+    img_t<uint16_t> reflectivity_;  // scan reflectivity, cast
+    img_t<uint8_t> flags_;          // scan flags, or zeros
+
+   public:
+    /**
+     * Create a ghost filter for a sensor.
+     *
+     * @throw std::invalid_argument if the pixel shifts don't match the sensor
+     * dimensions or a parameter is negative.
+     *
+     * @param[in] info sensor metadata.
+     * @param[in] flag_mask FLAGS bits marking ghosts; zero to ignore flags.
+     * @param[in] retro_reflectivity lowest reflectivity of retroreflectors.
+     * @param[in] bloom_cols, bloom_rows half size in columns and beams of the
+     * neighbourhood of retroreflectors checked for blooming; zero columns to
+     * disable the check.
+     * @param[in] bloom_range largest relative range difference of blooming to
+     * its retroreflector.
+     * @param[in] support_cols half size of the window along beams checked for
+     * support; zero to disable the check.
+     * @param[in] min_support fewest supporting returns of a consistent return.
+     * @param[in] max_range_change largest relative range difference of a
+     * supporting return.
+     */
+    explicit GhostFilter(const sensor::sensor_info& info,
+                         uint8_t flag_mask = 0xff,
+                         uint32_t retro_reflectivity = 101, int bloom_cols = 4,
+                         int bloom_rows = 2, double bloom_range = 0.1,
+                         int support_cols = 2, int min_support = 1,
+                         double max_range_change = 0.05);
+
+    /**
+     * Compute the ghost mask of staggered images.
+     *
+     * @throw std::invalid_argument if image dimensions don't match the sensor.
+     *
+     * @param[in] range staggered range image, as the RANGE field of a
+     * LidarScan.
+     * @param[in] reflectivity staggered reflectivity image.
+     * @param[in] flags staggered flags image.
+     * @param[out] mask staggered mask of GhostMask bits, zero for kept returns
+     * and pixels without returns; must not alias the inputs.
+     */
+    void operator()(const Eigen::Ref<const img_t<uint32_t>>& range,
+                    const Eigen::Ref<const img_t<uint16_t>>& reflectivity,
+                    const Eigen::Ref<const img_t<uint8_t>>& flags,
+                    Eigen::Ref<img_t<uint8_t>> mask);
+
+    /**
+     * Compute the ghost mask of a scan and store it in one of its fields.
+     *
+     * Uses RANGE, REFLECTIVITY and FLAGS, or the fields of the second return,
+     * and flags only if the scan has them. The scan must have been
+     * constructed with the mask field, e.g. by appending
+     * {ChanField::CUSTOM1, ChanFieldType::UINT8} to the field types returned
+     * by get_field_types().
+     *
+     * @throw std::invalid_argument if a field is missing or the mask field is
+     * not UINT8.
+     *
+     * @param[in, out] scan the scan to filter.
+     * @param[in] mask_field the UINT8 field receiving the mask.
+     * @param[in] second_return whether to mask the second return.
+     */
+    void operator()(LidarScan& scan,
+                    sensor::ChanField mask_field = sensor::ChanField::CUSTOM1,
+                    bool second_return = false);
+};
+
+}  // namespace ouster
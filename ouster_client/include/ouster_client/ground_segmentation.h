@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Ground segmentation using the column structure of the range image
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <vector>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/**
+ * Labels ground pixels by walking each destaggered column from the lowest beam
+ * upwards and checking the slope between consecutive returns.
+ *
+ * A return is ground if the slope from the last ground return (initially a
+ * point directly below the sensor at `sensor_height`) is within
+ * `max_slope_deg`. Optionally, a plane is then fit to the ground returns of
+ * each azimuth sector and all returns within `plane_distance` of it are
+ * relabeled as ground, which fills in flat areas missed by the column walk.
+ *
+ * Columns (and sectors) are processed in parallel when OpenMP is enabled.
+ */
+class GroundSegmentation {
+    size_t w_, h_;
+    double tan_max_slope_;
+    double sensor_height_;
+    int n_sectors_;
+    double plane_distance_;
+
+    // per destaggered column, beams ordered from lowest to highest altitude:
+    // pixel index into the staggered image and projection lut
+    std::vector<uint32_t> pixel_;
+    std::vector<float> dir_;  // 3 per entry
+    std::vector<float> ofs_;  // 3 per entry
+
+   public:
+    /**
+     * Create a ground segmentation kernel for a sensor.
+     *
+     * @param[in] info sensor metadata.
+     * @param[in] max_slope_deg maximum slope between consecutive ground
+     * returns along a column.
+     * @param[in] sensor_height height of the sensor frame origin above the
+     * ground in meters, or zero if unknown. When unknown, the lowest return of
+     * a column starts the ground only if its beam points below the horizon.
+     * @param[in] n_sectors number of azimuth sectors for plane refinement, or
+     * zero to disable it.
+     * @param[in] plane_distance maximum distance in meters from a sector's
+     * ground plane for a return to be relabeled as ground.
+     */
+    explicit GroundSegmentation(const sensor::sensor_info& info,
+                                double max_slope_deg = 10.0,
+                                double sensor_height = 0.0, int n_sectors = 0,
+                                double plane_distance = 0.1);
+
+    /**
+     * Compute the ground mask of a staggered range image.
+     *
+     * @throw std::invalid_argument if image dimensions don't match the sensor.
+     *
+     * @param[in] range staggered range image, as the RANGE field of a
+     * LidarScan.
+     * @param[out] mask staggered mask set to 1 for ground and 0 otherwise.
+     */
+    void operator()(const Eigen::Ref<const img_t<uint32_t>>& range,
+                    Eigen::Ref<img_t<uint8_t>> mask) const;
+
+    /**
+     * Compute the ground mask of a scan and store it in one of its fields.
+     *
+     * The scan must have been constructed with the mask field, e.g. by
+     * appending {ChanField::CUSTOM0, ChanFieldType::UINT8} to the field types
+     * returned by get_field_types().
+     *
+     * @throw std::invalid_argument if the mask field is missing or not UINT8.
+     *
+     * @param[in, out] scan the scan to segment.
+     * @param[in] mask_field the UINT8 field receiving the mask.
+     */
+    void operator()(LidarScan& scan, sensor::ChanField mask_field =
+                                         sensor::ChanField::CUSTOM0) const;
+};
+
+}  // namespace ouster
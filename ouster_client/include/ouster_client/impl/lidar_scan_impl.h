@@ -311,6 +311,12 @@ struct copy_and_cast {
                                   field_dest);
     }
 };
+
+// Pack the thermal shutdown and shot limiting statuses of a packet into the
+// frame status of a scan
+uint64_t frame_status(const uint8_t thermal_shutdown,
+                      const uint8_t shot_limiting);
+
 }  // namespace impl
 
 template <typename T>
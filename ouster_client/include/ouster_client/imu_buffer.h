@@ -0,0 +1,210 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Ring buffer of decoded IMU samples with time-indexed lookup
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "ouster_client/client.h"
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+// forward declarations
+namespace sensor {
+namespace impl {
+class BufferedUDPSource;
+}
+}  // namespace sensor
+
+/**
+ * Fixed-capacity ring of decoded IMU samples supporting lookup and linear
+ * interpolation by sensor timestamp.
+ *
+ * Samples are stored in structure-of-arrays form and keyed by the
+ * accelerometer read time (Imu::ts[1]), which is reported in the configured
+ * timestamp_mode, i.e. the same clock as the lidar column timestamps.
+ *
+ * A single writer thread may call the non-const methods while any number of
+ * reader threads call the const ones; no locks are taken. Readers detect
+ * samples overwritten during a lookup and retry, so capacity should comfortably
+ * exceed the time span that readers query (the IMU runs at ~100 Hz).
+ */
+class ImuBuffer {
+   public:
+    /** Per-sample vectors with the x, y, z components in columns. */
+    using Vectors = Eigen::Array<double, Eigen::Dynamic, 3>;
+
+    /**
+     * Called with each lidar packet encountered by consume().
+     */
+    using LidarHandler = std::function<void(const uint8_t*)>;
+
+    /**
+     * Create an empty buffer.
+     *
+     * @param[in] capacity minimum number of samples to retain; rounded up so
+     * that the internal storage is a power of two.
+     */
+    explicit ImuBuffer(size_t capacity = 1024);
+
+    ImuBuffer(const ImuBuffer&) = delete;
+    ImuBuffer& operator=(const ImuBuffer&) = delete;
+
+    /**
+     * Get the number of samples the buffer can hold.
+     *
+     * @return capacity in samples.
+     */
+    size_t capacity() const;
+
+    /**
+     * Get the number of samples currently available to readers.
+     *
+     * @return number of buffered samples.
+     */
+    size_t size() const;
+
+    /**
+     * Append a decoded sample. Writer thread only.
+     *
+     * @param[in] imu the sample to append.
+     *
+     * @return false if the sample was dropped because its timestamp is not
+     * newer than the last buffered sample.
+     */
+    bool push(const Imu& imu);
+
+    /**
+     * Decode and append a batch of IMU packets. Writer thread only.
+     *
+     * @param[in] bufs pointer to the first packet.
+     * @param[in] n_packets number of packets.
+     * @param[in] stride distance in bytes between consecutive packets.
+     * @param[in] pf the packet format used to parse the packets.
+     *
+     * @return number of samples appended.
+     */
+    size_t push_packets(const uint8_t* bufs, size_t n_packets, size_t stride,
+                        const sensor::packet_format& pf);
+
+    /**
+     * Drain packets from a buffered UDP source, decoding IMU packets into the
+     * ring. Writer thread only.
+     *
+     * Waits up to `timeout_sec` for the first packet, then takes whatever is
+     * already buffered without blocking, up to `max_packets`.
+     *
+     * @param[in] src the source to read from.
+     * @param[in] pf the packet format associated with the UDP stream.
+     * @param[in] max_packets maximum number of packets to consume.
+     * @param[in] timeout_sec maximum time to wait for the first packet.
+     * @param[in] on_lidar optional handler receiving lidar packets, which are
+     * otherwise dropped.
+     *
+     * @return bitwise or of the client states of all consumed packets, see
+     * sensor::poll_client().
+     */
+    sensor::client_state consume(sensor::impl::BufferedUDPSource& src,
+                                 const sensor::packet_format& pf,
+                                 size_t max_packets, float timeout_sec,
+                                 const LidarHandler& on_lidar = {});
+
+    /** Drop all buffered samples. Writer thread only. */
+    void clear();
+
+    /**
+     * Get the timestamps of the oldest and newest buffered samples.
+     *
+     * @param[out] first timestamp of the oldest sample.
+     * @param[out] last timestamp of the newest sample.
+     *
+     * @return false if the buffer is empty.
+     */
+    bool time_range(uint64_t& first, uint64_t& last) const;
+
+    /**
+     * Interpolate the IMU state at a timestamp.
+     *
+     * Acceleration and angular velocity are linearly interpolated between the
+     * two samples bracketing `ts`; all three timestamps of the result are set
+     * to `ts`.
+     *
+     * @param[in] ts the query timestamp.
+     * @param[out] imu the interpolated sample.
+     *
+     * @return false if `ts` is outside the buffered time range.
+     */
+    bool at(uint64_t ts, Imu& imu) const;
+
+    /**
+     * Interpolate the IMU state at a sequence of timestamps, e.g. the column
+     * timestamps of a LidarScan.
+     *
+     * Each query is bracketed by a binary search, continuing from the previous
+     * result when the timestamps are non-decreasing so that a sweep over a
+     * scan is amortized O(1) per column. Queries outside the buffered range
+     * hold the nearest sample; zero timestamps (missing columns) produce zero
+     * rows.
+     *
+     * @param[in] ts the query timestamps.
+     * @param[out] linear_accel interpolated acceleration, resized to ts.size().
+     * @param[out] angular_vel interpolated angular velocity, resized to
+     * ts.size().
+     *
+     * @return number of queries that fell inside the buffered range.
+     */
+    size_t at(const Eigen::Ref<const LidarScan::Header<uint64_t>>& ts,
+              Vectors& linear_accel, Vectors& angular_vel) const;
+
+    /**
+     * Copy out the raw samples covering a time interval: from the newest
+     * sample at or before `t0` through the oldest sample at or after `t1`.
+     *
+     * All three timestamps of each copied sample are set to its key
+     * timestamp.
+     *
+     * @param[in] t0 start of the interval.
+     * @param[in] t1 end of the interval.
+     * @param[out] out destination array of at least `max_samples` elements.
+     * @param[in] max_samples maximum number of samples to copy.
+     *
+     * @return number of samples copied; zero if the buffer is empty.
+     */
+    size_t copy(uint64_t t0, uint64_t t1, Imu* out, size_t max_samples) const;
+
+   private:
+    bool snapshot(uint64_t& begin, uint64_t& end) const;
+    bool overwritten(uint64_t idx) const;
+    uint64_t lower_bound(uint64_t begin, uint64_t end, uint64_t ts) const;
+    void lerp(uint64_t i, uint64_t ts, double* la, double* av) const;
+
+    size_t capacity_;
+    size_t mask_;
+
+    std::vector<uint64_t> accel_ts_;
+    std::array<std::vector<double>, 3> la_;
+    std::array<std::vector<double>, 3> av_;
+
+    // logical indices of the oldest valid and next written sample
+    std::atomic<uint64_t> begin_{0};
+    std::atomic<uint64_t> end_{0};
+
+    // writer-only state
+    uint64_t last_ts_{0};
+    std::vector<uint8_t> packet_buf_;
+};
+
+}  // namespace ouster
@@ -0,0 +1,157 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Preintegration of IMU measurements between timestamps
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <vector>
+
+#include "ouster_client/imu_buffer.h"
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/**
+ * Relative motion accumulated by integrating IMU measurements over an
+ * interval, expressed in the sensor frame at the start of the interval.
+ *
+ * Deltas do not include gravity, which must be applied by the user together
+ * with the initial velocity and orientation, e.g. for a start state (R, v, p)
+ * after dt seconds:
+ *
+ *   R' = R * delta_R
+ *   v' = v + g * dt + R * delta_v
+ *   p' = p + v * dt + 0.5 * g * dt^2 + R * delta_p
+ *
+ * The Jacobians give the first-order change of the deltas w.r.t. the
+ * accelerometer and gyroscope biases used during integration, so that a bias
+ * update can be applied without re-integrating.
+ */
+struct ImuPreintegrated {
+    double dt;                ///< integrated time in seconds
+    Eigen::Matrix3d delta_R;  ///< rotation increment
+    Eigen::Vector3d delta_v;  ///< velocity increment in m/s
+    Eigen::Vector3d delta_p;  ///< position increment in m
+
+    Eigen::Matrix3d dR_dbg;  ///< Jacobian of log(delta_R) w.r.t. gyro bias
+    Eigen::Matrix3d dv_dba;  ///< Jacobian of delta_v w.r.t. accel bias
+    Eigen::Matrix3d dv_dbg;  ///< Jacobian of delta_v w.r.t. gyro bias
+    Eigen::Matrix3d dp_dba;  ///< Jacobian of delta_p w.r.t. accel bias
+    Eigen::Matrix3d dp_dbg;  ///< Jacobian of delta_p w.r.t. gyro bias
+
+    /** Reset to the identity increment over a zero interval. */
+    void reset();
+};
+
+/**
+ * Integrates IMU measurements into ImuPreintegrated increments.
+ *
+ * Measurements are taken in sensor units (g and deg/s) in the IMU frame and
+ * rotated into the sensor frame using the rotation of imu_to_sensor_transform.
+ * The lever arm between the IMU and sensor origins is not compensated.
+ *
+ * Integration treats measurements as piecewise linear between samples and
+ * uses the midpoint of each sub-interval. No memory is allocated once the
+ * internal sample scratch has grown to the largest interval queried.
+ */
+class ImuPreintegrator {
+    Eigen::Matrix3d imu_to_sensor_;
+    Eigen::Vector3d accel_bias_{Eigen::Vector3d::Zero()};
+    Eigen::Vector3d gyro_bias_{Eigen::Vector3d::Zero()};
+    ImuPreintegrated delta_;
+    std::vector<Imu> samples_;
+
+    void step(const Eigen::Vector3d& a, const Eigen::Vector3d& w, double dt);
+    size_t fetch(const ImuBuffer& buf, uint64_t t0, uint64_t t1);
+    void advance(size_t n, size_t& k, uint64_t& t, uint64_t target);
+
+   public:
+    /** Standard gravity, used to convert accelerations from g to m/s^2. */
+    static constexpr double gravity = 9.80665;
+
+    /**
+     * Create a preintegrator for a sensor.
+     *
+     * @param[in] info sensor metadata providing imu_to_sensor_transform.
+     */
+    explicit ImuPreintegrator(const sensor::sensor_info& info);
+
+    /**
+     * Create a preintegrator given the IMU mounting.
+     *
+     * @param[in] imu_to_sensor_transform transform between the sensor
+     * coordinate frame and the IMU.
+     */
+    explicit ImuPreintegrator(const mat4d& imu_to_sensor_transform);
+
+    /**
+     * Set biases subtracted from subsequent measurements.
+     *
+     * @param[in] accel_bias accelerometer bias in m/s^2, sensor frame.
+     * @param[in] gyro_bias gyroscope bias in rad/s, sensor frame.
+     */
+    void set_bias(const Eigen::Vector3d& accel_bias,
+                  const Eigen::Vector3d& gyro_bias);
+
+    /** Reset the accumulated increment. */
+    void reset();
+
+    /**
+     * Integrate a constant measurement over a time step.
+     *
+     * @param[in] linear_accel acceleration in g, IMU frame.
+     * @param[in] angular_vel angular velocity in deg/s, IMU frame.
+     * @param[in] dt time step in seconds.
+     */
+    void integrate(const Eigen::Vector3d& linear_accel,
+                   const Eigen::Vector3d& angular_vel, double dt);
+
+    /**
+     * Reset and integrate buffered measurements between two timestamps.
+     *
+     * @param[in] buf the IMU samples.
+     * @param[in] t0 start timestamp in ns.
+     * @param[in] t1 end timestamp in ns.
+     *
+     * @return false if [t0, t1] is not covered by the buffered samples, in
+     * which case the accumulated increment is left reset.
+     */
+    bool integrate(const ImuBuffer& buf, uint64_t t0, uint64_t t1);
+
+    /**
+     * Integrate buffered measurements from the first valid timestamp to each
+     * of a sequence of timestamps, e.g. the column timestamps of a LidarScan.
+     *
+     * Makes a single pass over the samples and timestamps, so it is cheap to
+     * call for every column of a scan. Timestamps must be non-decreasing,
+     * except that zero timestamps (missing columns) are skipped and receive
+     * the increment of the preceding valid column.
+     *
+     * @param[in] buf the IMU samples.
+     * @param[in] ts the query timestamps in ns.
+     * @param[out] out increments from the first valid timestamp, resized to
+     * ts.size().
+     *
+     * @return false if the valid timestamps are not covered by the buffered
+     * samples, in which case all increments are left reset.
+     */
+    bool integrate(const ImuBuffer& buf,
+                   const Eigen::Ref<const LidarScan::Header<uint64_t>>& ts,
+                   std::vector<ImuPreintegrated>& out);
+
+    /**
+     * Get the increment accumulated since the last reset.
+     *
+     * @return the accumulated increment.
+     */
+    const ImuPreintegrated& delta() const;
+};
+
+}  // namespace ouster
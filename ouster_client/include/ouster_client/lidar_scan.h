@@ -316,6 +316,81 @@ struct XYZLut {
     LidarScan::Points offset;     ///< Lookup table of beam offsets
 };
 
+/**
+ * Region of interest of a scan.
+ *
+ * Columns are measurement ids of the staggered scan. A ScanBatcher only
+ * decodes the columns of the region; beams and the box further restrict the
+ * pixels projected by cartesian() through a lut made by make_roi_lut().
+ */
+struct ScanRoi {
+    /** Axis aligned box, in the frame and units of the lut. */
+    struct Box {
+        Eigen::Vector3d min;  ///< lowest corner
+        Eigen::Vector3d max;  ///< highest corner
+    };
+
+    size_t col_begin{0};  ///< first column of the region
+    size_t col_end{0};    ///< one past the last column, wrapping around if
+                          ///< below col_begin; all columns if equal
+    std::vector<size_t> beams;  ///< rows of the region; all rows if empty
+    optional<Box> box;          ///< box containing the points of the region
+};
+
+/**
+ * Make a region of interest of the columns seeing a sector of azimuths.
+ *
+ * The sector is counterclockwise from `az_begin_deg` to `az_end_deg` around
+ * the z axis of the sensor frame, with zero along its x axis. Columns are
+ * widened by the beam azimuth offsets so that pixels of all beams in the
+ * sector are included.
+ *
+ * @param[in] info sensor metadata.
+ * @param[in] az_begin_deg start of the sector in degrees.
+ * @param[in] az_end_deg end of the sector in degrees.
+ *
+ * @return region of the columns of the sector.
+ */
+ScanRoi make_sector_roi(const sensor::sensor_info& info, double az_begin_deg,
+                        double az_end_deg);
+
+/**
+ * Lookup tables restricted to a region of interest.
+ *
+ * The pixels of the region are listed as spans of consecutive staggered
+ * pixel indices, i = row * w + col, and the lookup tables hold the
+ * directions and offsets of these pixels only, in the order of the spans.
+ */
+struct XYZRoiLut {
+    size_t w{0};  ///< number of columns of the scans
+    size_t h{0};  ///< number of rows of the scans
+    std::vector<std::pair<size_t, size_t>> spans;  ///< [begin, end) pixels
+    XYZLut lut;  ///< directions and offsets of the pixels of the spans
+    /** lowest raw range of a return in the box, per pixel */
+    Eigen::Array<uint32_t, -1, 1> range_min;
+    /** highest raw range of a return in the box, per pixel */
+    Eigen::Array<uint32_t, -1, 1> range_max;
+};
+
+/**
+ * Restrict lookup tables to a region of interest.
+ *
+ * Pixels whose ray doesn't cross the box are left out, and the raw ranges at
+ * which the ray of each remaining pixel is within the box are precomputed.
+ *
+ * @throw std::invalid_argument if the lut doesn't match the dimensions or the
+ * region is out of range.
+ *
+ * @param[in] lut lookup tables generated by make_xyz_lut.
+ * @param[in] w number of columns of the scans.
+ * @param[in] h number of rows of the scans.
+ * @param[in] roi the region of interest.
+ *
+ * @return lookup tables of the pixels of the region.
+ */
+XYZRoiLut make_roi_lut(const XYZLut& lut, size_t w, size_t h,
+                       const ScanRoi& roi);
+
 /**
  * Generate a set of lookup tables useful for computing Cartesian coordinates
  * from ranges.
@@ -393,6 +468,39 @@ LidarScan::Points cartesian(const LidarScan& scan, const XYZLut& lut);
  */
 LidarScan::Points cartesian(const Eigen::Ref<const img_t<uint32_t>>& range,
                             const XYZLut& lut);
+
+/**
+ * Convert the pixels of a region of interest of a LidarScan to Cartesian
+ * points.
+ *
+ * Only the pixels of the spans of the lut are read and projected, so the work
+ * scales with the size of the region.
+ *
+ * @param[in] scan a LidarScan.
+ * @param[in] lut lookup tables generated by make_roi_lut.
+ *
+ * @return Cartesian points where the ith row is the point of the ith pixel of
+ *         the spans of the lut, or zero if its range is zero or outside the
+ *         box of the region.
+ */
+LidarScan::Points cartesian(const LidarScan& scan, const XYZRoiLut& lut);
+
+/**
+ * Convert the pixels of a region of interest of a staggered range image to
+ * Cartesian points.
+ *
+ * @throw std::invalid_argument if the image doesn't match the lut.
+ *
+ * @param[in] range a range image in the same format as the RANGE field of a
+ * LidarScan.
+ * @param[in] lut lookup tables generated by make_roi_lut.
+ *
+ * @return Cartesian points where the ith row is the point of the ith pixel of
+ *         the spans of the lut, or zero if its range is zero or outside the
+ *         box of the region.
+ */
+LidarScan::Points cartesian(const Eigen::Ref<const img_t<uint32_t>>& range,
+                            const XYZRoiLut& lut);
 /** @}*/
 
 /** \defgroup ouster_client_destagger Ouster Client lidar_scan.h
@@ -451,6 +559,10 @@ class ScanBatcher {
     uint16_t next_headers_m_id;
     std::vector<uint8_t> cache;
     bool cached_packet = false;
+    std::vector<uint8_t> decode_col;  // nonzero for columns of the roi
+
+    bool batch_packet(const uint8_t* packet_buf, LidarScan& ls,
+                      bool raw_headers);
 
    public:
     sensor::packet_format pf;  ///< The packet format object used for decoding
@@ -471,6 +583,21 @@ class ScanBatcher {
      */
     ScanBatcher(const sensor::sensor_info& info);
 
+    /**
+     * Create a batcher decoding only the columns of a region of interest.
+     *
+     * Columns outside of the region are zeroed like missing columns,
+     * including their headers and RAW_HEADERS; beams and the box of the
+     * region are ignored.
+     *
+     * @throw std::invalid_argument if the columns of the region are out of
+     * range.
+     *
+     * @param[in] info sensor metadata returned from the client.
+     * @param[in] roi the region of interest.
+     */
+    ScanBatcher(const sensor::sensor_info& info, const ScanRoi& roi);
+
     /**
      * Add a packet to the scan.
      *
@@ -480,6 +607,33 @@ class ScanBatcher {
      * @return true when the provided lidar scan is ready to use.
      */
     bool operator()(const uint8_t* packet_buf, LidarScan& ls);
+
+    /**
+     * Add a batch of packets to the scan, such as the output of a batched
+     * receive or a chunk of a pcap.
+     *
+     * Checks of the scan are done once for the batch and the headers of the
+     * next packet are prefetched while a packet is parsed. Completed scans
+     * are swapped with the elements of `scans` where they have the same
+     * dimensions and fields, so passing the same vector again reuses their
+     * storage.
+     *
+     * @throw std::invalid_argument if the scan dimensions don't match.
+     *
+     * @param[in] packet_bufs the lidar packets.
+     * @param[in] packet_sizes sizes of the packets in bytes; packets of a size
+     * other than the lidar packet size are skipped.
+     * @param[in] n_packets number of packets.
+     * @param[in] ls lidar scan to populate; batching of the last frame of the
+     * batch continues in it on the next call.
+     * @param[out] scans receives the scans completed within the batch in its
+     * first elements, in order; grown as needed.
+     *
+     * @return the number of scans completed within the batch.
+     */
+    size_t operator()(const uint8_t* const* packet_bufs,
+                      const size_t* packet_sizes, size_t n_packets,
+                      LidarScan& ls, std::vector<LidarScan>& scans);
 };
 
 /**
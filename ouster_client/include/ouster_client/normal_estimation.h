@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Surface normal estimation from range images
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <vector>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/**
+ * Estimates a surface normal at every pixel of a scan from its neighbours in
+ * the destaggered image.
+ *
+ * The normal at a pixel is the cross product of a horizontal and a vertical
+ * tangent. Each tangent is the difference between the mean points of the two
+ * half windows on either side of the pixel, (2 * half + 1) pixels across and
+ * `half` pixels deep. Window sums are accumulated over window offsets by
+ * branch-free loops over columns, which compilers vectorize, so the cost per
+ * pixel grows with `half`. Invalid pixels don't contribute to the means. A
+ * half window whose mean range differs from the pixel's by more than
+ * `max_depth_change` times the pixel's range is considered to lie across a
+ * depth discontinuity and is replaced by the pixel itself, so that surfaces
+ * aren't blended with the background. Normals point towards the sensor.
+ *
+ * The azimuth wraps around, so columns at the image seam see their neighbours
+ * on the other side. Rows are processed in parallel when OpenMP is enabled.
+ */
+class NormalEstimation {
+    std::ptrdiff_t w_, h_;
+    std::ptrdiff_t half_;
+    float max_depth_change_;
+    std::vector<int> shift_;  // destaggering shift of each row, in [0, w)
+
+    // destaggered points padded by half_ wrapped columns on each side, as
+    // planes of x, y, z and 1 for valid pixels per row; all zero for invalid
+    // pixels
+    std::vector<float> points_;
+
+   public:
+    /**
+     * Create a normal estimator for a sensor.
+     *
+     * @param[in] info sensor metadata.
+     * @param[in] half half size of the window in pixels; the window spans
+     * 2 * half + 1 pixels in each direction.
+     * @param[in] max_depth_change largest relative difference in range between
+     * a pixel and the mean of a half window.
+     */
+    explicit NormalEstimation(const sensor::sensor_info& info, int half = 2,
+                              double max_depth_change = 0.1);
+
+    /**
+     * Estimate normals for a scan, projecting ranges on the fly.
+     *
+     * @throw std::invalid_argument if image dimensions don't match the sensor.
+     *
+     * @param[in] scan the scan.
+     * @param[in] lut lookup tables generated by make_xyz_lut.
+     * @param[out] normals unit normals with one row per pixel, in the same
+     * order as cartesian(); zero where no normal could be estimated.
+     */
+    void operator()(const LidarScan& scan, const XYZLut& lut,
+                    PointsF& normals);
+
+    /**
+     * Estimate normals for points, e.g. the output of cartesian().
+     *
+     * Points at the origin are treated as invalid.
+     *
+     * @throw std::invalid_argument if the number of points doesn't match the
+     * sensor.
+     *
+     * @param[in] points staggered points, one row per pixel.
+     * @param[out] normals unit normals with one row per pixel; zero where no
+     * normal could be estimated.
+     */
+    void operator()(const LidarScan::Points& points, PointsF& normals);
+
+   private:
+    template <typename POS>
+    void run(POS&& pos, PointsF& normals);
+};
+
+}  // namespace ouster
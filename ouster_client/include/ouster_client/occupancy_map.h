@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Sparse voxel occupancy mapping from lidar scans
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/**
+ * Probabilistic 3D occupancy map integrating lidar scans along their rays.
+ *
+ * Voxels hold clamped log-odds of occupancy, zero for unknown space. For each
+ * scan, the voxel of every return is updated as a hit and the voxels crossed
+ * by its ray from the beam origin as misses. A voxel is updated at most once
+ * per scan, as a hit if any return falls into it and as a miss otherwise.
+ *
+ * Voxels are stored in bricks of 8x8x8 allocated on demand and found through
+ * an open addressing hash of brick coordinates. Memory is bounded by a
+ * maximum number of bricks: before integrating a scan, the least recently
+ * updated bricks are evicted to keep an eighth of the bricks free, and updates
+ * to new bricks that don't fit are dropped. Rays are traversed voxel by voxel
+ * with the Amanatides-Woo algorithm. With OpenMP enabled, rays are processed
+ * in parallel and each brick is locked while a ray crosses it.
+ *
+ * Queries must not run concurrently with integrate().
+ */
+class OccupancyMap {
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+
+   public:
+    /**
+     * Create an empty map.
+     *
+     * @throw std::invalid_argument if the voxel size or the maximum range
+     * isn't positive, there are fewer than 8 bricks or a probability is out of
+     * range.
+     *
+     * @param[in] voxel_size voxel edge length in meters.
+     * @param[in] max_bricks maximum number of bricks of 8x8x8 voxels.
+     * @param[in] max_range returns beyond this range in meters only clear
+     * space up to it.
+     * @param[in] p_hit occupancy probability of a voxel containing a return.
+     * @param[in] p_miss occupancy probability of a voxel crossed by a ray.
+     * @param[in] p_min lower clamping probability.
+     * @param[in] p_max upper clamping probability.
+     */
+    OccupancyMap(double voxel_size, size_t max_bricks = 65536,
+                 double max_range = 50.0, double p_hit = 0.7,
+                 double p_miss = 0.4, double p_min = 0.12,
+                 double p_max = 0.97);
+
+    /** Occupancy map destructor. */
+    ~OccupancyMap();
+
+    /**
+     * Integrate a scan.
+     *
+     * Pixels with zero range are skipped.
+     *
+     * @throw std::invalid_argument if the lut does not match the scan
+     * dimensions.
+     *
+     * @param[in] scan the scan to integrate.
+     * @param[in] lut lookup tables generated by make_xyz_lut.
+     * @param[in] pose transform from the frame of the lut to the map frame,
+     * with the translation in meters.
+     */
+    void integrate(const LidarScan& scan, const XYZLut& lut,
+                   const mat4d& pose = mat4d::Identity());
+
+    /**
+     * Get the log-odds of occupancy of the voxel containing a point.
+     *
+     * @param[in] x, y, z the point in the map frame, in meters.
+     *
+     * @return the log-odds, zero if the voxel is unknown.
+     */
+    float log_odds(double x, double y, double z) const;
+
+    /**
+     * Get the centers of all voxels with an occupancy probability above a
+     * threshold.
+     *
+     * @param[in] p_threshold occupancy probability threshold.
+     *
+     * @return voxel centers in the map frame, in unspecified order.
+     */
+    LidarScan::Points occupied(double p_threshold = 0.5) const;
+
+    /** Number of allocated bricks. */
+    size_t bricks() const;
+
+    /**
+     * Number of brick lookups that failed because the map was full, since
+     * construction or the last clear().
+     */
+    size_t dropped() const;
+
+    /** Remove all bricks. */
+    void clear();
+};
+
+}  // namespace ouster
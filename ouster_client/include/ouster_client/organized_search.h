@@ -0,0 +1,137 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Nearest neighbour search exploiting the range image structure
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <vector>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/**
+ * Radius and k-nearest neighbour search over the points of a scan without
+ * building a spatial index.
+ *
+ * Points are kept in destaggered images so that points close in space are
+ * close in the image. A query only probes a pixel window around the query
+ * pixel whose half-size is the angle asin(radius / range) divided by the
+ * angular resolution (azimuth 2 pi / w, elevation the smallest spacing
+ * between beams), plus one pixel of margin. The azimuth extent is widened by
+ * 1 / cos(elevation) to account for meridians converging away from the
+ * horizon. Every point within `radius` of the
+ * query subtends at most that angle from the sensor, so results match a
+ * kd-tree exactly except when:
+ *
+ * - the window is clamped to `max_window` pixels (radius close to or larger
+ *   than the query range), in which case only points inside the clamped
+ *   window are found;
+ * - irregular beam azimuth offsets or the beam origin offset displace a point
+ *   by more than the one-pixel margin, which only affects points near the
+ *   window boundary.
+ *
+ * Query methods are const and may be called concurrently.
+ */
+class OrganizedSearch {
+    std::ptrdiff_t w_, h_;
+    int max_window_;
+    float az_res_, el_res_;
+    std::vector<int> shift_;  // destaggering shift of each row, in [0, w)
+
+    // destaggered coordinates, NaN where invalid, and the staggered index of
+    // each destaggered pixel
+    img_t<float> x_, y_, z_;
+    img_t<uint32_t> index_;
+
+   public:
+    /** A neighbour, identified by its pixel index row * w + col. */
+    struct Neighbor {
+        uint32_t index;  ///< staggered pixel index, i.e. row of cartesian()
+        float sq_dist;   ///< squared distance to the query
+    };
+
+    /**
+     * Create a search structure for a sensor.
+     *
+     * @param[in] info sensor metadata.
+     * @param[in] max_window maximum half-size of the probed window, in
+     * pixels, along each image axis.
+     */
+    explicit OrganizedSearch(const sensor::sensor_info& info,
+                             int max_window = 32);
+
+    /**
+     * Set the points to search from a scan, projecting ranges on the fly.
+     *
+     * @param[in] scan the scan.
+     * @param[in] lut lookup tables generated by make_xyz_lut.
+     */
+    void set_input(const LidarScan& scan, const XYZLut& lut);
+
+    /**
+     * Set the points to search, e.g. from cartesian(). Points at the origin
+     * are treated as invalid.
+     *
+     * @param[in] points staggered points, one row per pixel.
+     */
+    void set_input(const LidarScan::Points& points);
+
+    /**
+     * Find all points within a radius of the point at a pixel, including the
+     * query point itself.
+     *
+     * @param[in] pixel staggered pixel index of the query point.
+     * @param[in] radius search radius in meters.
+     * @param[out] out neighbours, in unspecified order.
+     *
+     * @return number of neighbours found; zero if the query pixel is invalid.
+     */
+    size_t radius_search(uint32_t pixel, float radius,
+                         std::vector<Neighbor>& out) const;
+
+    /**
+     * Find the k nearest points to the point at a pixel, including the query
+     * point itself.
+     *
+     * The search radius starts from the spacing of neighbouring pixels and is
+     * doubled until k points are found within it or it exceeds `max_radius`.
+     *
+     * @param[in] pixel staggered pixel index of the query point.
+     * @param[in] k number of neighbours to find.
+     * @param[out] out neighbours sorted by increasing distance.
+     * @param[in] max_radius largest radius searched, in meters.
+     *
+     * @return number of neighbours found, at most k.
+     */
+    size_t knn_search(uint32_t pixel, size_t k, std::vector<Neighbor>& out,
+                      float max_radius = 2.0f) const;
+
+    /**
+     * Get the position of the point at a pixel.
+     *
+     * @param[in] pixel staggered pixel index.
+     *
+     * @return the point, or zero if the pixel is invalid.
+     */
+    Eigen::Vector3f point(uint32_t pixel) const;
+
+   private:
+    // search all pixels within du rows and dc columns of destaggered (u, c)
+    void probe(std::ptrdiff_t u, std::ptrdiff_t c, std::ptrdiff_t du,
+               std::ptrdiff_t dc, const Eigen::Vector3f& q, float sq_radius,
+               std::vector<Neighbor>& out) const;
+
+    // radius search around q at destaggered (u, c), appending to out
+    void search(std::ptrdiff_t u, std::ptrdiff_t c, const Eigen::Vector3f& q,
+                float radius, std::vector<Neighbor>& out) const;
+};
+
+}  // namespace ouster
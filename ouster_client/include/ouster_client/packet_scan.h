@@ -0,0 +1,158 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Lidar scans backed by the packets of a frame
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <bitset>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/**
+ * The lidar packets of a frame, with the fields of the scan decoded on first
+ * access.
+ *
+ * Packets are kept as received in one contiguous buffer, in the slot given
+ * by the measurement id of their first column, so adding a packet is a copy
+ * of the packet. A field is decoded the first time it is accessed, in
+ * parallel over packets when OpenMP is enabled, and cached until a packet is
+ * added or the scan is cleared. Fields that aren't accessed are never
+ * decoded. Decoded fields and headers are those ScanBatcher produces for a
+ * scan with the default fields of the profile: columns of missing packets
+ * and invalid columns are zeroed.
+ *
+ * Accessors are safe to call from several threads; adding packets and
+ * clearing are not.
+ */
+class PacketScan {
+    const sensor::packet_format& pf_;
+    std::ptrdiff_t w_, h_;
+    std::ptrdiff_t n_packets_;
+    std::vector<uint8_t> packets_;
+    std::vector<uint8_t> received_;  // nonzero for packets of the frame
+    int32_t frame_id_{-1};
+    uint64_t frame_status_{0};
+
+    // decoded fields and headers
+    mutable std::mutex decode_mx_;
+    mutable LidarScan scan_;
+    mutable std::bitset<static_cast<size_t>(sensor::ChanField::CHAN_FIELD_MAX)>
+        decoded_;
+    mutable bool headers_decoded_{false};
+
+    void decode(sensor::ChanField f) const;
+    void decode_headers() const;
+
+   public:
+    /**
+     * Create an empty scan for the packets of a sensor.
+     *
+     * @param[in] info sensor metadata.
+     */
+    explicit PacketScan(const sensor::sensor_info& info);
+
+    PacketScan(const PacketScan&) = delete;
+    PacketScan& operator=(const PacketScan&) = delete;
+
+    /** Width of the scan, in columns. */
+    std::ptrdiff_t w() const { return w_; }
+
+    /** Height of the scan, in pixels per column. */
+    std::ptrdiff_t h() const { return h_; }
+
+    /** Frame id of the packets, or -1 if the scan is empty. */
+    int32_t frame_id() const { return frame_id_; }
+
+    /** Frame status of the first packet of the frame. */
+    uint64_t frame_status() const { return frame_status_; }
+
+    /** Number of packets of the frame received. */
+    size_t packet_count() const;
+
+    /** Whether all packets of the frame were received. */
+    bool complete() const;
+
+    /**
+     * Add a lidar packet to the frame.
+     *
+     * The first packet added to an empty scan sets the frame id. Packets with
+     * measurement ids out of the scan and late packets of the previous frame
+     * are dropped.
+     *
+     * @param[in] packet_buf lidar packet of the sensor profile.
+     *
+     * @return false, without adding the packet, if it belongs to another
+     * frame; the scan should then be consumed and cleared before adding it.
+     */
+    bool add(const uint8_t* packet_buf);
+
+    /** Drop all packets and decoded fields, to start a new frame. */
+    void clear();
+
+    /**
+     * Get the type of a field.
+     *
+     * @param[in] f the field.
+     *
+     * @return the type of the field in the scan, or VOID if the sensor
+     * profile doesn't have it.
+     */
+    sensor::ChanFieldType field_type(sensor::ChanField f) const;
+
+    /**
+     * Access a field, decoding it if needed.
+     *
+     * The reference is valid until a packet is added or the scan is cleared.
+     *
+     * @throw std::invalid_argument if the profile doesn't have the field.
+     *
+     * @tparam T type of the field, as given by field_type().
+     * @param[in] f the field.
+     *
+     * @return the field as a staggered image.
+     */
+    template <typename T = uint32_t>
+    Eigen::Ref<const img_t<T>> field(sensor::ChanField f) const;
+
+    /**
+     * Access the measurement timestamps, decoding headers if needed.
+     *
+     * @return the timestamp of each column, zero for missing columns.
+     */
+    Eigen::Ref<const LidarScan::Header<uint64_t>> timestamp() const;
+
+    /**
+     * Access the measurement ids, decoding headers if needed.
+     *
+     * @return the measurement id of each column, zero for missing columns.
+     */
+    Eigen::Ref<const LidarScan::Header<uint16_t>> measurement_id() const;
+
+    /**
+     * Access the measurement statuses, decoding headers if needed.
+     *
+     * @return the status of each column, zero for missing columns.
+     */
+    Eigen::Ref<const LidarScan::Header<uint32_t>> status() const;
+
+    /**
+     * Decode all fields and headers.
+     *
+     * @return the decoded scan, valid until a packet is added or the scan is
+     * cleared.
+     */
+    const LidarScan& scan() const;
+};
+
+}  // namespace ouster
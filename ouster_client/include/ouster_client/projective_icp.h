@@ -0,0 +1,170 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Scan registration by projective ICP
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <vector>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/** Outcome of a registration. */
+struct IcpResult {
+    mat4d transform;  ///< transform from the source to the target frame
+    size_t inliers;   ///< associations used by the last iteration
+    double rms;       ///< rms point-to-plane residual of the inliers, meters
+    int iterations;   ///< Gauss-Newton iterations over all levels
+    bool converged;   ///< whether the finest level converged within its
+                      ///< iterations
+};
+
+/**
+ * Registers scans to a target scan, or to a model rendered as a range image
+ * of the same sensor, by point-to-plane ICP with projective data association.
+ *
+ * Instead of searching for the nearest target point, each source point is
+ * projected into the destaggered target image through the beam angles of the
+ * sensor and associated with the target point at that pixel. Associations
+ * farther apart than the gating distance are rejected and the others are
+ * weighted by a Cauchy kernel of their residual. Target normals are the
+ * cross products of central differences in the destaggered image.
+ *
+ * Registration runs coarse to fine: level l uses every 2^l-th row and column
+ * of the source and of the target, whose normals are computed at that
+ * resolution, and a gating distance 2^l times the finest one. Each level
+ * starts from the pose of the coarser one, so the finest level, where
+ * iterations cost the most, is given fewer of them. When tracking, passing
+ * the previous transform as the guess saves iterations on all levels.
+ *
+ * Points are processed in blocks: projection and residuals are computed in
+ * loops without branches, and the normal equations are accumulated in
+ * separate lanes, so that compilers vectorize them. Blocks are processed in
+ * parallel when OpenMP is enabled.
+ *
+ * The lookup tables passed to the methods must be the ones generated by
+ * make_xyz_lut() for the sensor info given to the constructor.
+ */
+class ProjectiveIcp {
+    std::ptrdiff_t w_, h_;
+    int levels_;
+    int max_iterations_;
+    int max_fine_iterations_;
+    float max_distance_;
+    float robust_scale_;
+
+    std::vector<int> shift_;  // destaggering shift of each row, in [0, w)
+
+    // projection from the frame of the lut to destaggered pixels
+    Eigen::Matrix3f to_lidar_rot_;
+    Eigen::Vector3f to_lidar_trans_;
+    float beam_radius_, beam_height_;  // beam origin in the lidar frame
+    float el_min_, inv_el_bin_;
+
+    struct TargetPoint {
+        float x, y, z, nx, ny, nz;
+    };
+
+    // every 2^l-th row and column of the destaggered images
+    struct Level {
+        std::ptrdiff_t w, h;
+        float inv_az_res;
+        std::vector<float> col_offset;  // column offset of each row
+        std::vector<int16_t> el_rows;   // nearest row by elevation, or -1
+        std::vector<TargetPoint> target;  // zero normal where invalid
+        std::vector<float> source[3];  // valid source points, by coordinate
+    };
+    std::vector<Level> pyramid_;
+    bool has_target_{false};
+
+    // staggered input points, zero where invalid
+    std::vector<Eigen::Vector3f> points_;
+
+    void load(const LidarScan& scan, const XYZLut& lut);
+    void load(const LidarScan::Points& points);
+    void update_target();
+    IcpResult update_source(const mat4d& guess);
+
+   public:
+    /**
+     * Create a registration engine for a sensor.
+     *
+     * @throw std::invalid_argument if levels or the iteration counts aren't
+     * positive, or max_distance or robust_scale isn't positive.
+     *
+     * @param[in] info sensor metadata.
+     * @param[in] levels number of pyramid levels.
+     * @param[in] max_iterations maximum Gauss-Newton iterations of each
+     * coarse level.
+     * @param[in] max_fine_iterations maximum Gauss-Newton iterations of the
+     * finest level.
+     * @param[in] max_distance gating distance of the finest level, meters.
+     * @param[in] robust_scale scale of the Cauchy kernel, meters.
+     */
+    explicit ProjectiveIcp(const sensor::sensor_info& info, int levels = 3,
+                           int max_iterations = 10, int max_fine_iterations = 2,
+                           double max_distance = 0.5,
+                           double robust_scale = 0.1);
+
+    /**
+     * Set the target from a scan.
+     *
+     * @throw std::invalid_argument if the scan or the lut doesn't match the
+     * sensor.
+     *
+     * @param[in] scan the target scan.
+     * @param[in] lut lookup tables generated by make_xyz_lut.
+     */
+    void set_target(const LidarScan& scan, const XYZLut& lut);
+
+    /**
+     * Set the target from points, e.g. a model rendered as a range image.
+     * Points at the origin are treated as invalid.
+     *
+     * @throw std::invalid_argument if the points don't match the sensor.
+     *
+     * @param[in] points staggered points in the frame of the lut, one row per
+     * pixel.
+     */
+    void set_target(const LidarScan::Points& points);
+
+    /**
+     * Register a scan to the target.
+     *
+     * @throw std::invalid_argument if the scan or the lut doesn't match the
+     * sensor.
+     * @throw std::logic_error if no target was set.
+     *
+     * @param[in] scan the source scan.
+     * @param[in] lut lookup tables generated by make_xyz_lut.
+     * @param[in] guess initial transform from the source to the target frame.
+     *
+     * @return the registration result.
+     */
+    IcpResult align(const LidarScan& scan, const XYZLut& lut,
+                    const mat4d& guess = mat4d::Identity());
+
+    /**
+     * Register points to the target. Points at the origin are skipped.
+     *
+     * @throw std::invalid_argument if the points don't match the sensor.
+     * @throw std::logic_error if no target was set.
+     *
+     * @param[in] points staggered source points, one row per pixel.
+     * @param[in] guess initial transform from the source to the target frame.
+     *
+     * @return the registration result.
+     */
+    IcpResult align(const LidarScan::Points& points,
+                    const mat4d& guess = mat4d::Identity());
+};
+
+}  // namespace ouster
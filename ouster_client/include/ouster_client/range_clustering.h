@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Connected component clustering of range images
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <vector>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/** Statistics of a cluster of pixels. */
+struct RangeCluster {
+    uint32_t label;            ///< label of the cluster's pixels, from 1
+    uint32_t count;            ///< number of pixels
+    Eigen::Vector3f min;       ///< lower corner of the bounding box
+    Eigen::Vector3f max;       ///< upper corner of the bounding box
+    Eigen::Vector3f centroid;  ///< mean of the cluster's points
+};
+
+/**
+ * Segments a scan into objects by finding connected components of the
+ * destaggered range image.
+ *
+ * Horizontally and vertically adjacent returns are connected when the angle
+ * between the sensor ray of the farther return and the line joining both
+ * returns is larger than `angle_threshold_deg`. Small angles mean that the
+ * line runs nearly along the ray, i.e. a depth discontinuity between two
+ * objects. The azimuth wraps around.
+ *
+ * Components are found with a union-find over pixels with path compression.
+ * With OpenMP enabled, each thread links a strip of rows and the boundaries
+ * between strips are merged afterwards. Buffers are kept between calls so
+ * that steady-state clustering does not allocate.
+ */
+class RangeClustering {
+    size_t w_, h_;
+    float tan_threshold_;
+    uint32_t min_points_;
+
+    // staggered pixel of each destaggered pixel, row-major
+    std::vector<uint32_t> pixel_;
+    // projection lut by destaggered pixel, 3 per pixel
+    std::vector<float> dir_;
+    std::vector<float> ofs_;
+    // sine and cosine of the angle to the next column and the next row
+    float sin_col_, cos_col_;
+    std::vector<float> sin_row_, cos_row_;
+
+    // per destaggered pixel: parent in the union-find, then cluster index
+    std::vector<uint32_t> parent_;
+    std::vector<uint32_t> index_;
+    std::vector<float> ranges_;
+    std::vector<double> sums_;
+
+   public:
+    /**
+     * Create a clustering kernel for a sensor.
+     *
+     * @param[in] info sensor metadata.
+     * @param[in] angle_threshold_deg smallest angle between the ray and the
+     * line joining two adjacent returns for them to be connected.
+     * @param[in] min_points clusters with fewer pixels are left unlabeled.
+     */
+    explicit RangeClustering(const sensor::sensor_info& info,
+                             double angle_threshold_deg = 10.0,
+                             uint32_t min_points = 10);
+
+    /**
+     * Cluster a staggered range image.
+     *
+     * @throw std::invalid_argument if image dimensions don't match the sensor.
+     *
+     * @param[in] range staggered range image, as the RANGE field of a
+     * LidarScan.
+     * @param[in] exclude staggered mask of pixels to ignore, e.g. ground, or
+     * an empty image to use all returns.
+     * @param[out] labels staggered image set to the label of each pixel's
+     * cluster, or 0 for pixels without one.
+     * @param[out] clusters statistics of each cluster, ordered by label.
+     */
+    void operator()(const Eigen::Ref<const img_t<uint32_t>>& range,
+                    const Eigen::Ref<const img_t<uint8_t>>& exclude,
+                    Eigen::Ref<img_t<uint32_t>> labels,
+                    std::vector<RangeCluster>& clusters);
+
+    /**
+     * Cluster a scan and store the labels in one of its fields.
+     *
+     * The scan must have been constructed with the label field, e.g. by
+     * appending {ChanField::CUSTOM1, ChanFieldType::UINT32} to the field types
+     * returned by get_field_types().
+     *
+     * @throw std::invalid_argument if the label field is missing or not UINT32.
+     *
+     * @param[in, out] scan the scan to cluster.
+     * @param[out] clusters statistics of each cluster, ordered by label.
+     * @param[in] label_field the UINT32 field receiving the labels.
+     */
+    void operator()(LidarScan& scan, std::vector<RangeCluster>& clusters,
+                    sensor::ChanField label_field = sensor::ChanField::CUSTOM1);
+};
+
+}  // namespace ouster
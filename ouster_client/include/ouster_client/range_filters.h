@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Spatial denoising and hole filling of range images
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <cstdint>
+
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/** \defgroup ouster_client_range_filters Ouster Client range_filters.h
+ * Spatial filters for range images.
+ *
+ * The filters take a range image in millimeters with zero for missing
+ * returns, like the RANGE field of a LidarScan. Filters working along rows
+ * give the same result on staggered and destaggered images. Filters using a
+ * 2D neighbourhood should be applied to destaggered images, where vertical
+ * neighbours are adjacent in space.
+ *
+ * Rows are split in tiles that fit in L1 cache, and the arithmetic over each
+ * tile is written so that compilers vectorize it. Rows are processed in
+ * parallel when OpenMP is enabled.
+ * @{
+ */
+/**
+ * 3x3 median filter.
+ *
+ * Missing returns take part in the median, so isolated returns are removed and
+ * isolated dropouts surrounded by returns are filled. Borders are replicated.
+ *
+ * @throw std::invalid_argument if image dimensions don't match.
+ *
+ * @param[in] range range image.
+ * @param[out] out filtered image; must not alias range.
+ */
+void median_filter(const Eigen::Ref<const img_t<uint32_t>>& range,
+                   Eigen::Ref<img_t<uint32_t>> out);
+
+/**
+ * Bilateral filter.
+ *
+ * Each return is replaced by the mean of the returns in a window of radius
+ * `radius` pixels, weighted by a Gaussian of their pixel distance and a
+ * Gaussian of their range difference, so that depth edges are preserved.
+ * Missing returns stay missing and don't contribute.
+ *
+ * @throw std::invalid_argument if image dimensions don't match.
+ *
+ * @param[in] range range image.
+ * @param[out] out filtered image; must not alias range.
+ * @param[in] radius window radius in pixels.
+ * @param[in] sigma_space standard deviation of the spatial weights in pixels.
+ * @param[in] sigma_range standard deviation of the range weights in meters.
+ */
+void bilateral_filter(const Eigen::Ref<const img_t<uint32_t>>& range,
+                      Eigen::Ref<img_t<uint32_t>> out, int radius = 2,
+                      double sigma_space = 1.5, double sigma_range = 0.1);
+
+/**
+ * Joint bilateral filter of range guided by a second channel such as
+ * reflectivity.
+ *
+ * Like bilateral_filter(), with the weights further multiplied by a Gaussian of
+ * the difference in the guide image, so that range isn't smoothed across
+ * material boundaries.
+ *
+ * @throw std::invalid_argument if image dimensions don't match.
+ *
+ * @param[in] range range image.
+ * @param[in] guide guide image, e.g. REFLECTIVITY cast to float.
+ * @param[out] out filtered image; must not alias range.
+ * @param[in] radius window radius in pixels.
+ * @param[in] sigma_space standard deviation of the spatial weights in pixels.
+ * @param[in] sigma_range standard deviation of the range weights in meters.
+ * @param[in] sigma_guide standard deviation of the guide weights, in units of
+ * the guide image.
+ */
+void joint_bilateral_filter(const Eigen::Ref<const img_t<uint32_t>>& range,
+                            const Eigen::Ref<const img_t<float>>& guide,
+                            Eigen::Ref<img_t<uint32_t>> out, int radius = 2,
+                            double sigma_space = 1.5, double sigma_range = 0.1,
+                            double sigma_guide = 10.0);
+
+/**
+ * Fill short runs of missing returns along rows.
+ *
+ * A run of at most `max_gap` missing returns is filled by linear
+ * interpolation if the returns on either side differ by at most `max_change`
+ * times the nearer of the two, i.e. if they likely lie on the same surface.
+ *
+ * @throw std::invalid_argument if image dimensions don't match.
+ *
+ * @param[in] range range image.
+ * @param[out] out filled image; may alias range.
+ * @param[in] max_gap longest run of missing returns to fill.
+ * @param[in] max_change largest relative range difference across a gap.
+ */
+void fill_gaps(const Eigen::Ref<const img_t<uint32_t>>& range,
+               Eigen::Ref<img_t<uint32_t>> out, int max_gap = 2,
+               double max_change = 0.05);
+/** @}*/
+
+}  // namespace ouster
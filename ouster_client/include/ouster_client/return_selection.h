@@ -0,0 +1,58 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Merging of the two returns of dual return scans
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/** Which of the two returns of a pixel to keep. */
+enum class ReturnPolicy {
+    STRONGEST,  ///< the return of highest signal
+    FIRST,      ///< the nearest return
+    LAST,       ///< the farthest return
+    NON_GHOST,  ///< a return without ghost flags, then the strongest
+};
+
+/**
+ * Merge the two returns of a dual return scan into a single return per pixel.
+ *
+ * Reads RANGE, RANGE2, SIGNAL, SIGNAL2, REFLECTIVITY, REFLECTIVITY2 and, if
+ * present, FLAGS and FLAGS2, with the types of the dual return profiles, and
+ * writes the RANGE, SIGNAL, REFLECTIVITY and FLAGS fields of the output that
+ * exist with the values of the selected return, in a single vectorized pass.
+ * FLAGS of the output is only written if the input has flags. A missing
+ * return, of zero range, is only selected if both are missing. Ties go to
+ * the first return. Other fields and column headers are left as they are.
+ *
+ * Returns with any of the `ghost_flags` bits set in their FLAGS field are
+ * ghosts for the NON_GHOST policy; the bits set by the sensor depend on the
+ * firmware.
+ *
+ * @throw std::invalid_argument if a field of the input is missing or of an
+ * unexpected type, flags are missing for the NON_GHOST policy, the scans
+ * differ in dimensions, a field of the output doesn't have the type of the
+ * input field or `which` isn't UINT8.
+ *
+ * @param[in] in dual return scan.
+ * @param[out] out scan receiving the merged return; may be the input.
+ * @param[in] policy which return to keep.
+ * @param[in] which UINT8 field of the output receiving the selected return:
+ * 1 or 2, or 0 if both are missing; not written if the output has no such
+ * field.
+ * @param[in] ghost_flags flag bits marking ghosts.
+ */
+void select_returns(const LidarScan& in, LidarScan& out, ReturnPolicy policy,
+                    sensor::ChanField which = sensor::ChanField::CUSTOM0,
+                    uint8_t ghost_flags = 0xff);
+
+}  // namespace ouster
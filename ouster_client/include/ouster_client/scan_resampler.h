@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Resampling of scans between column resolutions and beam subsets
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/** How output pixels are computed from the input columns they cover. */
+enum class ResampleMode {
+    NEAREST,      ///< the input column nearest in azimuth
+    MAX_POOL,     ///< the maximum of each field over the covered columns
+    RANGE_AWARE,  ///< the mean over returns at the depth of the nearest one
+};
+
+/**
+ * Resamples scans to another number of columns per frame and a subset of the
+ * beams, e.g. to feed scans of 512, 1024 and 2048 column sensors to a network
+ * with a fixed input size.
+ *
+ * Columns are resampled in the staggered image, where a column corresponds to
+ * an encoder angle: output column v' covers the input columns whose angle is
+ * nearer to its own than to that of its neighbours, or the nearest input
+ * column when upsampling. Column headers are taken from the nearest input
+ * column, with measurement ids scaled to the output resolution. The output
+ * sensor info has the selected beams, pixel shifts scaled to the output
+ * resolution and the matching lidar mode, if any, so that destagger() and
+ * make_xyz_lut() work on the output as on a scan of a real sensor.
+ *
+ * In RANGE_AWARE mode, the reference of an output pixel is the nearest return
+ * among the covered pixels. Fields are averaged over the returns within
+ * `max_depth_change` times the reference range of it, so that foreground and
+ * background are never blended; fields of the second return use the returns
+ * of RANGE2. Flags and raw fields take the value of the reference pixel.
+ * Pixels without returns take the values of the nearest column. In MAX_POOL
+ * mode, flags and raw fields take the value of the nearest column, since
+ * they hold bits rather than quantities.
+ *
+ * RAW_HEADERS columns are copied whole from the nearest input column, as
+ * their rows hold packed headers rather than beams.
+ *
+ * The loops over output columns run over precomputed window taps so that
+ * compilers vectorize them. Rows are processed in parallel when OpenMP is
+ * enabled.
+ */
+class ScanResampler {
+    size_t w_, h_;          // input
+    size_t out_w_, out_h_;  // output
+    ResampleMode mode_;
+    float max_depth_change_;
+    sensor::sensor_info out_info_;
+
+    std::vector<size_t> beams_;  // input row of each output row
+
+    // input columns covered by each output column: n_taps_ rows of out_w_
+    // taps, the last real tap repeated with a zero mask in shorter windows
+    size_t n_taps_;
+    std::vector<uint32_t> taps_;
+    std::vector<float> tap_mask_;
+    std::vector<uint32_t> nearest_;  // input column nearest in azimuth
+
+    // RANGE_AWARE weights of the taps of each output pixel and the input
+    // column of the reference, for the first and second returns
+    std::vector<float> weights_[2];
+    std::vector<uint32_t> reference_[2];
+
+    template <typename T>
+    void resample(Eigen::Ref<const img_t<T>> in, Eigen::Ref<img_t<T>> out,
+                  int ret, bool average) const;
+
+    void update_weights(const LidarScan& scan, sensor::ChanField range,
+                        int ret);
+
+   public:
+    /**
+     * Create a resampler for a sensor.
+     *
+     * @throw std::invalid_argument if the number of columns is zero, a beam
+     * index is out of range or the sensor info is inconsistent.
+     *
+     * @param[in] info input sensor metadata.
+     * @param[in] columns output columns per frame.
+     * @param[in] beams input rows of the output rows; all rows if empty.
+     * @param[in] mode how output pixels are computed.
+     * @param[in] max_depth_change largest relative range difference to the
+     * reference of the returns averaged in RANGE_AWARE mode.
+     */
+    ScanResampler(const sensor::sensor_info& info, size_t columns,
+                  const std::vector<size_t>& beams = {},
+                  ResampleMode mode = ResampleMode::NEAREST,
+                  double max_depth_change = 0.05);
+
+    /**
+     * Get the metadata of a sensor producing the output scans.
+     *
+     * @return the output sensor info.
+     */
+    const sensor::sensor_info& output_info() const;
+
+    /**
+     * Make the lookup tables of the output scans.
+     *
+     * @return make_xyz_lut() of the output sensor info.
+     */
+    XYZLut output_lut() const;
+
+    /**
+     * Resample a scan into a preallocated scan.
+     *
+     * All fields of the output scan are resampled from the input fields of
+     * the same name, which must exist.
+     *
+     * @throw std::invalid_argument if the scans don't match the input and
+     * output dimensions, a field is missing or of another type, or the
+     * output has RAW_HEADERS and a subset of the beams.
+     *
+     * @param[in] in the input scan.
+     * @param[out] out the output scan.
+     */
+    void operator()(const LidarScan& in, LidarScan& out);
+
+    /**
+     * Resample a scan.
+     *
+     * @throw std::invalid_argument if the scan doesn't match the input
+     * dimensions.
+     *
+     * @param[in] in the input scan.
+     *
+     * @return a scan of the output dimensions with the fields of the input.
+     */
+    LidarScan operator()(const LidarScan& in);
+};
+
+}  // namespace ouster
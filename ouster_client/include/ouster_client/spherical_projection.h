@@ -0,0 +1,144 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Projection of point clouds into range images of a sensor
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/**
+ * Projects arbitrary point clouds, e.g. fused or transformed scans, into the
+ * staggered range image a sensor would have measured from the origin.
+ *
+ * This is the inverse of cartesian(): a point falls into the pixel of the beam
+ * nearest in elevation and of the column nearest in azimuth, with the range
+ * measured along that pixel's ray as in the lookup tables of make_xyz_lut().
+ * Points farther than half the largest gap between beams above the highest or
+ * below the lowest beam are dropped. When several points fall into a pixel,
+ * the nearest one wins; ties go to the lowest point index, so the result
+ * doesn't depend on scheduling.
+ *
+ * Rows are found through a precomputed table indexed by elevation. Conflicts
+ * are resolved with an atomic minimum over the range and point index packed
+ * in 64 bits, so points are projected in parallel when OpenMP is enabled.
+ */
+class SphericalProjection {
+    std::ptrdiff_t w_, h_;
+
+    // from the frame of the lut to the lidar frame
+    Eigen::Matrix3f to_lidar_rot_;
+    Eigen::Vector3f to_lidar_trans_;
+    float beam_radius_, beam_height_;  // beam origin in the lidar frame
+    float beam_distance_;  // distance of the beam origin, added to ranges
+
+    // staggered column of an azimuth, by row
+    float inv_az_res_;
+    std::vector<float> col_offset_;
+    float el_min_, inv_el_bin_;
+    std::vector<int16_t> el_rows_;  // nearest row by elevation
+
+    // ray directions: encoder angle by column, beam angles by row
+    std::vector<float> enc_cos_, enc_sin_;
+    std::vector<float> az_cos_, az_sin_, alt_cos_, alt_sin_;
+
+    // range in millimeters and point index of the nearest point per pixel
+    std::unique_ptr<std::atomic<uint64_t>[]> zbuf_;
+
+    img_t<uint32_t> index_;
+    size_t n_points_{0};
+
+    template <typename T>
+    void project(const PointsT<T>& points, Eigen::Ref<img_t<uint32_t>> range,
+                 Eigen::Ref<img_t<uint32_t>> index);
+
+   public:
+    /** Index of pixels without a point. */
+    static constexpr uint32_t no_point = 0xffffffff;
+
+    /**
+     * Create a projection for a sensor.
+     *
+     * @throw std::invalid_argument if the beam angles don't match the sensor
+     * dimensions.
+     *
+     * @param[in] info sensor metadata.
+     */
+    explicit SphericalProjection(const sensor::sensor_info& info);
+
+    /** Spherical projection destructor. */
+    ~SphericalProjection();
+
+    /**
+     * Project points into range and index images.
+     *
+     * Points at the origin or with non-finite coordinates are skipped.
+     *
+     * @throw std::invalid_argument if image dimensions don't match the sensor
+     * or there are too many points to index.
+     *
+     * @param[in] points points in the frame of the lut, in meters.
+     * @param[out] range staggered range image in millimeters, zero where no
+     * point falls.
+     * @param[out] index staggered index image: the row in points of the point
+     * of each pixel, or no_point.
+     */
+    void operator()(const PointsD& points, Eigen::Ref<img_t<uint32_t>> range,
+                    Eigen::Ref<img_t<uint32_t>> index);
+
+    /** @copydoc operator()(const PointsD&, Eigen::Ref<img_t<uint32_t>>,
+     * Eigen::Ref<img_t<uint32_t>>) */
+    void operator()(const PointsF& points, Eigen::Ref<img_t<uint32_t>> range,
+                    Eigen::Ref<img_t<uint32_t>> index);
+
+    /**
+     * Project points into the RANGE field of a scan.
+     *
+     * Other fields and the column headers are left as they are; values of
+     * the points can be added to other fields with gather(). The index image
+     * is kept until the next projection.
+     *
+     * @throw std::invalid_argument if the scan doesn't match the sensor or
+     * there are too many points to index.
+     *
+     * @param[in] points points in the frame of the lut, in meters.
+     * @param[in, out] scan the scan receiving the ranges.
+     */
+    void operator()(const PointsD& points, LidarScan& scan);
+
+    /** @copydoc operator()(const PointsD&, LidarScan&) */
+    void operator()(const PointsF& points, LidarScan& scan);
+
+    /**
+     * Fill a field of a scan with values of the points it was projected from,
+     * e.g. their reflectivity. Values are cast to the field type and pixels
+     * without a point are set to zero.
+     *
+     * @throw std::invalid_argument if there isn't one value for each point of
+     * the last projection into a scan, the scan doesn't match the sensor or
+     * the field is missing.
+     *
+     * @param[in] values one value per point.
+     * @param[in, out] scan the scan of the last projection.
+     * @param[in] field the field to fill.
+     */
+    void gather(const Eigen::Ref<const Eigen::ArrayXd>& values,
+                LidarScan& scan, sensor::ChanField field) const;
+
+    /** Index image of the last projection into a scan. */
+    const img_t<uint32_t>& index() const;
+};
+
+}  // namespace ouster
@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Temporal median filtering of range images
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <vector>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/**
+ * Removes single-scan speckle, such as returns from rain, dust or sunlight,
+ * by taking the per-pixel median of the range over the last K scans.
+ *
+ * Pixels without a return count as zero range, so a return that is absent
+ * from most of the last K scans is removed. A return of the current scan is
+ * reported as noise if it differs from the median by more than `min_delta`
+ * and by more than `tolerance` times the median. The filter assumes a static
+ * or slowly moving sensor: objects moving by more than the tolerance within
+ * K scans are filtered too.
+ *
+ * The last K range images are kept in a ring. Medians are computed by a
+ * sorting network of compare-exchange steps applied to blocks of pixels,
+ * which compilers vectorize. Blocks are processed in parallel when OpenMP is
+ * enabled. No memory is allocated after construction.
+ */
+class TemporalFilter {
+    size_t w_, h_;
+    size_t k_;
+    float tolerance_;
+    uint32_t min_delta_;
+
+    std::vector<uint32_t> ring_;  // k_ images
+    size_t next_{0};               // slot of the next image
+    size_t count_{0};              // number of images in the ring
+
+   public:
+    /** Largest supported number of scans. */
+    static constexpr size_t max_scans = 15;
+
+    /**
+     * Create a temporal filter.
+     *
+     * @throw std::invalid_argument if k is zero or larger than max_scans.
+     *
+     * @param[in] w horizontal resolution, i.e. the number of columns.
+     * @param[in] h vertical resolution, i.e. the number of pixels per column.
+     * @param[in] k number of scans, preferably odd.
+     * @param[in] tolerance largest relative difference to the median for a
+     * return not to be noise.
+     * @param[in] min_delta largest difference to the median in meters for a
+     * return not to be noise, for returns at short range.
+     */
+    TemporalFilter(size_t w, size_t h, size_t k = 5, double tolerance = 0.05,
+                   double min_delta = 0.1);
+
+    /**
+     * Add a range image to the ring and filter it.
+     *
+     * Until k images have been added, the median is taken over the images
+     * added so far. The output images may be the input.
+     *
+     * @throw std::invalid_argument if image dimensions don't match the filter.
+     *
+     * @param[in] range staggered range image, as the RANGE field of a
+     * LidarScan.
+     * @param[out] filtered staggered median range image.
+     * @param[out] noise staggered mask set to 1 for returns of `range` that
+     * were reported as noise and 0 otherwise.
+     */
+    void operator()(const Eigen::Ref<const img_t<uint32_t>>& range,
+                    Eigen::Ref<img_t<uint32_t>> filtered,
+                    Eigen::Ref<img_t<uint8_t>> noise);
+
+    /**
+     * Filter a scan, storing the filtered range and the noise mask in its
+     * fields.
+     *
+     * @throw std::invalid_argument if the filtered field is missing or not
+     * UINT32, if the mask field is missing or not UINT8, or if the scan
+     * dimensions don't match the filter.
+     *
+     * @param[in, out] scan the scan.
+     * @param[in] filtered_field the UINT32 field receiving the filtered range;
+     * RANGE filters the scan in place.
+     * @param[in] mask_field the UINT8 field receiving the noise mask.
+     */
+    void operator()(
+        LidarScan& scan,
+        sensor::ChanField filtered_field = sensor::ChanField::RANGE,
+        sensor::ChanField mask_field = sensor::ChanField::CUSTOM0);
+
+    /** Discard all images in the ring. */
+    void reset();
+};
+
+}  // namespace ouster
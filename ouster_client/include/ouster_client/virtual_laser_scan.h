@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Extraction of planar laser scans from lidar scans
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/**
+ * Turns lidar scans into planar laser scans for 2D SLAM and safety systems
+ * that expect a single scanning plane.
+ *
+ * The full turn around the z axis of the lut frame is split into bins of
+ * equal angle, counterclockwise from the x axis: bin i covers the azimuths
+ * within half a bin of i * angle_increment(). The range of a bin is the
+ * smallest horizontal distance to the z axis among the returns of the
+ * selected beams whose height is within [z_min, z_max] and whose horizontal
+ * distance is within [range_min, range_max]. Pixels are binned by the
+ * azimuth of their ray, which differs from that of their point by the
+ * offset of the beam origin, a few hundredths of a degree beyond a meter.
+ *
+ * Heights and horizontal distances are linear in the range along a ray, so
+ * all bounds reduce to an interval of raw ranges per pixel, precomputed with
+ * the slopes of the lut; points are never computed. Rows whose intervals are
+ * all empty are skipped. Rows are processed in parallel when OpenMP is
+ * enabled.
+ */
+class VirtualLaserScan {
+    size_t w_, h_;
+    size_t n_bins_;
+
+    // per staggered pixel: raw range interval of the points to keep, slope
+    // and offset of the horizontal distance in the range, and bin
+    std::vector<float> range_lo_, range_hi_;
+    std::vector<float> slope_, offset_;
+    std::vector<uint32_t> bin_;
+    std::vector<size_t> rows_;  // rows with some pixel to keep
+
+    std::vector<float> values_;  // per row and thread
+    std::vector<float> bins_;    // per thread
+
+   public:
+    /**
+     * Create a laser scan extraction for a sensor.
+     *
+     * Infinite bounds may be given to select returns by beam only.
+     *
+     * @throw std::invalid_argument if the lut doesn't match the dimensions, a
+     * beam index is out of range or the bounds are empty.
+     *
+     * @param[in] lut lookup tables generated by make_xyz_lut.
+     * @param[in] w number of columns of the scans.
+     * @param[in] h number of rows of the scans.
+     * @param[in] n_bins number of bins per turn; w if zero.
+     * @param[in] z_min, z_max heights of the returns to keep, in the frame and
+     * units of the lut.
+     * @param[in] beams rows of the returns to keep; all rows if empty.
+     * @param[in] range_min, range_max horizontal distances of the returns to
+     * keep.
+     */
+    VirtualLaserScan(const XYZLut& lut, size_t w, size_t h, size_t n_bins,
+                     double z_min, double z_max,
+                     const std::vector<size_t>& beams = {},
+                     double range_min = 0.0,
+                     double range_max = std::numeric_limits<double>::max());
+
+    /** Number of bins per turn. */
+    size_t n_bins() const;
+
+    /** Angle between the centers of consecutive bins, in radians. */
+    double angle_increment() const;
+
+    /**
+     * Extract a laser scan from a range image.
+     *
+     * @throw std::invalid_argument if the image or output don't match the
+     * dimensions.
+     *
+     * @param[in] range staggered range image.
+     * @param[out] ranges n_bins() horizontal distances in the units of the
+     * lut, infinity for bins without returns.
+     */
+    void operator()(const Eigen::Ref<const img_t<uint32_t>>& range,
+                    Eigen::Ref<Eigen::ArrayXf> ranges);
+
+    /**
+     * Extract a laser scan from the RANGE field of a scan.
+     *
+     * @throw std::invalid_argument if the scan or output don't match the
+     * dimensions.
+     *
+     * @param[in] scan the scan.
+     * @param[out] ranges n_bins() horizontal distances in the units of the
+     * lut, infinity for bins without returns.
+     */
+    void operator()(const LidarScan& scan, Eigen::Ref<Eigen::ArrayXf> ranges);
+
+    /**
+     * Extract a laser scan from the RANGE field of a scan.
+     *
+     * @throw std::invalid_argument if the scan doesn't match the dimensions.
+     *
+     * @param[in] scan the scan.
+     *
+     * @return n_bins() horizontal distances in the units of the lut,
+     * infinity for bins without returns.
+     */
+    Eigen::ArrayXf operator()(const LidarScan& scan);
+};
+
+}  // namespace ouster
@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ *
+ * @file
+ * @brief Voxel grid downsampling of lidar scans
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ouster_client/lidar_scan.h"
+#include "ouster_client/types.h"
+
+namespace ouster {
+
+/** How a voxel's output point is chosen. */
+enum VoxelGridMode {
+    VOXEL_CENTROID = 0,  ///< mean of all points in the voxel
+    VOXEL_FIRST_POINT    ///< the point with the lowest pixel index
+};
+
+/** Downsampled cloud, one row per occupied voxel, in unspecified order. */
+struct VoxelCloud {
+    PointsF points;  ///< xyz of each voxel
+    Eigen::ArrayXXf fields;  ///< averaged fields, one column per field
+    Eigen::Array<uint32_t, Eigen::Dynamic, 1> counts;  ///< points per voxel
+    Eigen::Array<uint32_t, Eigen::Dynamic, 1>
+        pixels;  ///< lowest pixel index in each voxel, row * w + col
+};
+
+/**
+ * Voxel grid filter operating directly on range images or on cartesian
+ * output.
+ *
+ * Points are binned into a spatial hash with open addressing, sized for each
+ * frame. With OpenMP enabled, each thread bins a contiguous block of pixels
+ * into its own table and the tables are merged afterwards. Tables are kept
+ * between calls so that steady-state filtering does not allocate.
+ */
+class VoxelGrid {
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+
+   public:
+    /**
+     * Create a voxel grid filter.
+     *
+     * @param[in] leaf_size voxel edge length, in the units of the points.
+     * @param[in] mode how the output point of each voxel is chosen.
+     * @param[in] fields scan fields to average over each voxel's points.
+     */
+    VoxelGrid(double leaf_size, VoxelGridMode mode = VOXEL_CENTROID,
+              std::vector<sensor::ChanField> fields = {});
+
+    /** Voxel grid destructor. */
+    ~VoxelGrid();
+
+    /**
+     * Downsample a scan, projecting ranges on the fly.
+     *
+     * Pixels with zero range are skipped.
+     *
+     * @throw std::invalid_argument if the lut does not match the scan
+     * dimensions or a requested field is missing.
+     *
+     * @param[in] scan the scan to downsample.
+     * @param[in] lut lookup tables generated by make_xyz_lut.
+     * @param[out] out the downsampled cloud.
+     */
+    void operator()(const LidarScan& scan, const XYZLut& lut, VoxelCloud& out);
+
+    /**
+     * Downsample points, e.g. the output of cartesian().
+     *
+     * Points at the origin are skipped. No fields are averaged.
+     *
+     * @param[in] points the points to downsample.
+     * @param[out] out the downsampled cloud.
+     */
+    void operator()(const LidarScan::Points& points, VoxelCloud& out);
+};
+
+}  // namespace ouster
@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/background_model.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace ouster {
+
+using sensor::ChanField;
+using sensor::ChanFieldType;
+
+BackgroundModel::BackgroundModel(size_t w, size_t h, double rate,
+                                 double threshold_sigma, double min_delta,
+                                 uint32_t warmup, double foreground_rate)
+    : w_{w},
+      h_{h},
+      rate_{static_cast<float>(rate)},
+      foreground_rate_{static_cast<float>(foreground_rate)},
+      sq_sigma_{static_cast<float>(threshold_sigma * threshold_sigma)},
+      sq_min_delta_{static_cast<float>(min_delta * min_delta * 1e6)},
+      warmup_{warmup},
+      absorb_age_{foreground_rate > 0.0
+                      ? static_cast<float>(1.0 / foreground_rate)
+                      : std::numeric_limits<float>::infinity()},
+      mean_(w * h, 0.0f),
+      var_(w * h, 0.0f),
+      age_(w * h, 0.0f) {
+    if (!(rate > 0.0 && rate <= 1.0) ||
+        !(foreground_rate >= 0.0 && foreground_rate <= 1.0))
+        throw std::invalid_argument("background learning rate out of range");
+    changed_.reserve(w * h);
+}
+
+size_t BackgroundModel::operator()(
+    const Eigen::Ref<const img_t<uint32_t>>& range,
+    Eigen::Ref<img_t<uint8_t>> foreground) {
+    if (static_cast<size_t>(range.rows()) != h_ ||
+        static_cast<size_t>(range.cols()) != w_ ||
+        foreground.rows() != range.rows() ||
+        foreground.cols() != range.cols())
+        throw std::invalid_argument("unexpected image dimensions");
+
+    const size_t n = w_ * h_;
+    const uint32_t* rng = range.data();
+    uint8_t* fg = foreground.data();
+    float* mean = mean_.data();
+    float* var = var_.data();
+    float* age = age_.data();
+
+    const float rate = rate_;
+    const float fg_rate = foreground_rate_;
+    const float sq_sigma = sq_sigma_;
+    const float sq_min_delta = sq_min_delta_;
+    const float absorb_age = absorb_age_;
+    const int32_t warm = scans_ >= warmup_;
+
+    // masks are combined with bitwise operators and applied by arithmetic:
+    // any branch, including short-circuiting, keeps the loop from vectorizing
+    for (size_t i = 0; i < n; i++) {
+        const float r = static_cast<float>(rng[i]);
+        const float m = mean[i];
+        const float v = var[i];
+        const float n_seen = age[i];
+        const int32_t valid = r > 0.0f;
+        const int32_t has_mean = m > 0.0f;
+        const int32_t seeded = n_seen > 0.0f;
+        const int32_t bg = has_mean & (seeded ^ 1);
+
+        const float d = r - m;
+        const float sq_d = d * d;
+        const int32_t far = static_cast<int32_t>(sq_d > sq_sigma * v) &
+                            static_cast<int32_t>(sq_d > sq_min_delta);
+
+        // during warmup, the first return of a pixel initializes it; after
+        // warmup, it seeds the pixel, as does a return far from the seeded
+        // mean; other returns of seeded pixels are averaged into it
+        const int32_t init = valid & (has_mean ^ 1) & (warm ^ 1);
+        const int32_t seed =
+            valid & (((has_mean ^ 1) & warm) | (seeded & far));
+        const int32_t track = valid & seeded & (far ^ 1);
+        const int32_t update_fg = valid & bg & far;
+        const int32_t update_bg = valid & bg & (far ^ 1);
+
+        const float a = static_cast<float>(init | seed) +
+                        static_cast<float>(track) / (n_seen + 1.0f) +
+                        static_cast<float>(update_fg) * fg_rate +
+                        static_cast<float>(update_bg) * rate;
+        mean[i] = m + a * d;
+        var[i] = (1.0f - a) * (v + a * sq_d);
+
+        // seeded pixels become background after absorb_age returns
+        const float next_age =
+            static_cast<float>(seed) +
+            static_cast<float>(track) * (n_seen + 1.0f) +
+            static_cast<float>((valid ^ 1) & seeded) * n_seen;
+        const int32_t young = next_age < absorb_age;
+        age[i] = next_age * static_cast<float>(young);
+        fg[i] = static_cast<uint8_t>(seed | track | update_fg);
+    }
+
+    // compact the mask into a list of pixels; resizing within capacity
+    // doesn't allocate
+    changed_.resize(n);
+    uint32_t* out = changed_.data();
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+        out[k] = static_cast<uint32_t>(i);
+        k += fg[i];
+    }
+    changed_.resize(k);
+
+    if (!warm) scans_++;
+    return k;
+}
+
+size_t BackgroundModel::operator()(LidarScan& scan, ChanField mask_field) {
+    if (scan.field_type(mask_field) != ChanFieldType::UINT8)
+        throw std::invalid_argument("foreground mask field must be UINT8");
+    return operator()(scan.field(ChanField::RANGE),
+                      scan.field<uint8_t>(mask_field));
+}
+
+const std::vector<uint32_t>& BackgroundModel::changed() const {
+    return changed_;
+}
+
+Eigen::Map<const img_t<float>> BackgroundModel::background() const {
+    return {mean_.data(), static_cast<Eigen::Index>(h_),
+            static_cast<Eigen::Index>(w_)};
+}
+
+void BackgroundModel::reset() {
+    std::fill(mean_.begin(), mean_.end(), 0.0f);
+    std::fill(var_.begin(), var_.end(), 0.0f);
+    std::fill(age_.begin(), age_.end(), 0.0f);
+    changed_.clear();
+    scans_ = 0;
+}
+
+}  // namespace ouster
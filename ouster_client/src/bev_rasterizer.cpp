@@ -0,0 +1,280 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/bev_rasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "ouster_client/impl/lidar_scan_impl.h"
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#include <omp.h>
+#endif
+
+namespace ouster {
+
+namespace {
+
+// cells per band; the accumulators of a band fit in L2
+constexpr size_t band_cells = 16384;
+
+// std::floor may compile to a library call without SSE4.1; 32 bit integers
+// keep the conversions vectorizable
+inline int32_t fast_floor(float v) {
+    const auto i = static_cast<int32_t>(v);
+    return i - (v < i);
+}
+
+template <typename T>
+inline T to_channel(float v);
+
+template <>
+inline float to_channel<float>(float v) {
+    return v;
+}
+
+template <>
+inline uint8_t to_channel<uint8_t>(float v) {
+    // clamp as integer: a float comparison keeps the loops from vectorizing
+    return static_cast<uint8_t>(std::min(static_cast<int32_t>(v + 0.5f), 255));
+}
+
+}  // namespace
+
+BevRasterizer::BevRasterizer(double x_min, double x_max, double y_min,
+                             double y_max, double z_min, double z_max,
+                             double resolution, double max_density)
+    : x_max_{static_cast<float>(x_max)},
+      y_max_{static_cast<float>(y_max)},
+      z_min_{static_cast<float>(z_min)},
+      z_max_{static_cast<float>(z_max)},
+      inv_res_{static_cast<float>(1.0 / resolution)} {
+    if (!(resolution > 0.0))
+        throw std::invalid_argument("BEV resolution must be positive");
+    if (!(x_max > x_min && y_max > y_min && z_max > z_min))
+        throw std::invalid_argument("empty BEV extent");
+    if (!(max_density > 1.0))
+        throw std::invalid_argument("BEV max density must be above one");
+
+    rows_ = static_cast<size_t>(std::ceil((x_max - x_min) / resolution));
+    cols_ = static_cast<size_t>(std::ceil((y_max - y_min) / resolution));
+    if (rows_ * cols_ >= std::numeric_limits<int32_t>::max())
+        throw std::invalid_argument("BEV grid too large");
+    band_rows_ = std::max<size_t>(1, band_cells / cols_);
+    n_bands_ = (rows_ + band_rows_ - 1) / band_rows_;
+
+    // the last entry is one, for all counts from max_density - 1 up
+    density_lut_.resize(static_cast<size_t>(std::ceil(max_density)) + 1);
+    for (size_t c = 0; c < density_lut_.size(); c++)
+        density_lut_[c] = static_cast<float>(
+            std::min(1.0, std::log(c + 1.0) / std::log(max_density)));
+}
+
+size_t BevRasterizer::rows() const { return rows_; }
+
+size_t BevRasterizer::cols() const { return cols_; }
+
+template <typename T>
+void BevRasterizer::rasterize(const LidarScan& scan, const XYZLut& lut,
+                              Eigen::Ref<img_t<T>> height,
+                              Eigen::Ref<img_t<T>> density,
+                              Eigen::Ref<img_t<T>> reflectivity,
+                              float height_scale, float density_scale) {
+    const auto range = scan.field(sensor::ChanField::RANGE);
+    const size_t n = range.size();
+    if (static_cast<size_t>(lut.direction.rows()) != n)
+        throw std::invalid_argument("unexpected image dimensions");
+    for (const auto* img : {&height, &density, &reflectivity})
+        if (static_cast<size_t>(img->rows()) != rows_ ||
+            static_cast<size_t>(img->cols()) != cols_)
+            throw std::invalid_argument("unexpected BEV dimensions");
+
+    reflectivity_.resize(range.rows(), range.cols());
+    impl::visit_field(scan, sensor::ChanField::REFLECTIVITY,
+                      impl::read_and_cast(), reflectivity_);
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+    const int n_threads = omp_get_max_threads();
+#else
+    const int n_threads = 1;
+#endif
+    const size_t nb = n_bands_;
+    const size_t tile_cells = band_rows_ * cols_;
+    const auto none = static_cast<uint32_t>(rows_ * cols_);
+
+    cell_.resize(n);
+    height_.resize(n);
+    order_.resize(n);
+    offsets_.assign(n_threads * nb, 0);
+    // tiles are zero between bands
+    tile_max_.resize(n_threads * tile_cells);
+    tile_sum_.resize(n_threads * tile_cells);
+    tile_count_.resize(n_threads * tile_cells);
+
+    const uint32_t* rng = range.data();
+    const double* dir = lut.direction.data();
+    const double* ofs = lut.offset.data();
+    const float* refl = reflectivity_.data();
+    uint32_t* cell = cell_.data();
+    float* hgt = height_.data();
+    uint32_t* order = order_.data();
+    size_t* offsets = offsets_.data();
+
+    const float x_max = x_max_, y_max = y_max_;
+    const float z_min = z_min_, z_max = z_max_;
+    const float inv_res = inv_res_;
+    const auto rows = static_cast<int32_t>(rows_);
+    const auto cols = static_cast<int32_t>(cols_);
+    // clamp cell coordinates of far points before conversion
+    const auto max_coord = static_cast<float>(std::max(rows_, cols_));
+
+    // project and count points per band
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel num_threads(n_threads)
+#endif
+    {
+#ifdef __OUSTER_UTILIZE_OPENMP__
+        const int t = omp_get_thread_num();
+#else
+        const int t = 0;
+#endif
+        const size_t begin = n * t / n_threads;
+        const size_t end = n * (t + 1) / n_threads;
+
+        // ranges fit in 31 bits; the signed conversion vectorizes
+        for (size_t i = begin; i < end; i++) {
+            const double r = static_cast<int32_t>(rng[i]);
+            const auto x = static_cast<float>(r * dir[i] + ofs[i]);
+            const auto y = static_cast<float>(r * dir[n + i] + ofs[n + i]);
+            const auto z =
+                static_cast<float>(r * dir[2 * n + i] + ofs[2 * n + i]);
+            const int32_t u = fast_floor(
+                std::min(std::max((x_max - x) * inv_res, -1.0f), max_coord));
+            const int32_t v = fast_floor(
+                std::min(std::max((y_max - y) * inv_res, -1.0f), max_coord));
+            const bool keep = (r > 0.0) & (u >= 0) & (u < rows) & (v >= 0) &
+                              (v < cols) & (z >= z_min) & (z < z_max);
+            cell[i] = keep ? static_cast<uint32_t>(u * cols + v) : none;
+            hgt[i] = z - z_min;
+        }
+
+        size_t* count = offsets + t * nb;
+        for (size_t i = begin; i < end; i++)
+            if (cell[i] != none) count[cell[i] / tile_cells]++;
+    }
+
+    // exclusive scan over bands, then threads, so that each band is a
+    // contiguous range of order_ filled by the threads in turn
+    std::vector<size_t>& band_begin = band_begin_;
+    band_begin.resize(nb + 1);
+    size_t total = 0;
+    for (size_t b = 0; b < nb; b++) {
+        band_begin[b] = total;
+        for (int t = 0; t < n_threads; t++) {
+            const size_t c = offsets[t * nb + b];
+            offsets[t * nb + b] = total;
+            total += c;
+        }
+    }
+    band_begin[nb] = total;
+
+    // sort pixels by band, keeping pixel order within each band
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel num_threads(n_threads)
+#endif
+    {
+#ifdef __OUSTER_UTILIZE_OPENMP__
+        const int t = omp_get_thread_num();
+#else
+        const int t = 0;
+#endif
+        const size_t begin = n * t / n_threads;
+        const size_t end = n * (t + 1) / n_threads;
+
+        size_t* next = offsets + t * nb;
+        for (size_t i = begin; i < end; i++)
+            if (cell[i] != none)
+                order[next[cell[i] / tile_cells]++] = static_cast<uint32_t>(i);
+    }
+
+    // accumulate each band in a tile and write it out
+    const float* density_lut = density_lut_.data();
+    const auto max_count = static_cast<int32_t>(density_lut_.size() - 1);
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel num_threads(n_threads)
+#endif
+    {
+#ifdef __OUSTER_UTILIZE_OPENMP__
+        const int t = omp_get_thread_num();
+#else
+        const int t = 0;
+#endif
+        float* tmax = tile_max_.data() + t * tile_cells;
+        float* tsum = tile_sum_.data() + t * tile_cells;
+        int32_t* tcount = tile_count_.data() + t * tile_cells;
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp for schedule(dynamic)
+#endif
+        for (size_t b = 0; b < nb; b++) {
+            const size_t width = cols_;
+            const size_t row0 = b * band_rows_;
+            const size_t n_rows = std::min(band_rows_, rows_ - row0);
+            const size_t first = row0 * cols_;
+
+            for (size_t k = band_begin[b]; k < band_begin[b + 1]; k++) {
+                const uint32_t i = order[k];
+                const size_t c = cell[i] - first;
+                tmax[c] = std::max(tmax[c], hgt[i]);
+                tsum[c] += refl[i];
+                tcount[c]++;
+            }
+
+            // write out the band, clearing the tile for the next one
+            for (size_t r = 0; r < n_rows; r++) {
+                T* h = &height(row0 + r, 0);
+                T* d = &density(row0 + r, 0);
+                T* f = &reflectivity(row0 + r, 0);
+                float* rmax = tmax + r * cols_;
+                float* rsum = tsum + r * cols_;
+                int32_t* rcount = tcount + r * cols_;
+                for (size_t j = 0; j < width; j++) {
+                    const int32_t cnt = std::min(rcount[j], max_count);
+                    d[j] = to_channel<T>(density_lut[cnt] * density_scale);
+                }
+                for (size_t j = 0; j < width; j++) {
+                    // std::max here keeps the loop from vectorizing
+                    const int32_t c = rcount[j];
+                    const auto cnt = static_cast<float>(c + (c == 0));
+                    h[j] = to_channel<T>(rmax[j] * height_scale);
+                    f[j] = to_channel<T>(rsum[j] / cnt);
+                    rmax[j] = 0.0f;
+                    rsum[j] = 0.0f;
+                    rcount[j] = 0;
+                }
+            }
+        }
+    }
+}
+
+void BevRasterizer::operator()(const LidarScan& scan, const XYZLut& lut,
+                               Eigen::Ref<img_t<float>> height,
+                               Eigen::Ref<img_t<float>> density,
+                               Eigen::Ref<img_t<float>> reflectivity) {
+    rasterize<float>(scan, lut, height, density, reflectivity, 1.0f, 1.0f);
+}
+
+void BevRasterizer::operator()(const LidarScan& scan, const XYZLut& lut,
+                               Eigen::Ref<img_t<uint8_t>> height,
+                               Eigen::Ref<img_t<uint8_t>> density,
+                               Eigen::Ref<img_t<uint8_t>> reflectivity) {
+    rasterize<uint8_t>(scan, lut, height, density, reflectivity,
+                       255.0f / (z_max_ - z_min_), 255.0f);
+}
+
+}  // namespace ouster
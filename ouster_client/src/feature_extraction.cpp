@@ -0,0 +1,242 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/feature_extraction.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace ouster {
+
+using sensor::ChanField;
+using sensor::ChanFieldType;
+
+namespace {
+
+// scratch buffers of one thread, indexed by destaggered column; the padded
+// range holds half a window of wrapped columns on either side and a zero
+struct RowBuffers {
+    std::vector<float> range;      // padded, meters
+    std::vector<float> sum;        // window sum minus its center
+    std::vector<int32_t> reject;   // nonzero if the return is rejected
+    std::vector<float> curvature;  // negative if rejected
+    std::vector<uint8_t> taken;    // picked or next to a pick
+    std::vector<int32_t> keys;     // selection keys, see pick
+};
+
+}  // namespace
+
+FeatureExtraction::FeatureExtraction(const sensor::sensor_info& info,
+                                     int n_sectors, int max_edges,
+                                     int max_planes, int half_window,
+                                     double edge_threshold,
+                                     double plane_threshold,
+                                     double max_occlusion, double max_parallel)
+    : w_{info.format.columns_per_frame},
+      h_{info.format.pixels_per_column},
+      n_sectors_{n_sectors},
+      max_edges_{std::max(max_edges, 0)},
+      max_planes_{std::max(max_planes, 0)},
+      half_window_{half_window},
+      edge_threshold_{static_cast<float>(edge_threshold)},
+      plane_threshold_{static_cast<float>(plane_threshold)},
+      max_occlusion_{static_cast<float>(max_occlusion)},
+      max_parallel_{static_cast<float>(max_parallel)} {
+    const auto& shift = info.format.pixel_shift_by_row;
+    if (shift.size() != h_)
+        throw std::invalid_argument("unexpected scan dimensions");
+    if (n_sectors < 1 || half_window < 1 ||
+        static_cast<size_t>(2 * half_window * n_sectors) > w_)
+        throw std::invalid_argument("invalid feature sectors or window");
+    if (edge_threshold < 0 || plane_threshold < 0 || max_occlusion < 0 ||
+        max_parallel < 0)
+        throw std::invalid_argument("feature thresholds must not be negative");
+
+    const int iw = static_cast<int>(w_);
+    shift_.resize(h_);
+    for (size_t u = 0; u < h_; u++) shift_[u] = (shift[u] % iw + iw) % iw;
+    row_edges_.resize(h_);
+    row_planes_.resize(h_);
+}
+
+ScanFeatures FeatureExtraction::operator()(
+    const Eigen::Ref<const img_t<uint32_t>>& range,
+    Eigen::Ref<img_t<uint8_t>> labels) {
+    if (static_cast<size_t>(range.rows()) != h_ ||
+        static_cast<size_t>(range.cols()) != w_ ||
+        labels.rows() != range.rows() || labels.cols() != range.cols())
+        throw std::invalid_argument("unexpected image dimensions");
+
+    const std::ptrdiff_t w = w_;
+    const std::ptrdiff_t h = h_;
+    const std::ptrdiff_t k = half_window_;
+    const std::ptrdiff_t n_pad = w + 2 * k;
+    const uint32_t* rng = range.data();
+    uint8_t* lab = labels.data();
+
+    const float center = -static_cast<float>(2 * k + 1);
+    const float inv_neighbours = 1.0f / static_cast<float>(2 * k);
+    const float occlusion = 1.0f - max_occlusion_;
+    const float parallel = max_parallel_;
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel
+#endif
+    {
+        RowBuffers buf;
+        buf.range.resize(n_pad + 1, 0.0f);
+        buf.sum.resize(w);
+        buf.reject.resize(w);
+        buf.curvature.resize(w);
+        buf.taken.resize(w);
+        buf.keys.resize(w);
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp for schedule(static)
+#endif
+        for (std::ptrdiff_t u = 0; u < h; u++) {
+            const uint32_t* row = rng + u * w;
+            const std::ptrdiff_t s = shift_[u];
+            float* pad = buf.range.data();
+            float* sum = buf.sum.data();
+            int32_t* reject = buf.reject.data();
+            float* curv = buf.curvature.data();
+
+            // destagger into the padded row; ranges fit in 31 bits and the
+            // signed conversion vectorizes
+            for (std::ptrdiff_t c = 0; c < s; c++)
+                pad[k + c] = static_cast<int32_t>(row[w - s + c]) * 0.001f;
+            for (std::ptrdiff_t c = s; c < w; c++)
+                pad[k + c] = static_cast<int32_t>(row[c - s]) * 0.001f;
+            for (std::ptrdiff_t i = 0; i < k; i++) {
+                pad[i] = pad[w + i];
+                pad[w + k + i] = pad[k + i];
+            }
+
+            // window sums and rejections, accumulated over window offsets so
+            // that the loops over columns vectorize
+            for (std::ptrdiff_t c = 0; c < w; c++) {
+                const float r = pad[k + c];
+                const float dl = std::abs(pad[k + c - 1] - r);
+                const float dr = std::abs(pad[k + c + 1] - r);
+                sum[c] = center * r;
+                reject[c] = (dl > parallel * r) & (dr > parallel * r);
+            }
+            // a return is also rejected behind a nearer one within the
+            // window: on the left, a return nearer than the next one by more
+            // than the occlusion threshold, on the right nearer than the
+            // previous one; a zero threshold disables the check at an offset
+            for (std::ptrdiff_t j = 0; j <= 2 * k; j++) {
+                const float left = j < k ? occlusion : 0.0f;
+                const float right = j >= k && j < 2 * k ? occlusion : 0.0f;
+                const float* next = pad + j + 1;
+                for (std::ptrdiff_t c = 0; c < w; c++) {
+                    const float r = pad[c + j], nr = next[c];
+                    sum[c] += r;
+                    reject[c] |= static_cast<int32_t>(r == 0.0f) |
+                                 static_cast<int32_t>(r < left * nr) |
+                                 static_cast<int32_t>(nr < right * r);
+                }
+            }
+            // -1 where rejected, in arithmetic: selects between the results
+            // of floating point operations keep the loop from vectorizing
+            for (std::ptrdiff_t c = 0; c < w; c++) {
+                const auto rej = static_cast<float>(reject[c] != 0);
+                const float v =
+                    std::abs(sum[c]) * inv_neighbours / (pad[k + c] + rej);
+                curv[c] = v * (1.0f - rej) - rej;
+            }
+
+            // pick features per sector
+            std::vector<uint32_t>& edges = row_edges_[u];
+            std::vector<uint32_t>& planes = row_planes_[u];
+            edges.clear();
+            planes.clear();
+            std::fill(buf.taken.begin(), buf.taken.end(), 0);
+            uint8_t* lrow = lab + u * w;
+            std::fill(lrow, lrow + w, 0);
+
+            // keys order the candidates of a sector like their curvature,
+            // highest first for edges and lowest first for planes: bits of
+            // non-negative floats order like the floats. Other returns and
+            // taken ones get the largest key. Each pick is the first column
+            // with the least key: scans over the sector cost less than
+            // sorting, where about every other comparison is mispredicted
+            constexpr int32_t no_key = std::numeric_limits<int32_t>::max();
+            int32_t* key = buf.keys.data();
+            const uint8_t* taken = buf.taken.data();
+            auto pick = [&](std::ptrdiff_t begin, std::ptrdiff_t end,
+                            int max_picks, bool edge) {
+                if (max_picks == 0) return;
+                for (std::ptrdiff_t c = begin; c < end; c++) {
+                    const float v = curv[c];
+                    int32_t bits;
+                    std::memcpy(&bits, &v, sizeof(bits));
+                    const int32_t cand =
+                        edge ? static_cast<int32_t>(v > edge_threshold_)
+                             : static_cast<int32_t>(v >= 0.0f) &
+                                   static_cast<int32_t>(v < plane_threshold_);
+                    const int32_t k_c = edge ? no_key - 1 - bits : bits;
+                    key[c] = cand & (taken[c] == 0) ? k_c : no_key;
+                }
+
+                for (int picks = 0; picks < max_picks; picks++) {
+                    int32_t best = no_key;
+                    for (std::ptrdiff_t c = begin; c < end; c++)
+                        best = std::min(best, key[c]);
+                    if (best == no_key) break;
+                    std::ptrdiff_t c = begin;
+                    while (key[c] != best) c++;
+                    for (std::ptrdiff_t j = -k; j <= k; j++) {
+                        const std::ptrdiff_t t = (c + j + w) % w;
+                        buf.taken[t] = 1;
+                        key[t] = no_key;
+                    }
+                    const std::ptrdiff_t v = (c - s + w) % w;
+                    lrow[v] = static_cast<uint8_t>(
+                        edge ? FeatureLabel::EDGE : FeatureLabel::PLANAR);
+                    (edge ? edges : planes)
+                        .push_back(static_cast<uint32_t>(u * w + v));
+                }
+            };
+
+            for (int sec = 0; sec < n_sectors_; sec++) {
+                const std::ptrdiff_t begin = w * sec / n_sectors_;
+                const std::ptrdiff_t end = w * (sec + 1) / n_sectors_;
+                pick(begin, end, max_edges_, true);
+                pick(begin, end, max_planes_, false);
+            }
+        }
+    }
+
+    ScanFeatures features;
+    size_t n_edges = 0, n_planes = 0;
+    for (std::ptrdiff_t u = 0; u < h; u++) {
+        n_edges += row_edges_[u].size();
+        n_planes += row_planes_[u].size();
+    }
+    features.edges.reserve(n_edges);
+    features.planes.reserve(n_planes);
+    for (std::ptrdiff_t u = 0; u < h; u++) {
+        features.edges.insert(features.edges.end(), row_edges_[u].begin(),
+                              row_edges_[u].end());
+        features.planes.insert(features.planes.end(), row_planes_[u].begin(),
+                               row_planes_[u].end());
+    }
+    return features;
+}
+
+ScanFeatures FeatureExtraction::operator()(LidarScan& scan,
+                                           ChanField label_field) {
+    if (scan.field_type(label_field) != ChanFieldType::UINT8)
+        throw std::invalid_argument("feature label field must be UINT8");
+    return operator()(scan.field(ChanField::RANGE),
+                      scan.field<uint8_t>(label_field));
+}
+
+}  // namespace ouster
@@ -0,0 +1,229 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/ghost_filter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "ouster_client/impl/lidar_scan_impl.h"
+
+namespace ouster {
+
+using sensor::ChanField;
+using sensor::ChanFieldType;
+
+namespace {
+
+// scratch buffers of one thread, indexed by staggered column; the padded
+// buffer holds wrapped columns on either side
+struct RowBuffers {
+    std::vector<float> range;  // raw range
+    std::vector<float> pad;    // padded range or retroreflector range
+    std::vector<int32_t> count;
+};
+
+// copy row with `pad` wrapped columns on either side, starting at column
+// `offset`
+inline void wrap_row(const float* row, std::ptrdiff_t w, std::ptrdiff_t offset,
+                     std::ptrdiff_t pad, float* out) {
+    for (std::ptrdiff_t c = 0; c < w + 2 * pad; c++) {
+        std::ptrdiff_t v = c - pad + offset;
+        while (v < 0) v += w;
+        while (v >= w) v -= w;
+        out[c] = row[v];
+    }
+}
+
+}  // namespace
+
+GhostFilter::GhostFilter(const sensor::sensor_info& info, uint8_t flag_mask,
+                         uint32_t retro_reflectivity, int bloom_cols,
+                         int bloom_rows, double bloom_range, int support_cols,
+                         int min_support, double max_range_change)
+    : w_(info.format.columns_per_frame),
+      h_(info.format.pixels_per_column),
+      flag_mask_{flag_mask},
+      retro_reflectivity_{retro_reflectivity},
+      bloom_cols_{bloom_cols},
+      bloom_rows_{bloom_rows},
+      bloom_range_{static_cast<float>(bloom_range)},
+      support_cols_{support_cols},
+      min_support_{min_support},
+      max_range_change_{static_cast<float>(max_range_change)} {
+    const auto& shift = info.format.pixel_shift_by_row;
+    if (shift.size() != static_cast<size_t>(h_))
+        throw std::invalid_argument("unexpected scan dimensions");
+    if (bloom_cols < 0 || bloom_rows < 0 || support_cols < 0 ||
+        min_support < 0 || bloom_range < 0 || max_range_change < 0)
+        throw std::invalid_argument("ghost filter parameters must not be "
+                                    "negative");
+    if (2 * std::max(bloom_cols, support_cols) >= w_)
+        throw std::invalid_argument("ghost filter window wider than the scan");
+
+    const auto w = static_cast<int>(w_);
+    shift_.resize(h_);
+    for (std::ptrdiff_t u = 0; u < h_; u++)
+        shift_[u] = (shift[u] % w + w) % w;
+    retro_.resize(w_ * h_);
+    has_retro_.resize(h_);
+}
+
+void GhostFilter::operator()(
+    const Eigen::Ref<const img_t<uint32_t>>& range,
+    const Eigen::Ref<const img_t<uint16_t>>& reflectivity,
+    const Eigen::Ref<const img_t<uint8_t>>& flags,
+    Eigen::Ref<img_t<uint8_t>> mask) {
+    for (const auto& dims :
+         {std::make_pair(range.rows(), range.cols()),
+          std::make_pair(reflectivity.rows(), reflectivity.cols()),
+          std::make_pair(flags.rows(), flags.cols()),
+          std::make_pair(mask.rows(), mask.cols())})
+        if (dims.first != h_ || dims.second != w_)
+            throw std::invalid_argument("unexpected image dimensions");
+
+    const std::ptrdiff_t w = w_;
+    const std::ptrdiff_t h = h_;
+    const std::ptrdiff_t ks = support_cols_;
+    const std::ptrdiff_t kb = bloom_cols_;
+    const std::ptrdiff_t kr = bloom_rows_;
+    const std::ptrdiff_t k_max = std::max(ks, kb);
+    const auto retro_min = static_cast<int32_t>(
+        std::min<uint32_t>(retro_reflectivity_, 0x10000));
+    const uint8_t flag_mask = flag_mask_;
+    const int32_t min_support = min_support_;
+    const float change = max_range_change_;
+    const float bloom = bloom_range_;
+    float* retro = retro_.data();
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel
+#endif
+    {
+        RowBuffers buf;
+        buf.range.resize(w);
+        buf.pad.resize(w + 2 * k_max);
+        buf.count.resize(w);
+        float* r = buf.range.data();
+        float* pad = buf.pad.data();
+        int32_t* count = buf.count.data();
+
+        // retroreflectors, flags and support along beams; comparisons are
+        // combined as integers and selects written in arithmetic so that
+        // the loops vectorize
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp for schedule(static)
+#endif
+        for (std::ptrdiff_t u = 0; u < h; u++) {
+            const uint32_t* rng = range.row(u).data();
+            const uint16_t* refl = reflectivity.row(u).data();
+            const uint8_t* flg = flags.row(u).data();
+            uint8_t* m = mask.row(u).data();
+            float* ret = retro + u * w;
+
+            // ranges fit in 31 bits; the signed conversion vectorizes
+            int32_t n_retro = 0;
+            for (std::ptrdiff_t v = 0; v < w; v++) {
+                r[v] = static_cast<float>(static_cast<int32_t>(rng[v]));
+                const int32_t is_retro =
+                    static_cast<int32_t>(refl[v] >= retro_min) &
+                    static_cast<int32_t>(rng[v] != 0);
+                ret[v] = static_cast<float>(is_retro) * r[v];
+                n_retro += is_retro;
+                m[v] = static_cast<uint8_t>(
+                    (static_cast<int32_t>((flg[v] & flag_mask) != 0) &
+                     static_cast<int32_t>(rng[v] != 0)) *
+                    GHOST_FLAGGED);
+            }
+            has_retro_[u] = n_retro != 0;
+
+            if (ks == 0) continue;
+            wrap_row(r, w, 0, ks, pad);
+            std::fill(count, count + w, 0);
+            for (std::ptrdiff_t j = -ks; j <= ks; j++) {
+                if (j == 0) continue;
+                const float* nb = pad + ks + j;
+                for (std::ptrdiff_t v = 0; v < w; v++)
+                    count[v] += static_cast<int32_t>(nb[v] != 0.0f) &
+                                static_cast<int32_t>(std::abs(nb[v] - r[v]) <=
+                                                     change * r[v]);
+            }
+            for (std::ptrdiff_t v = 0; v < w; v++)
+                m[v] |= static_cast<uint8_t>(
+                    (static_cast<int32_t>(count[v] < min_support) &
+                     static_cast<int32_t>(rng[v] != 0)) *
+                    GHOST_INCONSISTENT);
+        }
+
+        // blooming, from the retroreflectors of neighbouring beams aligned
+        // by the pixel shifts
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp for schedule(dynamic, 8)
+#endif
+        for (std::ptrdiff_t u = 0; u < h; u++) {
+            if (kb == 0) continue;
+            const std::ptrdiff_t u_begin = std::max<std::ptrdiff_t>(0, u - kr);
+            const std::ptrdiff_t u_end = std::min(h, u + kr + 1);
+            bool any = false;
+            for (std::ptrdiff_t n = u_begin; n < u_end; n++)
+                any |= has_retro_[n] != 0;
+            if (!any) continue;
+
+            const uint32_t* rng = range.row(u).data();
+            const float* own = retro + u * w;
+            uint8_t* m = mask.row(u).data();
+            for (std::ptrdiff_t v = 0; v < w; v++)
+                r[v] = static_cast<float>(static_cast<int32_t>(rng[v]));
+            std::fill(count, count + w, 0);
+
+            for (std::ptrdiff_t n = u_begin; n < u_end; n++) {
+                if (!has_retro_[n]) continue;
+                wrap_row(retro + n * w, w, shift_[u] - shift_[n], kb, pad);
+                for (std::ptrdiff_t j = -kb; j <= kb; j++) {
+                    const float* nb = pad + kb + j;
+                    for (std::ptrdiff_t v = 0; v < w; v++)
+                        count[v] |=
+                            static_cast<int32_t>(nb[v] != 0.0f) &
+                            static_cast<int32_t>(std::abs(r[v] - nb[v]) <=
+                                                 bloom * nb[v]);
+                }
+            }
+            // retroreflectors themselves are kept
+            for (std::ptrdiff_t v = 0; v < w; v++)
+                m[v] |= static_cast<uint8_t>(
+                    (count[v] & static_cast<int32_t>(rng[v] != 0) &
+                     static_cast<int32_t>(own[v] == 0.0f)) *
+                    GHOST_BLOOMING);
+        }
+    }
+}
+
+void GhostFilter::operator()(LidarScan& scan, ChanField mask_field,
+                             bool second_return) {
+    const ChanField range_field =
+        second_return ? ChanField::RANGE2 : ChanField::RANGE;
+    const ChanField refl_field =
+        second_return ? ChanField::REFLECTIVITY2 : ChanField::REFLECTIVITY;
+    const ChanField flags_field =
+        second_return ? ChanField::FLAGS2 : ChanField::FLAGS;
+    if (scan.field_type(mask_field) != ChanFieldType::UINT8)
+        throw std::invalid_argument("ghost mask field must be UINT8");
+    if (scan.field_type(range_field) != ChanFieldType::UINT32)
+        throw std::invalid_argument("missing or unexpected range field");
+
+    reflectivity_.resize(h_, w_);
+    impl::visit_field(scan, refl_field, impl::read_and_cast(), reflectivity_);
+    flags_.resize(h_, w_);
+    if (scan.field_type(flags_field) != ChanFieldType::VOID)
+        impl::visit_field(scan, flags_field, impl::read_and_cast(), flags_);
+    else
+        flags_.setZero();
+
+    operator()(scan.field<uint32_t>(range_field), reflectivity_, flags_,
+               scan.field<uint8_t>(mask_field));
+}
+
+}  // namespace ouster
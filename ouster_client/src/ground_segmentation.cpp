@@ -0,0 +1,176 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/ground_segmentation.h"
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+namespace ouster {
+
+using sensor::ChanField;
+using sensor::ChanFieldType;
+
+GroundSegmentation::GroundSegmentation(const sensor::sensor_info& info,
+                                       double max_slope_deg,
+                                       double sensor_height, int n_sectors,
+                                       double plane_distance)
+    : w_{info.format.columns_per_frame},
+      h_{info.format.pixels_per_column},
+      tan_max_slope_{std::tan(max_slope_deg * M_PI / 180.0)},
+      sensor_height_{sensor_height},
+      n_sectors_{std::max(n_sectors, 0)},
+      plane_distance_{plane_distance} {
+    const auto& shift = info.format.pixel_shift_by_row;
+    const auto& altitude = info.beam_altitude_angles;
+    if (shift.size() != h_ || altitude.size() != h_)
+        throw std::invalid_argument("unexpected scan dimensions");
+
+    const XYZLut lut = make_xyz_lut(info);
+
+    std::vector<size_t> beams(h_);
+    std::iota(beams.begin(), beams.end(), 0);
+    std::stable_sort(beams.begin(), beams.end(), [&](size_t a, size_t b) {
+        return altitude[a] < altitude[b];
+    });
+
+    const size_t n = w_ * h_;
+    pixel_.resize(n);
+    dir_.resize(3 * n);
+    ofs_.resize(3 * n);
+    for (size_t c = 0; c < w_; c++) {
+        for (size_t k = 0; k < h_; k++) {
+            const size_t u = beams[k];
+            // staggered column whose pixel in row u lands on column c
+            const int iw = static_cast<int>(w_);
+            const size_t v = (c + w_ - (shift[u] % iw + iw) % iw) % w_;
+            const size_t px = u * w_ + v;
+            const size_t e = c * h_ + k;
+            pixel_[e] = static_cast<uint32_t>(px);
+            for (int i = 0; i < 3; i++) {
+                dir_[3 * e + i] = static_cast<float>(lut.direction(px, i));
+                ofs_[3 * e + i] = static_cast<float>(lut.offset(px, i));
+            }
+        }
+    }
+}
+
+void GroundSegmentation::operator()(
+    const Eigen::Ref<const img_t<uint32_t>>& range,
+    Eigen::Ref<img_t<uint8_t>> mask) const {
+    if (static_cast<size_t>(range.rows()) != h_ ||
+        static_cast<size_t>(range.cols()) != w_ ||
+        mask.rows() != range.rows() || mask.cols() != range.cols())
+        throw std::invalid_argument("unexpected image dimensions");
+
+    const uint32_t* rng = range.data();
+    uint8_t* out = mask.data();
+    const std::ptrdiff_t w = w_;
+    const std::ptrdiff_t h = h_;
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel for schedule(static)
+#endif
+    for (std::ptrdiff_t c = 0; c < w; c++) {
+        // start from a virtual point on the ground below the sensor
+        bool have_ref = sensor_height_ > 0.0;
+        float ref_d = 0.0f;
+        float ref_z = static_cast<float>(-sensor_height_);
+
+        for (std::ptrdiff_t k = 0; k < h; k++) {
+            const size_t e = c * h + k;
+            const uint32_t px = pixel_[e];
+            out[px] = 0;
+            const uint32_t r = rng[px];
+            if (r == 0) continue;
+
+            const float x = r * dir_[3 * e] + ofs_[3 * e];
+            const float y = r * dir_[3 * e + 1] + ofs_[3 * e + 1];
+            const float z = r * dir_[3 * e + 2] + ofs_[3 * e + 2];
+            const float d = std::sqrt(x * x + y * y);
+
+            bool ground;
+            if (!have_ref) {
+                // unknown mount height: lowest return seeds the ground if its
+                // beam looks downwards
+                ground = dir_[3 * e + 2] < 0.0f;
+            } else {
+                const float dd = d - ref_d;
+                ground =
+                    dd > 0.0f && std::abs(z - ref_z) <= tan_max_slope_ * dd;
+            }
+
+            if (ground) {
+                out[px] = 1;
+                have_ref = true;
+                ref_d = d;
+                ref_z = z;
+            }
+        }
+    }
+
+    if (n_sectors_ == 0) return;
+
+    // refine with a least-squares plane z = a x + b y + c per sector
+    const std::ptrdiff_t n_sectors = n_sectors_;
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel for schedule(static)
+#endif
+    for (std::ptrdiff_t s = 0; s < n_sectors; s++) {
+        const std::ptrdiff_t c0 = s * w / n_sectors;
+        const std::ptrdiff_t c1 = (s + 1) * w / n_sectors;
+
+        Eigen::Matrix3d A = Eigen::Matrix3d::Zero();
+        Eigen::Vector3d b = Eigen::Vector3d::Zero();
+        size_t n_ground = 0;
+        for (std::ptrdiff_t e = c0 * h; e < c1 * h; e++) {
+            const uint32_t px = pixel_[e];
+            if (!out[px]) continue;
+            const uint32_t r = rng[px];
+            const double x = r * dir_[3 * e] + ofs_[3 * e];
+            const double y = r * dir_[3 * e + 1] + ofs_[3 * e + 1];
+            const double z = r * dir_[3 * e + 2] + ofs_[3 * e + 2];
+            const Eigen::Vector3d p{x, y, 1.0};
+            A.noalias() += p * p.transpose();
+            b += p * z;
+            n_ground++;
+        }
+        if (n_ground < 3) continue;
+
+        const Eigen::LDLT<Eigen::Matrix3d> ldlt(A);
+        if (ldlt.info() != Eigen::Success) continue;
+        const Eigen::Vector3d plane = ldlt.solve(b);
+        if (!plane.allFinite()) continue;
+
+        // perpendicular distance to z = a x + b y + c
+        const double norm =
+            std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + 1.0);
+        const double max_dz = plane_distance_ * norm;
+
+        for (std::ptrdiff_t e = c0 * h; e < c1 * h; e++) {
+            const uint32_t px = pixel_[e];
+            const uint32_t r = rng[px];
+            if (r == 0) continue;
+            const double x = r * dir_[3 * e] + ofs_[3 * e];
+            const double y = r * dir_[3 * e + 1] + ofs_[3 * e + 1];
+            const double z = r * dir_[3 * e + 2] + ofs_[3 * e + 2];
+            const double dz = z - (plane[0] * x + plane[1] * y + plane[2]);
+            out[px] |= std::abs(dz) <= max_dz;
+        }
+    }
+}
+
+void GroundSegmentation::operator()(LidarScan& scan,
+                                    ChanField mask_field) const {
+    if (scan.field_type(mask_field) != ChanFieldType::UINT8)
+        throw std::invalid_argument("ground mask field must be UINT8");
+    operator()(scan.field(ChanField::RANGE),
+               scan.field<uint8_t>(mask_field));
+}
+
+}  // namespace ouster
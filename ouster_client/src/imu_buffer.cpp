@@ -0,0 +1,303 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/imu_buffer.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "ouster_client/buffered_udp_source.h"
+
+/*
+ * The writer fills slot (end_ & mask_) and then publishes it by incrementing
+ * end_. Writing logical index n clobbers index n - capacity_, so readers copy
+ * what they need and afterwards check that the oldest index they touched is
+ * still newer than end_ - capacity_, retrying otherwise (seqlock-style).
+ */
+namespace ouster {
+
+namespace {
+
+// number of attempts before a reader gives up on a buffer being overwritten
+constexpr int max_read_attempts = 4;
+
+size_t next_pow2(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+}  // namespace
+
+ImuBuffer::ImuBuffer(size_t capacity)
+    : capacity_{next_pow2(std::max<size_t>(capacity, 1) + 1)},
+      mask_{capacity_ - 1},
+      accel_ts_(capacity_) {
+    for (int i = 0; i < 3; i++) {
+        la_[i].resize(capacity_);
+        av_[i].resize(capacity_);
+    }
+}
+
+size_t ImuBuffer::capacity() const { return capacity_ - 1; }
+
+size_t ImuBuffer::size() const {
+    uint64_t begin, end;
+    snapshot(begin, end);
+    return end - begin;
+}
+
+bool ImuBuffer::push(const Imu& imu) {
+    const uint64_t ts = imu.ts[1];
+    const uint64_t end = end_.load(std::memory_order_relaxed);
+    if (end != begin_.load(std::memory_order_relaxed) && ts <= last_ts_)
+        return false;
+
+    // make the overwrite of index end - capacity_ visible no earlier than the
+    // publication of end, which readers compare against
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const size_t slot = end & mask_;
+    accel_ts_[slot] = ts;
+    for (int i = 0; i < 3; i++) {
+        la_[i][slot] = imu.linear_accel[i];
+        av_[i][slot] = imu.angular_vel[i];
+    }
+    last_ts_ = ts;
+
+    end_.store(end + 1, std::memory_order_release);
+    return true;
+}
+
+size_t ImuBuffer::push_packets(const uint8_t* bufs, size_t n_packets,
+                               size_t stride,
+                               const sensor::packet_format& pf) {
+    size_t n = 0;
+    Imu imu;
+    for (size_t i = 0; i < n_packets; i++) {
+        packet_to_imu(bufs + i * stride, pf, imu);
+        if (push(imu)) n++;
+    }
+    return n;
+}
+
+sensor::client_state ImuBuffer::consume(sensor::impl::BufferedUDPSource& src,
+                                        const sensor::packet_format& pf,
+                                        size_t max_packets, float timeout_sec,
+                                        const LidarHandler& on_lidar) {
+    using sensor::client_state;
+
+    const size_t buf_size = std::max(pf.lidar_packet_size, pf.imu_packet_size);
+    if (packet_buf_.size() < buf_size) packet_buf_.resize(buf_size);
+
+    auto res = client_state(0);
+    for (size_t i = 0; i < max_packets; i++) {
+        // only block waiting for the first packet
+        if (i > 0 && src.size() == 0) break;
+
+        auto st = src.consume(packet_buf_.data(), packet_buf_.size(),
+                              i == 0 ? timeout_sec : 0.0f);
+        res = client_state(res | st);
+        if (st & (client_state::EXIT | client_state::CLIENT_ERROR)) break;
+        if (st == client_state::TIMEOUT) break;
+
+        if (st & client_state::IMU_DATA) {
+            push_packets(packet_buf_.data(), 1, 0, pf);
+        } else if ((st & client_state::LIDAR_DATA) && on_lidar) {
+            on_lidar(packet_buf_.data());
+        }
+    }
+    return res;
+}
+
+void ImuBuffer::clear() {
+    begin_.store(end_.load(std::memory_order_relaxed),
+                 std::memory_order_release);
+}
+
+bool ImuBuffer::snapshot(uint64_t& begin, uint64_t& end) const {
+    end = end_.load(std::memory_order_acquire);
+    begin = begin_.load(std::memory_order_acquire);
+    // the slot being written next belongs to index end - capacity_
+    if (end >= capacity_) begin = std::max(begin, end - capacity_ + 1);
+    return begin < end;
+}
+
+bool ImuBuffer::overwritten(uint64_t idx) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t end = end_.load(std::memory_order_relaxed);
+    return idx + capacity_ <= end;
+}
+
+uint64_t ImuBuffer::lower_bound(uint64_t begin, uint64_t end,
+                                uint64_t ts) const {
+    // first index in [begin, end) with accel_ts >= ts
+    uint64_t count = end - begin;
+    while (count > 0) {
+        const uint64_t step = count / 2;
+        const uint64_t mid = begin + step;
+        if (accel_ts_[mid & mask_] < ts) {
+            begin = mid + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    return begin;
+}
+
+void ImuBuffer::lerp(uint64_t i, uint64_t ts, double* la, double* av) const {
+    // interpolate between samples i - 1 and i, where ts is in (t0, t1]
+    const size_t s0 = (i - 1) & mask_;
+    const size_t s1 = i & mask_;
+    const uint64_t t0 = accel_ts_[s0];
+    const uint64_t t1 = accel_ts_[s1];
+    const double a = static_cast<double>(ts - t0) / (t1 - t0);
+    for (int k = 0; k < 3; k++) {
+        la[k] = la_[k][s0] + a * (la_[k][s1] - la_[k][s0]);
+        av[k] = av_[k][s0] + a * (av_[k][s1] - av_[k][s0]);
+    }
+}
+
+bool ImuBuffer::time_range(uint64_t& first, uint64_t& last) const {
+    for (int attempt = 0; attempt < max_read_attempts; attempt++) {
+        uint64_t begin, end;
+        if (!snapshot(begin, end)) return false;
+        first = accel_ts_[begin & mask_];
+        last = accel_ts_[(end - 1) & mask_];
+        if (!overwritten(begin)) return true;
+    }
+    return false;
+}
+
+bool ImuBuffer::at(uint64_t ts, Imu& imu) const {
+    for (int attempt = 0; attempt < max_read_attempts; attempt++) {
+        uint64_t begin, end;
+        if (!snapshot(begin, end)) return false;
+
+        const uint64_t i = lower_bound(begin, end, ts);
+        if (i == end) return false;
+        if (accel_ts_[i & mask_] == ts) {
+            const size_t s = i & mask_;
+            for (int k = 0; k < 3; k++) {
+                imu.linear_accel[k] = la_[k][s];
+                imu.angular_vel[k] = av_[k][s];
+            }
+        } else if (i == begin) {
+            return false;
+        } else {
+            lerp(i, ts, imu.linear_accel.data(), imu.angular_vel.data());
+        }
+        if (overwritten(i == begin ? i : i - 1)) continue;
+
+        imu.ts = {ts, ts, ts};
+        return true;
+    }
+    return false;
+}
+
+size_t ImuBuffer::copy(uint64_t t0, uint64_t t1, Imu* out,
+                       size_t max_samples) const {
+    for (int attempt = 0; attempt < max_read_attempts; attempt++) {
+        uint64_t begin, end;
+        if (!snapshot(begin, end)) return 0;
+
+        uint64_t first = lower_bound(begin, end, t0);
+        if (first > begin && (first == end || accel_ts_[first & mask_] != t0))
+            first--;
+        uint64_t last = lower_bound(first, end, t1);
+        if (last == end) last--;
+
+        const size_t n = std::min<size_t>(
+            static_cast<size_t>(last - first + 1), max_samples);
+        for (size_t j = 0; j < n; j++) {
+            const size_t s = (first + j) & mask_;
+            const uint64_t ts = accel_ts_[s];
+            out[j].ts = {ts, ts, ts};
+            for (int k = 0; k < 3; k++) {
+                out[j].linear_accel[k] = la_[k][s];
+                out[j].angular_vel[k] = av_[k][s];
+            }
+        }
+        if (!overwritten(first)) return n;
+    }
+    return 0;
+}
+
+size_t ImuBuffer::at(const Eigen::Ref<const LidarScan::Header<uint64_t>>& ts,
+                     Vectors& linear_accel, Vectors& angular_vel) const {
+    const auto n = ts.size();
+    linear_accel.resize(n, 3);
+    angular_vel.resize(n, 3);
+
+    for (int attempt = 0; attempt < max_read_attempts; attempt++) {
+        uint64_t begin, end;
+        if (!snapshot(begin, end)) break;
+
+        size_t n_valid = 0;
+        uint64_t oldest = end;
+        uint64_t hint = begin;
+        uint64_t prev_ts = 0;
+        double la[3], av[3];
+        for (Eigen::Index j = 0; j < n; j++) {
+            const uint64_t t = ts[j];
+            if (t == 0) {
+                linear_accel.row(j).setZero();
+                angular_vel.row(j).setZero();
+                continue;
+            }
+
+            // restart the search if the query went backwards
+            if (t < prev_ts) hint = begin;
+            prev_ts = t;
+
+            // gallop forward from the previous result before bisecting
+            uint64_t step = 1;
+            uint64_t lo = hint;
+            while (lo + step < end && accel_ts_[(lo + step) & mask_] < t) {
+                lo += step;
+                step <<= 1;
+            }
+            const uint64_t i = lower_bound(lo, std::min(lo + step + 1, end), t);
+            hint = i > begin ? i - 1 : begin;
+
+            if (i == end) {
+                // hold the newest sample
+                const size_t s = (end - 1) & mask_;
+                for (int k = 0; k < 3; k++) {
+                    la[k] = la_[k][s];
+                    av[k] = av_[k][s];
+                }
+                oldest = std::min(oldest, end - 1);
+            } else if (i == begin || accel_ts_[i & mask_] == t) {
+                // exact match or hold the oldest sample
+                const size_t s = i & mask_;
+                for (int k = 0; k < 3; k++) {
+                    la[k] = la_[k][s];
+                    av[k] = av_[k][s];
+                }
+                if (i != begin || accel_ts_[i & mask_] == t) n_valid++;
+                oldest = std::min(oldest, i);
+            } else {
+                lerp(i, t, la, av);
+                n_valid++;
+                oldest = std::min(oldest, i - 1);
+            }
+
+            for (int k = 0; k < 3; k++) {
+                linear_accel(j, k) = la[k];
+                angular_vel(j, k) = av[k];
+            }
+        }
+
+        if (!overwritten(oldest)) return n_valid;
+    }
+
+    linear_accel.setZero();
+    angular_vel.setZero();
+    return 0;
+}
+
+}  // namespace ouster
@@ -0,0 +1,207 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/imu_preintegration.h"
+
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+
+namespace ouster {
+
+namespace {
+
+constexpr double deg_to_rad = M_PI / 180.0;
+constexpr double ns_to_sec = 1e-9;
+
+Eigen::Matrix3d skew(const Eigen::Vector3d& v) {
+    Eigen::Matrix3d m;
+    m << 0, -v.z(), v.y(), v.z(), 0, -v.x(), -v.y(), v.x(), 0;
+    return m;
+}
+
+/*
+ * Exponential map of SO(3) and its right Jacobian
+ */
+void exp_so3(const Eigen::Vector3d& phi, Eigen::Matrix3d& R,
+             Eigen::Matrix3d& Jr) {
+    const double theta2 = phi.squaredNorm();
+    const Eigen::Matrix3d K = skew(phi);
+    if (theta2 < 1e-12) {
+        R = Eigen::Matrix3d::Identity() + K;
+        Jr = Eigen::Matrix3d::Identity() - 0.5 * K;
+        return;
+    }
+    const double theta = std::sqrt(theta2);
+    const double s = std::sin(theta);
+    const double c = std::cos(theta);
+    const Eigen::Matrix3d K2 = K * K;
+    R = Eigen::Matrix3d::Identity() + (s / theta) * K +
+        ((1.0 - c) / theta2) * K2;
+    Jr = Eigen::Matrix3d::Identity() - ((1.0 - c) / theta2) * K +
+         ((theta - s) / (theta2 * theta)) * K2;
+}
+
+}  // namespace
+
+constexpr double ImuPreintegrator::gravity;
+
+void ImuPreintegrated::reset() {
+    dt = 0.0;
+    delta_R.setIdentity();
+    delta_v.setZero();
+    delta_p.setZero();
+    dR_dbg.setZero();
+    dv_dba.setZero();
+    dv_dbg.setZero();
+    dp_dba.setZero();
+    dp_dbg.setZero();
+}
+
+ImuPreintegrator::ImuPreintegrator(const sensor::sensor_info& info)
+    : ImuPreintegrator(info.imu_to_sensor_transform) {}
+
+ImuPreintegrator::ImuPreintegrator(const mat4d& imu_to_sensor_transform)
+    : imu_to_sensor_{imu_to_sensor_transform.topLeftCorner<3, 3>()} {
+    delta_.reset();
+}
+
+void ImuPreintegrator::set_bias(const Eigen::Vector3d& accel_bias,
+                                const Eigen::Vector3d& gyro_bias) {
+    accel_bias_ = accel_bias;
+    gyro_bias_ = gyro_bias;
+}
+
+void ImuPreintegrator::reset() { delta_.reset(); }
+
+const ImuPreintegrated& ImuPreintegrator::delta() const { return delta_; }
+
+void ImuPreintegrator::step(const Eigen::Vector3d& a, const Eigen::Vector3d& w,
+                            double dt) {
+    if (dt <= 0.0) return;
+
+    Eigen::Matrix3d dR_inc, Jr;
+    exp_so3(w * dt, dR_inc, Jr);
+
+    const double dt2 = dt * dt;
+    const Eigen::Matrix3d& R = delta_.delta_R;
+    // rotate the acceleration by the attitude at the middle of the step
+    const Eigen::Vector3d Ra = R * (a + 0.5 * dt * w.cross(a));
+    const Eigen::Matrix3d R_ax_dbg = R * skew(a) * delta_.dR_dbg;
+
+    // Jacobians first: they depend on the deltas before this step
+    delta_.dp_dba += delta_.dv_dba * dt - 0.5 * R * dt2;
+    delta_.dp_dbg += delta_.dv_dbg * dt - 0.5 * R_ax_dbg * dt2;
+    delta_.dv_dba -= R * dt;
+    delta_.dv_dbg -= R_ax_dbg * dt;
+    delta_.dR_dbg = dR_inc.transpose() * delta_.dR_dbg - Jr * dt;
+
+    delta_.delta_p += delta_.delta_v * dt + 0.5 * Ra * dt2;
+    delta_.delta_v += Ra * dt;
+    delta_.delta_R = R * dR_inc;
+    delta_.dt += dt;
+}
+
+void ImuPreintegrator::integrate(const Eigen::Vector3d& linear_accel,
+                                 const Eigen::Vector3d& angular_vel,
+                                 double dt) {
+    step(imu_to_sensor_ * (linear_accel * gravity) - accel_bias_,
+         imu_to_sensor_ * (angular_vel * deg_to_rad) - gyro_bias_, dt);
+}
+
+size_t ImuPreintegrator::fetch(const ImuBuffer& buf, uint64_t t0,
+                               uint64_t t1) {
+    // sized to the buffer once so that later queries don't allocate
+    if (samples_.size() < buf.capacity()) samples_.resize(buf.capacity());
+    const size_t n = buf.copy(t0, t1, samples_.data(), samples_.size());
+    if (n == 0 || samples_[0].ts[1] > t0 || samples_[n - 1].ts[1] < t1)
+        return 0;
+    return n;
+}
+
+/*
+ * Integrate from t to target, where samples_[k] is the latest sample at or
+ * before t. Measurements are linear between samples, so the midpoint of each
+ * sub-interval is exact for the average over it.
+ */
+void ImuPreintegrator::advance(size_t n, size_t& k, uint64_t& t,
+                               uint64_t target) {
+    Eigen::Vector3d la, av;
+    while (t < target) {
+        while (k + 1 < n && samples_[k + 1].ts[1] <= t) k++;
+
+        const Imu& s0 = samples_[k];
+        const uint64_t tb =
+            k + 1 < n ? std::min(target, samples_[k + 1].ts[1]) : target;
+        const double tm = 0.5 * (static_cast<double>(t) + tb);
+
+        if (k + 1 < n) {
+            const Imu& s1 = samples_[k + 1];
+            const double alpha = (tm - s0.ts[1]) /
+                                 static_cast<double>(s1.ts[1] - s0.ts[1]);
+            for (int i = 0; i < 3; i++) {
+                la[i] = s0.linear_accel[i] +
+                        alpha * (s1.linear_accel[i] - s0.linear_accel[i]);
+                av[i] = s0.angular_vel[i] +
+                        alpha * (s1.angular_vel[i] - s0.angular_vel[i]);
+            }
+        } else {
+            la = Eigen::Map<const Eigen::Vector3d>(s0.linear_accel.data());
+            av = Eigen::Map<const Eigen::Vector3d>(s0.angular_vel.data());
+        }
+
+        integrate(la, av, (tb - t) * ns_to_sec);
+        t = tb;
+    }
+}
+
+bool ImuPreintegrator::integrate(const ImuBuffer& buf, uint64_t t0,
+                                 uint64_t t1) {
+    reset();
+    if (t1 < t0) return false;
+    const size_t n = fetch(buf, t0, t1);
+    if (n == 0) return false;
+
+    size_t k = 0;
+    uint64_t t = t0;
+    advance(n, k, t, t1);
+    return true;
+}
+
+bool ImuPreintegrator::integrate(
+    const ImuBuffer& buf,
+    const Eigen::Ref<const LidarScan::Header<uint64_t>>& ts,
+    std::vector<ImuPreintegrated>& out) {
+    reset();
+    out.resize(ts.size());
+    for (auto& d : out) d.reset();
+
+    // first and last valid timestamps
+    Eigen::Index first = 0;
+    while (first < ts.size() && ts[first] == 0) first++;
+    if (first == ts.size()) return false;
+    Eigen::Index last = ts.size() - 1;
+    while (ts[last] == 0) last--;
+
+    const size_t n = fetch(buf, ts[first], ts[last]);
+    if (n == 0) return false;
+
+    size_t k = 0;
+    uint64_t t = ts[first];
+    for (Eigen::Index j = first; j < ts.size(); j++) {
+        if (ts[j] != 0) {
+            if (ts[j] < t) {
+                reset();
+                for (auto& d : out) d.reset();
+                return false;
+            }
+            advance(n, k, t, ts[j]);
+        }
+        out[j] = delta_;
+    }
+    return true;
+}
+
+}  // namespace ouster
@@ -6,9 +6,11 @@
 #include "ouster_client/lidar_scan.h"
 
 #include <Eigen/Core>
+#include <algorithm>
 #include <cmath>
 #include <cstddef>
 #include <cstring>
+#include <limits>
 #include <type_traits>
 #include <vector>
 
@@ -396,17 +398,211 @@ LidarScan::Points cartesian(const Eigen::Ref<const img_t<uint32_t>>& range,
     return (nooffset.array() == 0.0).select(nooffset, nooffset + lut.offset);
 }
 
+namespace {
+
+// pixels per tile of cartesian() over a region of interest
+constexpr std::ptrdiff_t roi_tile = 256;
+
+// nonzero for the columns of a region of interest
+std::vector<uint8_t> roi_columns(const ScanRoi& roi, size_t w) {
+    if (roi.col_begin >= w || roi.col_end > w)
+        throw std::invalid_argument("region of interest out of range");
+    std::vector<uint8_t> cols(w, roi.col_begin == roi.col_end);
+    if (roi.col_begin < roi.col_end) {
+        std::fill(cols.begin() + roi.col_begin, cols.begin() + roi.col_end, 1);
+    } else if (roi.col_begin > roi.col_end) {
+        std::fill(cols.begin() + roi.col_begin, cols.end(), 1);
+        std::fill(cols.begin(), cols.begin() + roi.col_end, 1);
+    }
+    return cols;
+}
+
+}  // namespace
+
+ScanRoi make_sector_roi(const sensor::sensor_info& info, double az_begin_deg,
+                        double az_end_deg) {
+    const size_t w = info.format.columns_per_frame;
+    const auto& beam_az = info.beam_azimuth_angles;
+    if (w == 0 || beam_az.empty())
+        throw std::invalid_argument("unexpected scan dimensions");
+
+    ScanRoi roi;
+    const double width = az_end_deg - az_begin_deg;
+    if (width >= 360.0) return roi;
+
+    // the pixel of column v and beam u looks at 360 - 360 v / w - az[u]
+    // degrees in the lidar frame, turned by the yaw of the sensor frame
+    const auto& t = info.lidar_to_sensor_transform;
+    const double yaw = std::atan2(t(1, 0), t(0, 0)) * 180.0 / M_PI;
+    const double begin = az_begin_deg - yaw;
+    const double sector = std::fmod(std::fmod(width, 360.0) + 360.0, 360.0);
+    const auto az = std::minmax_element(beam_az.begin(), beam_az.end());
+    const double cols_per_deg = w / 360.0;
+    const auto v_lo = static_cast<long>(
+        std::floor((360.0 - *az.second - begin - sector) * cols_per_deg));
+    const auto v_hi = static_cast<long>(
+        std::floor((360.0 - *az.first - begin) * cols_per_deg));
+
+    const long n_cols = v_hi - v_lo + 1;
+    const auto iw = static_cast<long>(w);
+    if (n_cols >= iw) return roi;
+    roi.col_begin = static_cast<size_t>((v_lo % iw + iw) % iw);
+    roi.col_end = (roi.col_begin + n_cols) % w;
+    return roi;
+}
+
+XYZRoiLut make_roi_lut(const XYZLut& lut, size_t w, size_t h,
+                       const ScanRoi& roi) {
+    const size_t n = w * h;
+    if (n == 0 || static_cast<size_t>(lut.direction.rows()) != n ||
+        static_cast<size_t>(lut.offset.rows()) != n)
+        throw std::invalid_argument("unexpected scan dimensions");
+    const std::vector<uint8_t> cols = roi_columns(roi, w);
+    std::vector<uint8_t> rows(h, roi.beams.empty());
+    for (size_t u : roi.beams) {
+        if (u >= h)
+            throw std::invalid_argument("region of interest out of range");
+        rows[u] = 1;
+    }
+
+    XYZRoiLut out;
+    out.w = w;
+    out.h = h;
+
+    // raw range interval of each pixel within the box, by slabs; zero
+    // ranges are no returns and ranges fit in 31 bits
+    std::vector<size_t> pixels;
+    std::vector<uint32_t> range_min, range_max;
+    const double max_range = std::numeric_limits<int32_t>::max();
+    for (size_t u = 0; u < h; u++) {
+        if (!rows[u]) continue;
+        for (size_t v = 0; v < w; v++) {
+            if (!cols[v]) continue;
+            const size_t i = u * w + v;
+            double lo = 1.0, hi = max_range;
+            bool empty = false;
+            for (int k = 0; roi.box && k < 3; k++) {
+                const double d = lut.direction(i, k), o = lut.offset(i, k);
+                const double b_min = roi.box->min(k), b_max = roi.box->max(k);
+                if (d > 0.0) {
+                    lo = std::max(lo, (b_min - o) / d);
+                    hi = std::min(hi, (b_max - o) / d);
+                } else if (d < 0.0) {
+                    lo = std::max(lo, (b_max - o) / d);
+                    hi = std::min(hi, (b_min - o) / d);
+                } else {
+                    empty |= o < b_min || o > b_max;
+                }
+            }
+            lo = std::ceil(lo);
+            hi = std::floor(hi);
+            if (empty || !(lo <= hi)) continue;
+
+            if (!out.spans.empty() && out.spans.back().second == i)
+                out.spans.back().second++;
+            else
+                out.spans.emplace_back(i, i + 1);
+            pixels.push_back(i);
+            range_min.push_back(static_cast<uint32_t>(lo));
+            range_max.push_back(static_cast<uint32_t>(hi));
+        }
+    }
+
+    const auto m = static_cast<Eigen::Index>(pixels.size());
+    out.lut.direction.resize(m, 3);
+    out.lut.offset.resize(m, 3);
+    for (Eigen::Index j = 0; j < m; j++) {
+        out.lut.direction.row(j) = lut.direction.row(pixels[j]);
+        out.lut.offset.row(j) = lut.offset.row(pixels[j]);
+    }
+    using RangeArray = Eigen::Array<uint32_t, -1, 1>;
+    out.range_min = Eigen::Map<const RangeArray>(range_min.data(), m);
+    out.range_max = Eigen::Map<const RangeArray>(range_max.data(), m);
+    return out;
+}
+
+LidarScan::Points cartesian(const LidarScan& scan, const XYZRoiLut& lut) {
+    return cartesian(scan.field(ChanField::RANGE), lut);
+}
+
+LidarScan::Points cartesian(const Eigen::Ref<const img_t<uint32_t>>& range,
+                            const XYZRoiLut& lut) {
+    if (static_cast<size_t>(range.rows()) != lut.h ||
+        static_cast<size_t>(range.cols()) != lut.w)
+        throw std::invalid_argument("unexpected image dimensions");
+
+    const Eigen::Index n = lut.lut.direction.rows();
+    LidarScan::Points points(n, 3);
+
+    // first point of each span
+    const auto n_spans = static_cast<std::ptrdiff_t>(lut.spans.size());
+    std::vector<Eigen::Index> first(n_spans);
+    Eigen::Index total = 0;
+    for (std::ptrdiff_t s = 0; s < n_spans; s++) {
+        first[s] = total;
+        total += lut.spans[s].second - lut.spans[s].first;
+    }
+
+    const uint32_t* rng = range.data();
+    const double* dir = lut.lut.direction.data();
+    const double* ofs = lut.lut.offset.data();
+    const uint32_t* lo = lut.range_min.data();
+    const uint32_t* hi = lut.range_max.data();
+    double* pts = points.data();
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel for schedule(static)
+#endif
+    for (std::ptrdiff_t s = 0; s < n_spans; s++) {
+        const uint32_t* r_span = rng + lut.spans[s].first;
+        const auto len = static_cast<std::ptrdiff_t>(lut.spans[s].second -
+                                                     lut.spans[s].first);
+        const Eigen::Index k0 = first[s];
+
+        // points out of the box are zeroed in arithmetic, with the bounds
+        // checked on signed integers; ranges fit in 31 bits. The factors of
+        // a tile go to local buffers first, so that both loops vectorize
+        double rk[roi_tile], ok[roi_tile];
+        for (std::ptrdiff_t j0 = 0; j0 < len; j0 += roi_tile) {
+            const std::ptrdiff_t m = std::min(roi_tile, len - j0);
+            const Eigen::Index k = k0 + j0;
+            for (std::ptrdiff_t j = 0; j < m; j++) {
+                const auto r = static_cast<int32_t>(r_span[j0 + j]);
+                const int32_t keep =
+                    static_cast<int32_t>(r >= static_cast<int32_t>(lo[k + j])) &
+                    static_cast<int32_t>(r <= static_cast<int32_t>(hi[k + j]));
+                rk[j] = r * keep;
+                ok[j] = keep;
+            }
+            for (Eigen::Index c = 0; c < 3; c++) {
+                const double* d = dir + c * n + k;
+                const double* o = ofs + c * n + k;
+                double* p = pts + c * n + k;
+                for (std::ptrdiff_t j = 0; j < m; j++)
+                    p[j] = rk[j] * d[j] + ok[j] * o[j];
+            }
+        }
+    }
+    return points;
+}
+
 ScanBatcher::ScanBatcher(size_t w, const sensor::packet_format& pf)
     : w(w),
       h(pf.pixels_per_column),
       next_valid_m_id(0),
       next_headers_m_id(0),
       cache(pf.lidar_packet_size),
+      decode_col(w, 1),
       pf(pf) {}
 
 ScanBatcher::ScanBatcher(const sensor::sensor_info& info)
     : ScanBatcher(info.format.columns_per_frame, sensor::get_format(info)) {}
 
+ScanBatcher::ScanBatcher(const sensor::sensor_info& info, const ScanRoi& roi)
+    : ScanBatcher(info) {
+    decode_col = roi_columns(roi, w);
+}
+
 namespace {
 
 /*
@@ -449,23 +645,6 @@ struct parse_field_col {
     }
 };
 
-uint64_t frame_status(const uint8_t thermal_shutdown,
-                      const uint8_t shot_limiting) {
-    uint64_t res = 0;
-
-    // clang-format off
-    res |= (thermal_shutdown & 0x0f)
-        << FRAME_STATUS_THERMAL_SHUTDOWN_SHIFT;  // right nibble is thermal
-                                                 // shutdown status, apply mask
-                                                 // for safety, then shift
-    //clang-format on
-    res |= (shot_limiting & 0x0f)
-           << FRAME_STATUS_SHOT_LIMITING_SHIFT;  // right nibble is shot
-                                                 // limiting, apply mask for
-                                                 // safety, then shift
-    return res;
-}
-
 /**
  * Checks whether RAW_HEADERS field is present and can be used to store headers.
  *
@@ -536,23 +715,96 @@ struct pack_raw_headers_col {
     }
 };
 
+/*
+ * Prefetch the packet header and the measurement block headers of a packet,
+ * which are read first when batching it
+ */
+inline void prefetch_headers(const sensor::packet_format& pf,
+                             const uint8_t* packet_buf) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(packet_buf);
+    for (int icol = 0; icol < pf.columns_per_packet; icol++)
+        __builtin_prefetch(pf.nth_col(icol, packet_buf));
+#else
+    (void)pf;
+    (void)packet_buf;
+#endif
+}
+
+bool same_layout(const LidarScan& a, const LidarScan& b) {
+    return a.w == b.w && a.h == b.h &&
+           std::equal(a.begin(), a.end(), b.begin(), b.end());
+}
+
 }  // namespace
 
+namespace impl {
+
+uint64_t frame_status(const uint8_t thermal_shutdown,
+                      const uint8_t shot_limiting) {
+    uint64_t res = 0;
+
+    // clang-format off
+    res |= (thermal_shutdown & 0x0f)
+        << FRAME_STATUS_THERMAL_SHUTDOWN_SHIFT;  // right nibble is thermal
+                                                 // shutdown status, apply mask
+                                                 // for safety, then shift
+    //clang-format on
+    res |= (shot_limiting & 0x0f)
+           << FRAME_STATUS_SHOT_LIMITING_SHIFT;  // right nibble is shot
+                                                 // limiting, apply mask for
+                                                 // safety, then shift
+    return res;
+}
+
+}  // namespace impl
+
 bool ScanBatcher::operator()(const uint8_t* packet_buf, LidarScan& ls) {
     if (ls.w != w || ls.h != h)
         throw std::invalid_argument("unexpected scan dimensions");
 
+    return batch_packet(packet_buf, ls, raw_headers_enabled(pf, ls));
+}
+
+size_t ScanBatcher::operator()(const uint8_t* const* packet_bufs,
+                               const size_t* packet_sizes, size_t n_packets,
+                               LidarScan& ls, std::vector<LidarScan>& scans) {
+    if (ls.w != w || ls.h != h)
+        throw std::invalid_argument("unexpected scan dimensions");
+
+    // swapping scans keeps the fields, so this holds for the whole batch
+    const bool raw_headers = raw_headers_enabled(pf, ls);
+
+    size_t n_scans = 0;
+    for (size_t i = 0; i < n_packets; i++) {
+        if (i + 1 < n_packets) prefetch_headers(pf, packet_bufs[i + 1]);
+        if (packet_sizes[i] != pf.lidar_packet_size) continue;
+        if (!batch_packet(packet_bufs[i], ls, raw_headers)) continue;
+
+        // hand over the completed scan without copying it when possible; the
+        // scan swapped in is overwritten by batching, like a reused scan
+        if (n_scans == scans.size())
+            scans.push_back(ls);
+        else if (same_layout(scans[n_scans], ls))
+            std::swap(scans[n_scans], ls);
+        else
+            scans[n_scans] = ls;
+        n_scans++;
+    }
+    return n_scans;
+}
+
+bool ScanBatcher::batch_packet(const uint8_t* packet_buf, LidarScan& ls,
+                               bool raw_headers) {
     // process cached packet
     if (cached_packet) {
         cached_packet = false;
         ls.frame_id = -1;
-        this->operator()(cache.data(), ls);
+        batch_packet(cache.data(), ls, raw_headers);
     }
 
     const uint16_t f_id = pf.frame_id(packet_buf);
 
-    const bool raw_headers = raw_headers_enabled(pf, ls);
-
     if (ls.frame_id == -1) {
         // expecting to start batching a new scan
         next_valid_m_id = 0;
@@ -561,7 +813,8 @@ bool ScanBatcher::operator()(const uint8_t* packet_buf, LidarScan& ls) {
 
         const uint8_t f_thermal_shutdown = pf.thermal_shutdown(packet_buf);
         const uint8_t f_shot_limiting = pf.shot_limiting(packet_buf);
-        ls.frame_status = frame_status(f_thermal_shutdown, f_shot_limiting);
+        ls.frame_status =
+            impl::frame_status(f_thermal_shutdown, f_shot_limiting);
 
     } else if (ls.frame_id == static_cast<uint16_t>(f_id + 1)) {
         // drop reordered packets from the previous frame
@@ -596,7 +849,9 @@ bool ScanBatcher::operator()(const uint8_t* packet_buf, LidarScan& ls) {
         // drop out-of-bounds data in case of misconfiguration
         if (m_id >= w) continue;
 
-        if (raw_headers) {
+        // columns outside of the region of interest are zeroed like missing
+        // columns, raw headers included
+        if (raw_headers && decode_col[m_id]) {
             // zero out missing columns if we jumped forward
             if (m_id >= next_headers_m_id) {
                 impl::visit_field(ls, ChanField::RAW_HEADERS, zero_field_cols(),
@@ -610,8 +865,8 @@ bool ScanBatcher::operator()(const uint8_t* packet_buf, LidarScan& ls) {
                               pf, icol, packet_buf);
         }
 
-        // drop invalid
-        if (!valid) continue;
+        // drop invalid columns and columns outside of the region of interest
+        if (!valid || !decode_col[m_id]) continue;
 
         // zero out missing columns if we jumped forward
         if (m_id >= next_valid_m_id) {
@@ -0,0 +1,256 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/normal_estimation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace ouster {
+
+namespace {
+
+// columns processed at once by the vectorized loops
+constexpr std::ptrdiff_t chunk = 64;
+
+}  // namespace
+
+NormalEstimation::NormalEstimation(const sensor::sensor_info& info, int half,
+                                   double max_depth_change)
+    : w_{static_cast<std::ptrdiff_t>(info.format.columns_per_frame)},
+      h_{static_cast<std::ptrdiff_t>(info.format.pixels_per_column)},
+      half_{half},
+      max_depth_change_{static_cast<float>(max_depth_change)} {
+    if (half < 1 || half >= w_ / 2)
+        throw std::invalid_argument("invalid normal estimation window");
+
+    const auto& shift = info.format.pixel_shift_by_row;
+    if (static_cast<std::ptrdiff_t>(shift.size()) != h_)
+        throw std::invalid_argument("unexpected scan dimensions");
+
+    const int iw = static_cast<int>(w_);
+    shift_.resize(h_);
+    for (std::ptrdiff_t u = 0; u < h_; u++)
+        shift_[u] = (shift[u] % iw + iw) % iw;
+
+    const std::ptrdiff_t pw = w_ + 2 * half_;
+    points_.resize(4 * h_ * pw);
+}
+
+template <typename POS>
+void NormalEstimation::run(POS&& pos, PointsF& normals) {
+    const std::ptrdiff_t w = w_, h = h_, k = half_;
+    const std::ptrdiff_t pw = w + 2 * k;  // padded width
+    float* pts = points_.data();
+
+    // gather destaggered points, padded with wrapped columns
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel for schedule(static)
+#endif
+    for (std::ptrdiff_t u = 0; u < h; u++) {
+        float* row = pts + 4 * u * pw;
+        std::ptrdiff_t v = ((w - k - shift_[u]) % w + w) % w;
+        for (std::ptrdiff_t j = 0; j < pw; j++, v = v + 1 == w ? 0 : v + 1)
+            pos(u * w + v, row + j, pw);
+    }
+
+    normals.resize(w * h, 3);
+    float* out = normals.data();
+    const std::ptrdiff_t n = w * h;
+    const float lo = std::max(1.0f - max_depth_change_, 0.0f);
+    const float hi = 1.0f + max_depth_change_;
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel
+#endif
+    {
+        // per column sums of the k rows above, the k rows below and all
+        // 2k + 1 rows around the current row
+        std::vector<float> cols(12 * pw);
+        std::vector<float> nrm(3 * w);  // normals of the row
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp for schedule(static)
+#endif
+        for (std::ptrdiff_t u = 0; u < h; u++) {
+            float* above = cols.data();
+            float* below = above + 4 * pw;
+            float* full = below + 4 * pw;
+            std::fill(cols.begin(), cols.end(), 0.0f);
+            for (std::ptrdiff_t i = 1; i <= k; i++) {
+                if (u - i >= 0) {
+                    const float* row = pts + 4 * (u - i) * pw;
+                    for (std::ptrdiff_t j = 0; j < 4 * pw; j++)
+                        above[j] += row[j];
+                }
+                if (u + i < h) {
+                    const float* row = pts + 4 * (u + i) * pw;
+                    for (std::ptrdiff_t j = 0; j < 4 * pw; j++)
+                        below[j] += row[j];
+                }
+            }
+            const float* mid = pts + 4 * u * pw;
+            for (std::ptrdiff_t j = 0; j < 4 * pw; j++)
+                full[j] = above[j] + mid[j] + below[j];
+
+            // left and right windows of full, upper window of above and
+            // lower window of below: first and past the last offset from the
+            // padded column
+            const float* win[4] = {full, full, above, below};
+            const std::ptrdiff_t first[4] = {-k, 1, -k, -k};
+            const std::ptrdiff_t last[4] = {0, k + 1, k + 1, k + 1};
+            const float* qx = mid + k;
+            const float* qy = qx + pw;
+            const float* qz = qy + pw;
+            const float* valid = qz + pw;
+
+            // columns are processed in chunks kept in local arrays, which
+            // the compiler knows not to alias the inputs, so that the loops
+            // vectorize; selects are written in arithmetic for the same
+            // reason
+            for (std::ptrdiff_t c0 = 0; c0 < w; c0 += chunk) {
+                const std::ptrdiff_t nc = std::min(chunk, w - c0);
+
+                // window sums, accumulated over window offsets so that the
+                // loops over columns vectorize; they stay small enough for
+                // floats to keep the precision of near surfaces, unlike
+                // prefix sums along the row
+                float sums[4][4][chunk];
+                for (int d = 0; d < 4; d++) {
+                    for (int i = 0; i < 4; i++) {
+                        float* sum = sums[d][i];
+                        std::fill(sum, sum + nc, 0.0f);
+                        const float* plane = win[d] + i * pw + k + c0;
+                        for (std::ptrdiff_t t = first[d]; t < last[d]; t++)
+                            for (std::ptrdiff_t c = 0; c < nc; c++)
+                                sum[c] += plane[c + t];
+                    }
+                }
+
+                // window means, or the pixel itself for empty windows and
+                // windows across a depth discontinuity
+                float m[4][3][chunk], use[4][chunk];
+                for (int d = 0; d < 4; d++) {
+                    const float* sx = sums[d][0];
+                    const float* sy = sums[d][1];
+                    const float* sz = sums[d][2];
+                    const float* cnt = sums[d][3];
+                    for (std::ptrdiff_t c = 0; c < nc; c++) {
+                        const float inv =
+                            1.0f / (cnt[c] + static_cast<float>(cnt[c] < 0.5f));
+                        const float x = sx[c] * inv, y = sy[c] * inv,
+                                    z = sz[c] * inv;
+                        const float ax = qx[c0 + c], ay = qy[c0 + c],
+                                    az = qz[c0 + c];
+                        const float sq_range = ax * ax + ay * ay + az * az;
+                        const float sq = x * x + y * y + z * z;
+                        const float ok = static_cast<float>(
+                            static_cast<int32_t>(cnt[c] >= 0.5f) &
+                            static_cast<int32_t>(sq >= sq_range * lo * lo) &
+                            static_cast<int32_t>(sq <= sq_range * hi * hi));
+                        m[d][0][c] = ax + ok * (x - ax);
+                        m[d][1][c] = ay + ok * (y - ay);
+                        m[d][2][c] = az + ok * (z - az);
+                        use[d][c] = ok;
+                    }
+                }
+
+                // normals from the tangents, towards the sensor, and their
+                // scale: zero where there is no normal
+                float n3[3][chunk], scale[chunk], sq_len[chunk];
+                for (std::ptrdiff_t c = 0; c < nc; c++) {
+                    const float hx = m[1][0][c] - m[0][0][c];
+                    const float hy = m[1][1][c] - m[0][1][c];
+                    const float hz = m[1][2][c] - m[0][2][c];
+                    const float vx = m[3][0][c] - m[2][0][c];
+                    const float vy = m[3][1][c] - m[2][1][c];
+                    const float vz = m[3][2][c] - m[2][2][c];
+                    const float nx = hy * vz - hz * vy;
+                    const float ny = hz * vx - hx * vz;
+                    const float nz = hx * vy - hy * vx;
+                    const float sq = nx * nx + ny * ny + nz * nz;
+                    const int32_t ok =
+                        static_cast<int32_t>(valid[c0 + c] != 0.0f) &
+                        static_cast<int32_t>(use[0][c] + use[1][c] != 0.0f) &
+                        static_cast<int32_t>(use[2][c] + use[3][c] != 0.0f) &
+                        static_cast<int32_t>(sq > 0.0f);
+                    const float facing = static_cast<float>(
+                        nx * qx[c0 + c] + ny * qy[c0 + c] + nz * qz[c0 + c] >
+                        0.0f);
+                    n3[0][c] = nx;
+                    n3[1][c] = ny;
+                    n3[2][c] = nz;
+                    scale[c] = static_cast<float>(ok) * (1.0f - 2.0f * facing);
+                    sq_len[c] = sq + static_cast<float>(ok ^ 1);
+                }
+                // Eigen's sqrt is vectorized, unlike std::sqrt, which sets
+                // errno
+                Eigen::Map<Eigen::ArrayXf>(scale, nc) /=
+                    Eigen::Map<Eigen::ArrayXf>(sq_len, nc).sqrt();
+                for (int i = 0; i < 3; i++)
+                    for (std::ptrdiff_t c = 0; c < nc; c++)
+                        nrm[i * w + c0 + c] = scale[c] * n3[i][c];
+            }
+
+            // back to the staggered columns: destaggered column c is the
+            // staggered column (c - shift) mod w
+            const std::ptrdiff_t v0 = (w - shift_[u]) % w;
+            for (int i = 0; i < 3; i++) {
+                const float* src = nrm.data() + i * w;
+                float* dst = out + i * n + u * w;
+                std::copy(src, src + w - v0, dst + v0);
+                std::copy(src + w - v0, src + w, dst);
+            }
+        }
+    }
+}
+
+void NormalEstimation::operator()(const LidarScan& scan, const XYZLut& lut,
+                                  PointsF& normals) {
+    const auto range = scan.field(sensor::ChanField::RANGE);
+    if (range.rows() != h_ || range.cols() != w_ ||
+        lut.direction.rows() != range.size())
+        throw std::invalid_argument("unexpected image dimensions");
+
+    const std::ptrdiff_t n = range.size();
+    const uint32_t* rng = range.data();
+    const double* dir = lut.direction.data();
+    const double* ofs = lut.offset.data();
+    run(
+        [=](std::ptrdiff_t i, float* p, std::ptrdiff_t stride) {
+            const double r = rng[i];
+            const float valid = r != 0;
+            p[0] = valid * static_cast<float>(r * dir[i] + ofs[i]);
+            p[stride] =
+                valid * static_cast<float>(r * dir[n + i] + ofs[n + i]);
+            p[2 * stride] =
+                valid * static_cast<float>(r * dir[2 * n + i] + ofs[2 * n + i]);
+            p[3 * stride] = valid;
+        },
+        normals);
+}
+
+void NormalEstimation::operator()(const LidarScan::Points& points,
+                                  PointsF& normals) {
+    if (points.rows() != w_ * h_)
+        throw std::invalid_argument("unexpected number of points");
+
+    const std::ptrdiff_t n = points.rows();
+    const double* pts = points.data();
+    run(
+        [=](std::ptrdiff_t i, float* p, std::ptrdiff_t stride) {
+            const float x = static_cast<float>(pts[i]);
+            const float y = static_cast<float>(pts[n + i]);
+            const float z = static_cast<float>(pts[2 * n + i]);
+            p[0] = x;
+            p[stride] = y;
+            p[2 * stride] = z;
+            p[3 * stride] = x != 0.0f || y != 0.0f || z != 0.0f;
+        },
+        normals);
+}
+
+}  // namespace ouster
@@ -0,0 +1,477 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/occupancy_map.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace ouster {
+
+namespace {
+
+constexpr int brick_bits = 3;
+constexpr int32_t brick_mask = (1 << brick_bits) - 1;
+constexpr size_t brick_voxels = size_t{1} << (3 * brick_bits);
+
+constexpr uint64_t empty_key = ~uint64_t{0};
+constexpr uint32_t no_brick = ~uint32_t{0};
+constexpr uint32_t pending = no_brick - 1;
+
+// brick coordinates are packed into 21 bits each
+constexpr int64_t key_bias = int64_t{1} << 20;
+constexpr uint64_t key_mask = (uint64_t{1} << 21) - 1;
+
+size_t next_pow2(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+inline uint64_t hash_key(uint64_t k) {
+    // splitmix64 finalizer
+    k ^= k >> 30;
+    k *= 0xbf58476d1ce4e5b9ull;
+    k ^= k >> 27;
+    k *= 0x94d049bb133111ebull;
+    k ^= k >> 31;
+    return k;
+}
+
+inline uint64_t brick_key(int32_t x, int32_t y, int32_t z) {
+    const auto pack = [](int32_t c) {
+        return static_cast<uint64_t>((c >> brick_bits) + key_bias) & key_mask;
+    };
+    return pack(x) | (pack(y) << 21) | (pack(z) << 42);
+}
+
+inline int32_t brick_coord(uint64_t key, int k) {
+    return static_cast<int32_t>(
+        static_cast<int64_t>((key >> (21 * k)) & key_mask) - key_bias);
+}
+
+inline size_t voxel_index(int32_t x, int32_t y, int32_t z) {
+    return (x & brick_mask) | ((y & brick_mask) << brick_bits) |
+           ((z & brick_mask) << (2 * brick_bits));
+}
+
+inline float logit(double p) {
+    return static_cast<float>(std::log(p / (1.0 - p)));
+}
+
+struct Brick {
+    std::mutex mtx;
+    uint64_t key;
+    uint32_t last_used;             // scan of the last update
+    uint32_t stamp[brick_voxels];   // scan of the last update of each voxel
+    float log_odds[brick_voxels];
+};
+
+/*
+ * Slot of the brick hash. Slots are claimed by a compare-and-swap of the key
+ * and then published by storing the brick index, so that lookups and
+ * insertions may run concurrently. Slots are only erased between scans.
+ */
+struct Slot {
+    std::atomic<uint64_t> key;
+    std::atomic<uint32_t> brick;
+};
+
+// direct-mapped cache of brick lookups, private to a thread during a scan;
+// neighbouring rays mostly cross the same bricks
+struct BrickCache {
+    static constexpr size_t size = 256;
+    uint64_t keys[size];
+    Brick* bricks[size];
+
+    BrickCache() { std::fill(keys, keys + size, empty_key); }
+};
+
+}  // namespace
+
+struct OccupancyMap::Impl {
+    double inv_voxel;
+    double voxel_size;
+    double max_range;
+    float hit, miss, min_log_odds, max_log_odds;
+    size_t max_bricks;
+
+    size_t mask;
+    std::unique_ptr<Slot[]> slots;
+
+    // bricks are allocated on first use and recycled after eviction
+    std::vector<std::unique_ptr<Brick>> pool;
+    std::vector<uint32_t> free_list;
+    std::atomic<std::ptrdiff_t> free_top{0};
+    std::atomic<size_t> dropped{0};
+    uint32_t scan{0};
+
+    void reset() {
+        for (size_t s = 0; s <= mask; s++) {
+            slots[s].key.store(empty_key, std::memory_order_relaxed);
+            slots[s].brick.store(pending, std::memory_order_relaxed);
+        }
+        for (size_t k = 0; k < max_bricks; k++) {
+            free_list[k] = static_cast<uint32_t>(max_bricks - 1 - k);
+            if (pool[k]) pool[k]->key = empty_key;
+        }
+        free_top = static_cast<std::ptrdiff_t>(max_bricks);
+    }
+
+    size_t used() const { return max_bricks - free_top; }
+
+    // pop a brick from the free list; safe to call concurrently
+    uint32_t allocate(uint64_t key) {
+        const std::ptrdiff_t k = free_top.fetch_sub(1) - 1;
+        if (k < 0) {
+            dropped++;
+            return no_brick;
+        }
+        const uint32_t b = free_list[k];
+        if (!pool[b]) pool[b].reset(new Brick{});
+        Brick& brick = *pool[b];
+        brick.key = key;
+        brick.last_used = 0;
+        std::fill(brick.stamp, brick.stamp + brick_voxels, 0);
+        std::fill(brick.log_odds, brick.log_odds + brick_voxels, 0.0f);
+        return b;
+    }
+
+    // find or insert a brick; safe to call concurrently
+    Brick* acquire(uint64_t key) {
+        size_t s = hash_key(key) & mask;
+        for (size_t probes = 0; probes <= mask; probes++) {
+            uint64_t k = slots[s].key.load(std::memory_order_acquire);
+            if (k == empty_key && free_top <= 0) {
+                // don't fill the table with keys of bricks that won't fit
+                dropped++;
+                return nullptr;
+            }
+            if (k == empty_key &&
+                slots[s].key.compare_exchange_strong(k, key)) {
+                const uint32_t b = allocate(key);
+                slots[s].brick.store(b, std::memory_order_release);
+                return b == no_brick ? nullptr : pool[b].get();
+            }
+            if (k == key) {
+                uint32_t b;
+                while ((b = slots[s].brick.load(std::memory_order_acquire)) ==
+                       pending)
+                    std::this_thread::yield();
+                return b == no_brick ? nullptr : pool[b].get();
+            }
+            s = (s + 1) & mask;
+        }
+        dropped++;
+        return nullptr;
+    }
+
+    Brick* acquire(uint64_t key, BrickCache& cache) {
+        const size_t c = (key ^ (key >> 21) ^ (key >> 42)) % BrickCache::size;
+        if (cache.keys[c] != key) {
+            cache.keys[c] = key;
+            cache.bricks[c] = acquire(key);
+        }
+        return cache.bricks[c];
+    }
+
+    size_t find_slot(uint64_t key) const {
+        size_t s = hash_key(key) & mask;
+        for (size_t probes = 0; probes <= mask; probes++) {
+            const uint64_t k = slots[s].key.load(std::memory_order_relaxed);
+            if (k == key) return s;
+            if (k == empty_key) break;
+            s = (s + 1) & mask;
+        }
+        return mask + 1;
+    }
+
+    const Brick* find(uint64_t key) const {
+        const size_t s = find_slot(key);
+        if (s > mask) return nullptr;
+        const uint32_t b = slots[s].brick.load(std::memory_order_relaxed);
+        return b < pending ? pool[b].get() : nullptr;
+    }
+
+    // erase a slot between scans, shifting back the entries that follow
+    void erase_slot(size_t i) {
+        for (size_t j = (i + 1) & mask;; j = (j + 1) & mask) {
+            const uint64_t k = slots[j].key.load(std::memory_order_relaxed);
+            if (k == empty_key) break;
+            const size_t home = hash_key(k) & mask;
+            const bool stays =
+                i <= j ? (i < home && home <= j) : (i < home || home <= j);
+            if (stays) continue;
+            slots[i].key.store(k, std::memory_order_relaxed);
+            slots[i].brick.store(
+                slots[j].brick.load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+            i = j;
+        }
+        slots[i].key.store(empty_key, std::memory_order_relaxed);
+        slots[i].brick.store(pending, std::memory_order_relaxed);
+    }
+
+    // keep an eighth of the bricks free for the next scan
+    void evict() {
+        const size_t target = std::max<size_t>(1, max_bricks / 8);
+        const size_t n_free = max_bricks - used();
+        if (n_free >= target) return;
+
+        std::vector<std::pair<uint32_t, uint32_t>> ages;
+        ages.reserve(used());
+        for (size_t b = 0; b < max_bricks; b++)
+            if (pool[b] && pool[b]->key != empty_key)
+                ages.emplace_back(pool[b]->last_used, b);
+        const size_t n_evict = std::min(target - n_free, ages.size());
+        std::nth_element(ages.begin(), ages.begin() + n_evict, ages.end());
+
+        std::ptrdiff_t top = free_top;
+        for (size_t e = 0; e < n_evict; e++) {
+            Brick& brick = *pool[ages[e].second];
+            erase_slot(find_slot(brick.key));
+            brick.key = empty_key;
+            free_list[top++] = ages[e].second;
+        }
+        free_top = top;
+    }
+
+    // remove the slots of bricks that didn't fit
+    void cleanup() {
+        if (free_top < 0) free_top = 0;
+        for (size_t s = 0; s <= mask; s++) {
+            while (slots[s].key.load(std::memory_order_relaxed) != empty_key &&
+                   slots[s].brick.load(std::memory_order_relaxed) == no_brick)
+                erase_slot(s);
+        }
+    }
+};
+
+OccupancyMap::OccupancyMap(double voxel_size, size_t max_bricks,
+                           double max_range, double p_hit, double p_miss,
+                           double p_min, double p_max)
+    : impl_{new Impl{}} {
+    if (!(voxel_size > 0.0))
+        throw std::invalid_argument("voxel size must be positive");
+    if (!(max_range > 0.0))
+        throw std::invalid_argument("maximum range must be positive");
+    if (max_bricks < 8 || max_bricks >= pending)
+        throw std::invalid_argument("unsupported number of bricks");
+    if (!(p_min > 0.0 && p_min <= p_miss && p_miss <= 0.5 && 0.5 <= p_hit &&
+          p_hit <= p_max && p_max < 1.0))
+        throw std::invalid_argument("occupancy probabilities out of range");
+
+    Impl& m = *impl_;
+    m.voxel_size = voxel_size;
+    m.inv_voxel = 1.0 / voxel_size;
+    m.max_range = max_range;
+    m.hit = logit(p_hit);
+    m.miss = logit(p_miss);
+    m.min_log_odds = logit(p_min);
+    m.max_log_odds = logit(p_max);
+    m.max_bricks = max_bricks;
+    m.mask = next_pow2(2 * max_bricks) - 1;
+    m.slots.reset(new Slot[m.mask + 1]);
+    m.pool.resize(max_bricks);
+    m.free_list.resize(max_bricks);
+    m.reset();
+}
+
+OccupancyMap::~OccupancyMap() = default;
+
+void OccupancyMap::integrate(const LidarScan& scan, const XYZLut& lut,
+                             const mat4d& pose) {
+    const auto range = scan.field(sensor::ChanField::RANGE);
+    const size_t n = range.size();
+    if (static_cast<size_t>(lut.direction.rows()) != n)
+        throw std::invalid_argument("unexpected image dimensions");
+
+    Impl& m = *impl_;
+    m.evict();
+    const uint32_t scan_id = ++m.scan;
+
+    const uint32_t* rng = range.data();
+    const double* dir = lut.direction.data();
+    const double* ofs = lut.offset.data();
+    const Eigen::Matrix3d rot = pose.topLeftCorner<3, 3>();
+    const Eigen::Vector3d trans = pose.topRightCorner<3, 1>();
+    const double inv_voxel = m.inv_voxel;
+    const double max_range = m.max_range;
+    const float max_log_odds = m.max_log_odds;
+    const float min_log_odds = m.min_log_odds;
+    const float hit = m.hit;
+    const float miss = m.miss;
+    const double inf = std::numeric_limits<double>::infinity();
+
+    // beam origin and return in voxel units of the map frame; false if the
+    // return is beyond the maximum range and the end is truncated
+    auto ray = [&](size_t i, Eigen::Vector3d& a, Eigen::Vector3d& b) {
+        const double r = rng[i];
+        const Eigen::Vector3d d{dir[i], dir[n + i], dir[2 * n + i]};
+        const Eigen::Vector3d o{ofs[i], ofs[n + i], ofs[2 * n + i]};
+        const double len = r * d.norm();
+        const double t = len > max_range ? max_range / len : 1.0;
+        a = (rot * o + trans) * inv_voxel;
+        b = (rot * (o + t * r * d) + trans) * inv_voxel;
+        return t == 1.0;
+    };
+
+    // the voxels of returns are updated first, so that rays crossing them
+    // later in the same scan leave them alone
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel
+#endif
+    {
+        BrickCache cache;
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp for schedule(dynamic, 256)
+#endif
+        for (size_t i = 0; i < n; i++) {
+            if (rng[i] == 0) continue;
+            Eigen::Vector3d a, b;
+            if (!ray(i, a, b)) continue;
+            const auto x = static_cast<int32_t>(std::floor(b[0]));
+            const auto y = static_cast<int32_t>(std::floor(b[1]));
+            const auto z = static_cast<int32_t>(std::floor(b[2]));
+            Brick* brick = m.acquire(brick_key(x, y, z), cache);
+            if (!brick) continue;
+            std::lock_guard<std::mutex> lock{brick->mtx};
+            const size_t k = voxel_index(x, y, z);
+            if (brick->stamp[k] == scan_id) continue;
+            brick->stamp[k] = scan_id;
+            brick->log_odds[k] =
+                std::min(brick->log_odds[k] + hit, max_log_odds);
+            brick->last_used = scan_id;
+        }
+    }
+
+    // Amanatides-Woo traversal from the beam origin, stopping before the
+    // voxel of the return. The brick of the current voxel stays locked until
+    // the ray leaves it.
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel
+#endif
+    {
+        BrickCache cache;
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp for schedule(dynamic, 256)
+#endif
+        for (size_t i = 0; i < n; i++) {
+            if (rng[i] == 0) continue;
+            Eigen::Vector3d a, b;
+            const bool has_return = ray(i, a, b);
+
+            // the state is kept in scalars: indexing arrays by the axis
+            // makes each step wait on a store
+            int32_t v[3], step[3];
+            double t_max[3], t_delta[3];
+            int64_t n_steps = has_return ? 0 : 1;
+            for (int k = 0; k < 3; k++) {
+                v[k] = static_cast<int32_t>(std::floor(a[k]));
+                const auto end = static_cast<int32_t>(std::floor(b[k]));
+                const double d = b[k] - a[k];
+                step[k] = d > 0 ? 1 : -1;
+                t_delta[k] = d != 0 ? 1.0 / std::abs(d) : inf;
+                t_max[k] = d != 0 ? (v[k] + (d > 0) - a[k]) / d : inf;
+                n_steps += std::abs(static_cast<int64_t>(end) - v[k]);
+            }
+            int32_t x = v[0], y = v[1], z = v[2];
+            double tx = t_max[0], ty = t_max[1], tz = t_max[2];
+
+            uint64_t key = empty_key;
+            Brick* brick = nullptr;
+            std::unique_lock<std::mutex> lock;
+            for (int64_t s = 0; s < n_steps; s++) {
+                const uint64_t bk = brick_key(x, y, z);
+                if (bk != key) {
+                    if (lock) lock.unlock();
+                    key = bk;
+                    brick = m.acquire(bk, cache);
+                    if (brick) lock = std::unique_lock<std::mutex>{brick->mtx};
+                }
+                if (brick) {
+                    const size_t k = voxel_index(x, y, z);
+                    if (brick->stamp[k] != scan_id) {
+                        brick->stamp[k] = scan_id;
+                        brick->log_odds[k] =
+                            std::max(brick->log_odds[k] + miss, min_log_odds);
+                        brick->last_used = scan_id;
+                    }
+                }
+                if (tx < ty) {
+                    if (tx < tz) {
+                        x += step[0];
+                        tx += t_delta[0];
+                    } else {
+                        z += step[2];
+                        tz += t_delta[2];
+                    }
+                } else if (ty < tz) {
+                    y += step[1];
+                    ty += t_delta[1];
+                } else {
+                    z += step[2];
+                    tz += t_delta[2];
+                }
+            }
+        }
+    }
+
+    m.cleanup();
+}
+
+float OccupancyMap::log_odds(double x, double y, double z) const {
+    const Impl& m = *impl_;
+    const auto vx = static_cast<int32_t>(std::floor(x * m.inv_voxel));
+    const auto vy = static_cast<int32_t>(std::floor(y * m.inv_voxel));
+    const auto vz = static_cast<int32_t>(std::floor(z * m.inv_voxel));
+    const Brick* brick = m.find(brick_key(vx, vy, vz));
+    return brick ? brick->log_odds[voxel_index(vx, vy, vz)] : 0.0f;
+}
+
+LidarScan::Points OccupancyMap::occupied(double p_threshold) const {
+    const Impl& m = *impl_;
+    const float threshold = logit(p_threshold);
+
+    std::vector<Eigen::Vector3d> centers;
+    for (const auto& brick : m.pool) {
+        if (!brick || brick->key == empty_key) continue;
+        int32_t origin[3];
+        for (int k = 0; k < 3; k++)
+            origin[k] = brick_coord(brick->key, k) * (1 << brick_bits);
+        for (size_t j = 0; j < brick_voxels; j++) {
+            if (!(brick->log_odds[j] > threshold)) continue;
+            const auto local = static_cast<int32_t>(j);
+            const int32_t x = origin[0] + (local & brick_mask);
+            const int32_t y = origin[1] + ((local >> brick_bits) & brick_mask);
+            const int32_t z = origin[2] + (local >> (2 * brick_bits));
+            centers.emplace_back((x + 0.5) * m.voxel_size,
+                                 (y + 0.5) * m.voxel_size,
+                                 (z + 0.5) * m.voxel_size);
+        }
+    }
+
+    LidarScan::Points out(centers.size(), 3);
+    for (size_t j = 0; j < centers.size(); j++) out.row(j) = centers[j];
+    return out;
+}
+
+size_t OccupancyMap::bricks() const { return impl_->used(); }
+
+size_t OccupancyMap::dropped() const { return impl_->dropped; }
+
+void OccupancyMap::clear() {
+    impl_->reset();
+    impl_->dropped = 0;
+    for (auto& brick : impl_->pool) brick.reset();
+}
+
+}  // namespace ouster
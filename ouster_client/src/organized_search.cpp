@@ -0,0 +1,248 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/organized_search.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace ouster {
+
+namespace {
+
+constexpr float nan = std::numeric_limits<float>::quiet_NaN();
+
+// columns per batch of distance evaluations
+constexpr std::ptrdiff_t batch = 64;
+
+bool closer(const OrganizedSearch::Neighbor& a,
+            const OrganizedSearch::Neighbor& b) {
+    return a.sq_dist < b.sq_dist;
+}
+
+}  // namespace
+
+OrganizedSearch::OrganizedSearch(const sensor::sensor_info& info,
+                                 int max_window)
+    : w_{static_cast<std::ptrdiff_t>(info.format.columns_per_frame)},
+      h_{static_cast<std::ptrdiff_t>(info.format.pixels_per_column)},
+      max_window_{std::max(max_window, 1)},
+      x_{img_t<float>::Constant(h_, w_, nan)},
+      y_{img_t<float>::Constant(h_, w_, nan)},
+      z_{img_t<float>::Constant(h_, w_, nan)},
+      index_(h_, w_) {
+    const auto& shift = info.format.pixel_shift_by_row;
+    const auto& altitude = info.beam_altitude_angles;
+    if (static_cast<std::ptrdiff_t>(shift.size()) != h_ ||
+        static_cast<std::ptrdiff_t>(altitude.size()) != h_)
+        throw std::invalid_argument("unexpected scan dimensions");
+
+    const int iw = static_cast<int>(w_);
+    shift_.resize(h_);
+    for (std::ptrdiff_t u = 0; u < h_; u++) {
+        shift_[u] = (shift[u] % iw + iw) % iw;
+        for (std::ptrdiff_t v = 0; v < w_; v++)
+            index_(u, (v + shift_[u]) % w_) =
+                static_cast<uint32_t>(u * w_ + v);
+    }
+
+    // the smallest gap between beams keeps the window conservative when beams
+    // are not evenly spaced
+    az_res_ = static_cast<float>(2.0 * M_PI / w_);
+    std::vector<double> sorted(altitude);
+    std::sort(sorted.begin(), sorted.end());
+    double el_res = 0.0;
+    for (size_t i = 1; i < sorted.size(); i++) {
+        const double d = sorted[i] - sorted[i - 1];
+        if (d > 0.0 && (el_res == 0.0 || d < el_res)) el_res = d;
+    }
+    el_res_ = el_res > 0.0 ? static_cast<float>(el_res * M_PI / 180.0)
+                           : az_res_;
+}
+
+void OrganizedSearch::set_input(const LidarScan& scan, const XYZLut& lut) {
+    const auto range = scan.field(sensor::ChanField::RANGE);
+    if (range.rows() != h_ || range.cols() != w_ ||
+        lut.direction.rows() != range.size())
+        throw std::invalid_argument("unexpected image dimensions");
+
+    const std::ptrdiff_t n = range.size();
+    const uint32_t* rng = range.data();
+    const double* dir = lut.direction.data();
+    const double* ofs = lut.offset.data();
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel for schedule(static)
+#endif
+    for (std::ptrdiff_t u = 0; u < h_; u++) {
+        for (std::ptrdiff_t v = 0; v < w_; v++) {
+            const std::ptrdiff_t i = u * w_ + v;
+            const std::ptrdiff_t c = (v + shift_[u]) % w_;
+            const double r = rng[i];
+            if (r == 0) {
+                x_(u, c) = y_(u, c) = z_(u, c) = nan;
+                continue;
+            }
+            x_(u, c) = static_cast<float>(r * dir[i] + ofs[i]);
+            y_(u, c) = static_cast<float>(r * dir[n + i] + ofs[n + i]);
+            z_(u, c) = static_cast<float>(r * dir[2 * n + i] + ofs[2 * n + i]);
+        }
+    }
+}
+
+void OrganizedSearch::set_input(const LidarScan::Points& points) {
+    if (points.rows() != w_ * h_)
+        throw std::invalid_argument("unexpected number of points");
+
+    const std::ptrdiff_t n = points.rows();
+    const double* p = points.data();
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel for schedule(static)
+#endif
+    for (std::ptrdiff_t u = 0; u < h_; u++) {
+        for (std::ptrdiff_t v = 0; v < w_; v++) {
+            const std::ptrdiff_t i = u * w_ + v;
+            const std::ptrdiff_t c = (v + shift_[u]) % w_;
+            const double x = p[i], y = p[n + i], z = p[2 * n + i];
+            const bool valid = x != 0.0 || y != 0.0 || z != 0.0;
+            x_(u, c) = valid ? static_cast<float>(x) : nan;
+            y_(u, c) = valid ? static_cast<float>(y) : nan;
+            z_(u, c) = valid ? static_cast<float>(z) : nan;
+        }
+    }
+}
+
+void OrganizedSearch::probe(std::ptrdiff_t u, std::ptrdiff_t c,
+                            std::ptrdiff_t du, std::ptrdiff_t dc,
+                            const Eigen::Vector3f& q, float sq_radius,
+                            std::vector<Neighbor>& out) const {
+    using Segment = Eigen::Map<const Eigen::ArrayXf>;
+
+    // column range, split in at most two contiguous spans at the wrap around
+    std::ptrdiff_t spans[2][2];
+    int n_spans = 1;
+    if (2 * dc + 1 >= w_) {
+        spans[0][0] = 0;
+        spans[0][1] = w_;
+    } else if (c - dc < 0) {
+        spans[0][0] = 0;
+        spans[0][1] = c + dc + 1;
+        spans[1][0] = c - dc + w_;
+        spans[1][1] = w_;
+        n_spans = 2;
+    } else if (c + dc >= w_) {
+        spans[0][0] = c - dc;
+        spans[0][1] = w_;
+        spans[1][0] = 0;
+        spans[1][1] = c + dc + 1 - w_;
+        n_spans = 2;
+    } else {
+        spans[0][0] = c - dc;
+        spans[0][1] = c + dc + 1;
+    }
+
+    Eigen::Array<float, batch, 1> d2;
+    const std::ptrdiff_t u0 = std::max<std::ptrdiff_t>(u - du, 0);
+    const std::ptrdiff_t u1 = std::min<std::ptrdiff_t>(u + du, h_ - 1);
+    for (std::ptrdiff_t r = u0; r <= u1; r++) {
+        for (int s = 0; s < n_spans; s++) {
+            for (std::ptrdiff_t b = spans[s][0]; b < spans[s][1]; b += batch) {
+                const std::ptrdiff_t m = std::min(batch, spans[s][1] - b);
+                const std::ptrdiff_t i = r * w_ + b;
+
+                // contiguous, branch-free and vectorized by Eigen; invalid
+                // pixels are NaN and never compare within the radius
+                d2.head(m) = (Segment(x_.data() + i, m) - q[0]).square() +
+                             (Segment(y_.data() + i, m) - q[1]).square() +
+                             (Segment(z_.data() + i, m) - q[2]).square();
+
+                for (std::ptrdiff_t j = 0; j < m; j++) {
+                    if (d2[j] <= sq_radius)
+                        out.push_back({index_(r, b + j), d2[j]});
+                }
+            }
+        }
+    }
+}
+
+void OrganizedSearch::search(std::ptrdiff_t u, std::ptrdiff_t c,
+                             const Eigen::Vector3f& q, float radius,
+                             std::vector<Neighbor>& out) const {
+    // every point within radius of q subtends at most this angle, seen from
+    // the sensor origin
+    const float range = q.norm();
+    const float angle = radius < range ? std::asin(radius / range)
+                                       : static_cast<float>(M_PI);
+
+    // azimuth differences grow by 1 / cos(elevation) away from the horizon
+    const float max_el = std::abs(std::asin(q[2] / range)) + angle;
+    const float az_angle = max_el < 1.5f ? angle / std::cos(max_el)
+                                         : static_cast<float>(M_PI);
+
+    const auto half = [&](float a, float res) {
+        return std::min<std::ptrdiff_t>(
+            static_cast<std::ptrdiff_t>(std::ceil(a / res)) + 1, max_window_);
+    };
+    probe(u, c, half(angle, el_res_), half(az_angle, az_res_), q,
+          radius * radius, out);
+}
+
+size_t OrganizedSearch::radius_search(uint32_t pixel, float radius,
+                                      std::vector<Neighbor>& out) const {
+    out.clear();
+    if (pixel >= static_cast<uint32_t>(w_ * h_)) return 0;
+    const std::ptrdiff_t u = pixel / w_;
+    const std::ptrdiff_t c = (pixel % w_ + shift_[u]) % w_;
+    const Eigen::Vector3f q{x_(u, c), y_(u, c), z_(u, c)};
+    if (std::isnan(q[0])) return 0;
+
+    search(u, c, q, radius, out);
+    return out.size();
+}
+
+size_t OrganizedSearch::knn_search(uint32_t pixel, size_t k,
+                                   std::vector<Neighbor>& out,
+                                   float max_radius) const {
+    out.clear();
+    if (k == 0 || pixel >= static_cast<uint32_t>(w_ * h_)) return 0;
+    const std::ptrdiff_t u = pixel / w_;
+    const std::ptrdiff_t c = (pixel % w_ + shift_[u]) % w_;
+    const Eigen::Vector3f q{x_(u, c), y_(u, c), z_(u, c)};
+    if (std::isnan(q[0])) return 0;
+
+    // start from the distance between adjacent pixels at the query range
+    const float spacing = q.norm() * std::max(az_res_, el_res_);
+    float radius = std::min(std::max(spacing, 0.01f), max_radius);
+    for (;;) {
+        out.clear();
+        search(u, c, q, radius, out);
+
+        // all points within the radius were found, so once there are k of
+        // them they are the k nearest
+        if (out.size() >= k || radius >= max_radius) break;
+        radius = std::min(2.0f * radius, max_radius);
+    }
+
+    if (out.size() > k) {
+        std::nth_element(out.begin(), out.begin() + k, out.end(), closer);
+        out.resize(k);
+    }
+    std::sort(out.begin(), out.end(), closer);
+    return out.size();
+}
+
+Eigen::Vector3f OrganizedSearch::point(uint32_t pixel) const {
+    if (pixel >= static_cast<uint32_t>(w_ * h_))
+        return Eigen::Vector3f::Zero();
+    const std::ptrdiff_t u = pixel / w_;
+    const std::ptrdiff_t c = (pixel % w_ + shift_[u]) % w_;
+    if (std::isnan(x_(u, c))) return Eigen::Vector3f::Zero();
+    return {x_(u, c), y_(u, c), z_(u, c)};
+}
+
+}  // namespace ouster
@@ -0,0 +1,196 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/packet_scan.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "ouster_client/impl/lidar_scan_impl.h"
+
+namespace ouster {
+
+using sensor::ChanField;
+using sensor::ChanFieldType;
+
+namespace {
+
+// decode a field from all packets of a frame; columns of missing packets and
+// invalid columns are zeroed
+struct decode_field {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> field, ChanField f,
+                    const sensor::packet_format& pf, const uint8_t* packets,
+                    const uint8_t* received, std::ptrdiff_t n_packets) {
+        const std::ptrdiff_t w = field.cols();
+        const std::ptrdiff_t cpp = pf.columns_per_packet;
+        const std::ptrdiff_t size = pf.lidar_packet_size;
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel for schedule(static)
+#endif
+        for (std::ptrdiff_t p = 0; p < n_packets; p++) {
+            const std::ptrdiff_t v0 = p * cpp;
+            const std::ptrdiff_t v1 = std::min(w, v0 + cpp);
+            if (!received[p]) {
+                field.block(0, v0, field.rows(), v1 - v0).setZero();
+                continue;
+            }
+            const uint8_t* packet_buf = packets + p * size;
+            for (int icol = 0; icol < cpp; icol++) {
+                const uint8_t* col_buf = pf.nth_col(icol, packet_buf);
+                const uint16_t m_id = pf.col_measurement_id(col_buf);
+                if (m_id < v0 || m_id >= v1) continue;
+                if (pf.col_status(col_buf) & 0x01)
+                    pf.col_field(col_buf, f, field.col(m_id).data(),
+                                 field.cols());
+                else
+                    field.col(m_id).setZero();
+            }
+        }
+    }
+};
+
+}  // namespace
+
+PacketScan::PacketScan(const sensor::sensor_info& info)
+    : pf_(sensor::get_format(info)),
+      w_(info.format.columns_per_frame),
+      h_(info.format.pixels_per_column),
+      n_packets_((w_ + pf_.columns_per_packet - 1) / pf_.columns_per_packet),
+      packets_(n_packets_ * pf_.lidar_packet_size),
+      received_(n_packets_, 0),
+      scan_(w_, h_, info.format.udp_profile_lidar) {}
+
+size_t PacketScan::packet_count() const {
+    return std::count(received_.begin(), received_.end(), 1);
+}
+
+bool PacketScan::complete() const {
+    return packet_count() == static_cast<size_t>(n_packets_);
+}
+
+bool PacketScan::add(const uint8_t* packet_buf) {
+    const uint16_t f_id = pf_.frame_id(packet_buf);
+    if (frame_id_ == -1) {
+        frame_id_ = f_id;
+        frame_status_ = impl::frame_status(pf_.thermal_shutdown(packet_buf),
+                                           pf_.shot_limiting(packet_buf));
+    } else if (frame_id_ == static_cast<uint16_t>(f_id + 1)) {
+        // drop reordered packets from the previous frame, as ScanBatcher does
+        return true;
+    } else if (frame_id_ != f_id) {
+        return false;
+    }
+
+    // drop out-of-bounds data in case of misconfiguration
+    const uint16_t m_id = pf_.col_measurement_id(pf_.nth_col(0, packet_buf));
+    const std::ptrdiff_t p = m_id / pf_.columns_per_packet;
+    if (m_id >= w_ || p >= n_packets_) return true;
+
+    std::memcpy(packets_.data() + p * pf_.lidar_packet_size, packet_buf,
+                pf_.lidar_packet_size);
+    received_[p] = 1;
+
+    std::lock_guard<std::mutex> guard{decode_mx_};
+    decoded_.reset();
+    headers_decoded_ = false;
+    return true;
+}
+
+void PacketScan::clear() {
+    std::fill(received_.begin(), received_.end(), 0);
+    frame_id_ = -1;
+    frame_status_ = 0;
+
+    std::lock_guard<std::mutex> guard{decode_mx_};
+    decoded_.reset();
+    headers_decoded_ = false;
+}
+
+ChanFieldType PacketScan::field_type(ChanField f) const {
+    return scan_.field_type(f);
+}
+
+void PacketScan::decode(ChanField f) const {
+    if (scan_.field_type(f) == ChanFieldType::VOID)
+        throw std::invalid_argument("no field " + sensor::to_string(f) +
+                                    " in the packet profile");
+
+    std::lock_guard<std::mutex> guard{decode_mx_};
+    const auto i = static_cast<size_t>(f);
+    if (decoded_[i]) return;
+    impl::visit_field(scan_, f, decode_field(), f, pf_, packets_.data(),
+                      received_.data(), n_packets_);
+    decoded_[i] = true;
+}
+
+void PacketScan::decode_headers() const {
+    std::lock_guard<std::mutex> guard{decode_mx_};
+    if (headers_decoded_) return;
+
+    const std::ptrdiff_t cpp = pf_.columns_per_packet;
+    auto ts = scan_.timestamp();
+    auto m_ids = scan_.measurement_id();
+    auto status = scan_.status();
+    ts.setZero();
+    m_ids.setZero();
+    status.setZero();
+    for (std::ptrdiff_t p = 0; p < n_packets_; p++) {
+        if (!received_[p]) continue;
+        const uint8_t* packet_buf = packets_.data() + p * pf_.lidar_packet_size;
+        for (int icol = 0; icol < cpp; icol++) {
+            const uint8_t* col_buf = pf_.nth_col(icol, packet_buf);
+            const uint16_t m_id = pf_.col_measurement_id(col_buf);
+            const uint32_t s = pf_.col_status(col_buf);
+            if (m_id >= w_ || !(s & 0x01)) continue;
+            ts[m_id] = pf_.col_timestamp(col_buf);
+            m_ids[m_id] = m_id;
+            status[m_id] = s;
+        }
+    }
+    headers_decoded_ = true;
+}
+
+template <typename T>
+Eigen::Ref<const img_t<T>> PacketScan::field(ChanField f) const {
+    decode(f);
+    return static_cast<const LidarScan&>(scan_).field<T>(f);
+}
+
+// explicitly instantiate for each supported field type
+template Eigen::Ref<const img_t<uint8_t>> PacketScan::field(ChanField f) const;
+template Eigen::Ref<const img_t<uint16_t>> PacketScan::field(ChanField f) const;
+template Eigen::Ref<const img_t<uint32_t>> PacketScan::field(ChanField f) const;
+template Eigen::Ref<const img_t<uint64_t>> PacketScan::field(ChanField f) const;
+
+Eigen::Ref<const LidarScan::Header<uint64_t>> PacketScan::timestamp() const {
+    decode_headers();
+    return static_cast<const LidarScan&>(scan_).timestamp();
+}
+
+Eigen::Ref<const LidarScan::Header<uint16_t>> PacketScan::measurement_id()
+    const {
+    decode_headers();
+    return static_cast<const LidarScan&>(scan_).measurement_id();
+}
+
+Eigen::Ref<const LidarScan::Header<uint32_t>> PacketScan::status() const {
+    decode_headers();
+    return static_cast<const LidarScan&>(scan_).status();
+}
+
+const LidarScan& PacketScan::scan() const {
+    for (const auto& ft : scan_) decode(ft.first);
+    decode_headers();
+
+    std::lock_guard<std::mutex> guard{decode_mx_};
+    scan_.frame_id = frame_id_;
+    scan_.frame_status = frame_status_;
+    return scan_;
+}
+
+}  // namespace ouster
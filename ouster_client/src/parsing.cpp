@@ -5,11 +5,12 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <map>
-#include <mutex>
+#include <memory>
 #include <stdexcept>
 #include <type_traits>
 #include <utility>
@@ -502,20 +503,58 @@ float packet_format::imu_av_z(const uint8_t* imu_buf) const {
     return res;
 }
 
-const packet_format& get_format(const sensor_info& info) {
-    using key = std::tuple<int, int, UDPProfileLidar>;
-    static std::map<key, std::unique_ptr<packet_format>> cache{};
-    static std::mutex cache_mx{};
+namespace {
+
+/*
+ * Packet formats are interned in an append-only list, so that lookups only
+ * read an atomic pointer and immutable entries. Entries are never removed and
+ * references to them stay valid for the life of the process.
+ */
+struct InternedFormat {
+    uint32_t pixels_per_column;
+    uint32_t columns_per_packet;
+    UDPProfileLidar udp_profile_lidar;
+    packet_format pf;
+    const InternedFormat* next;
+
+    InternedFormat(const sensor_info& info, const InternedFormat* next)
+        : pixels_per_column{info.format.pixels_per_column},
+          columns_per_packet{info.format.columns_per_packet},
+          udp_profile_lidar{info.format.udp_profile_lidar},
+          pf{info},
+          next{next} {}
+};
 
-    key k{info.format.pixels_per_column, info.format.columns_per_packet,
-          info.format.udp_profile_lidar};
+std::atomic<const InternedFormat*> interned_formats{nullptr};
 
-    std::lock_guard<std::mutex> lk{cache_mx};
-    if (!cache.count(k)) {
-        cache[k] = std::make_unique<packet_format>(info);
+const packet_format* find_format(const InternedFormat* head,
+                                 const sensor_info& info) {
+    for (const InternedFormat* e = head; e; e = e->next) {
+        if (e->pixels_per_column == info.format.pixels_per_column &&
+            e->columns_per_packet == info.format.columns_per_packet &&
+            e->udp_profile_lidar == info.format.udp_profile_lidar)
+            return &e->pf;
     }
+    return nullptr;
+}
+
+}  // namespace
 
-    return *cache.at(k);
+const packet_format& get_format(const sensor_info& info) {
+    const InternedFormat* head =
+        interned_formats.load(std::memory_order_acquire);
+    if (const packet_format* pf = find_format(head, info)) return *pf;
+
+    // publish a new entry, unless another thread interned the same format
+    // meanwhile
+    auto entry = std::make_unique<InternedFormat>(info, head);
+    while (!interned_formats.compare_exchange_weak(
+        entry->next, entry.get(), std::memory_order_release,
+        std::memory_order_acquire)) {
+        if (const packet_format* pf = find_format(entry->next, info))
+            return *pf;
+    }
+    return entry.release()->pf;
 }
 
 }  // namespace sensor
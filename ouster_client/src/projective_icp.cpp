@@ -0,0 +1,500 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/projective_icp.h"
+
+#include <Eigen/Cholesky>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace ouster {
+
+namespace {
+
+// source points per block
+constexpr std::ptrdiff_t block = 256;
+
+// accumulator lanes; a multiple of the vector width
+constexpr std::ptrdiff_t lanes = 8;
+
+// normal equations: 21 entries of the upper triangle of J^T W J, 6 of
+// J^T W r, then the sum of squared residuals and the number of inliers
+constexpr int n_sums = 29;
+
+// neighbours farther from each other than this times the range are taken to
+// lie across a depth discontinuity
+constexpr float max_depth_change = 0.1f;
+
+constexpr float pi = static_cast<float>(M_PI);
+
+// atan2 within 1e-5 radians, much cheaper than std::atan2; quadrants are
+// applied in arithmetic, as selects keep loops calling it from vectorizing
+inline float fast_atan2(float y, float x) {
+    const float ax = std::abs(x);
+    const float ay = std::abs(y);
+    const float a = std::min(ax, ay) /
+                    std::max({ax, ay, std::numeric_limits<float>::min()});
+    const float s = a * a;
+    float r = ((((-0.01172120f * s + 0.05265332f) * s - 0.11643287f) * s +
+                0.19354346f) *
+                   s -
+               0.33262347f) *
+                  s * a +
+              0.99997726f * a;
+    const auto steep = static_cast<float>(ay > ax);
+    const auto left = static_cast<float>(x < 0.0f);
+    const auto below = static_cast<float>(y < 0.0f);
+    r += steep * (0.5f * pi - 2.0f * r);
+    r += left * (pi - 2.0f * r);
+    return r - below * 2.0f * r;
+}
+
+}  // namespace
+
+ProjectiveIcp::ProjectiveIcp(const sensor::sensor_info& info, int levels,
+                             int max_iterations, int max_fine_iterations,
+                             double max_distance, double robust_scale)
+    : w_{static_cast<std::ptrdiff_t>(info.format.columns_per_frame)},
+      h_{static_cast<std::ptrdiff_t>(info.format.pixels_per_column)},
+      levels_{levels},
+      max_iterations_{max_iterations},
+      max_fine_iterations_{max_fine_iterations},
+      max_distance_{static_cast<float>(max_distance)},
+      robust_scale_{static_cast<float>(robust_scale)} {
+    const auto& shift = info.format.pixel_shift_by_row;
+    const auto& altitude = info.beam_altitude_angles;
+    const auto& azimuth = info.beam_azimuth_angles;
+    if (static_cast<std::ptrdiff_t>(shift.size()) != h_ ||
+        static_cast<std::ptrdiff_t>(altitude.size()) != h_ ||
+        static_cast<std::ptrdiff_t>(azimuth.size()) != h_)
+        throw std::invalid_argument("unexpected scan dimensions");
+    if (levels < 1 || max_iterations < 1 || max_fine_iterations < 1)
+        throw std::invalid_argument("ICP iterations must be positive");
+    if (!(max_distance > 0.0 && robust_scale > 0.0))
+        throw std::invalid_argument("ICP distances must be positive");
+
+    const int iw = static_cast<int>(w_);
+    shift_.resize(h_);
+    std::vector<float> col_offset(h_);
+    for (std::ptrdiff_t u = 0; u < h_; u++) {
+        shift_[u] = (shift[u] % iw + iw) % iw;
+        // the lut points column v at an encoder angle of 2 pi (1 - v / w)
+        // rotated by minus the beam azimuth
+        col_offset[u] =
+            static_cast<float>(shift_[u] - azimuth[u] * w_ / 360.0);
+    }
+
+    // the lut maps ranges to meters in the sensor frame
+    const mat4d& to_sensor = info.lidar_to_sensor_transform;
+    const Eigen::Matrix3d rot = to_sensor.topLeftCorner<3, 3>().transpose();
+    to_lidar_rot_ = rot.cast<float>();
+    to_lidar_trans_ = (-rot * to_sensor.topRightCorner<3, 1>() *
+                       sensor::range_unit)
+                          .cast<float>();
+    beam_radius_ = static_cast<float>(info.beam_to_lidar_transform(0, 3) *
+                                      sensor::range_unit);
+    beam_height_ = static_cast<float>(info.beam_to_lidar_transform(2, 3) *
+                                      sensor::range_unit);
+
+    // nearest row by elevation, in bins of an eighth of the smallest gap
+    // between beams, extending half a gap beyond the outermost beams
+    std::vector<double> sorted(altitude);
+    std::sort(sorted.begin(), sorted.end());
+    double gap = 0.0, max_gap = 0.0;
+    for (size_t i = 1; i < sorted.size(); i++) {
+        const double d = sorted[i] - sorted[i - 1];
+        if (d > 0.0 && (gap == 0.0 || d < gap)) gap = d;
+        max_gap = std::max(max_gap, d);
+    }
+    if (gap == 0.0) gap = max_gap = 360.0 / w_;
+    const double bin = gap / 8.0;
+    const double lo = sorted.front() - max_gap / 2.0;
+    const double hi = sorted.back() + max_gap / 2.0;
+    const auto n_bins = static_cast<size_t>(std::ceil((hi - lo) / bin));
+    el_min_ = static_cast<float>(lo * M_PI / 180.0);
+    inv_el_bin_ = static_cast<float>(180.0 / (M_PI * bin));
+
+    // coarse levels keep every s-th row and column; their columns are
+    // positions in the finest image divided by s
+    pyramid_.resize(levels_);
+    for (int l = 0; l < levels_; l++) {
+        const std::ptrdiff_t s = std::ptrdiff_t{1} << l;
+        Level& lvl = pyramid_[l];
+        lvl.w = (w_ + s - 1) / s;
+        lvl.h = (h_ + s - 1) / s;
+        lvl.inv_az_res = static_cast<float>(w_ / (2.0 * M_PI * s));
+        lvl.col_offset.resize(lvl.h);
+        for (std::ptrdiff_t u = 0; u < lvl.h; u++)
+            lvl.col_offset[u] = col_offset[u * s] / s;
+        lvl.el_rows.resize(n_bins);
+        for (size_t b = 0; b < n_bins; b++) {
+            const double el = lo + (b + 0.5) * bin;
+            std::ptrdiff_t best = 0;
+            for (std::ptrdiff_t u = s; u < h_; u += s)
+                if (std::abs(altitude[u] - el) < std::abs(altitude[best] - el))
+                    best = u;
+            const bool outside = (el < sorted.front() - gap / 2.0) ||
+                                 (el > sorted.back() + gap / 2.0);
+            lvl.el_rows[b] = outside ? -1 : static_cast<int16_t>(best / s);
+        }
+        lvl.target.resize(lvl.w * lvl.h);
+    }
+    points_.resize(w_ * h_);
+}
+
+void ProjectiveIcp::load(const LidarScan& scan, const XYZLut& lut) {
+    const auto range = scan.field(sensor::ChanField::RANGE);
+    if (range.rows() != h_ || range.cols() != w_ ||
+        lut.direction.rows() != range.size())
+        throw std::invalid_argument("unexpected image dimensions");
+
+    const std::ptrdiff_t n = range.size();
+    const uint32_t* rng = range.data();
+    const double* dir = lut.direction.data();
+    const double* ofs = lut.offset.data();
+    Eigen::Vector3f* out = points_.data();
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel for schedule(static)
+#endif
+    for (std::ptrdiff_t i = 0; i < n; i++) {
+        const double r = rng[i];
+        if (r == 0) {
+            out[i].setZero();
+            continue;
+        }
+        out[i] = Eigen::Vector3d{r * dir[i] + ofs[i],
+                                 r * dir[n + i] + ofs[n + i],
+                                 r * dir[2 * n + i] + ofs[2 * n + i]}
+                     .cast<float>();
+    }
+}
+
+void ProjectiveIcp::load(const LidarScan::Points& points) {
+    if (points.rows() != w_ * h_)
+        throw std::invalid_argument("unexpected image dimensions");
+    const std::ptrdiff_t n = points.rows();
+    for (std::ptrdiff_t i = 0; i < n; i++)
+        points_[i] = points.row(i).transpose().cast<float>();
+}
+
+void ProjectiveIcp::update_target() {
+    // destagger into the finest target image
+    Level& fine = pyramid_[0];
+    for (std::ptrdiff_t u = 0; u < h_; u++) {
+        for (std::ptrdiff_t v = 0; v < w_; v++) {
+            const Eigen::Vector3f& p = points_[u * w_ + v];
+            TargetPoint& t = fine.target[u * w_ + (v + shift_[u]) % w_];
+            t = {p.x(), p.y(), p.z(), 0.0f, 0.0f, 0.0f};
+        }
+    }
+    for (int l = 1; l < levels_; l++) {
+        const std::ptrdiff_t s = std::ptrdiff_t{1} << l;
+        Level& lvl = pyramid_[l];
+        for (std::ptrdiff_t u = 0; u < lvl.h; u++)
+            for (std::ptrdiff_t c = 0; c < lvl.w; c++)
+                lvl.target[u * lvl.w + c] = fine.target[u * s * w_ + c * s];
+    }
+
+    auto valid = [](const TargetPoint& t) {
+        return t.x != 0.0f || t.y != 0.0f || t.z != 0.0f;
+    };
+    auto pos = [](const TargetPoint& t) {
+        return Eigen::Vector3f{t.x, t.y, t.z};
+    };
+
+    for (int l = levels_ - 1; l >= 0; l--) {
+        Level& lvl = pyramid_[l];
+        const std::ptrdiff_t w = lvl.w;
+        const std::ptrdiff_t h = lvl.h;
+        TargetPoint* target = lvl.target.data();
+        // neighbours of coarse levels are farther apart
+        const float max_change = max_depth_change * static_cast<float>(1 << l);
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel for schedule(static)
+#endif
+        for (std::ptrdiff_t u = 1; u < h - 1; u++) {
+            for (std::ptrdiff_t c = 0; c < w; c++) {
+                TargetPoint& t = target[u * w + c];
+                const TargetPoint& left = target[u * w + (c + w - 1) % w];
+                const TargetPoint& right = target[u * w + (c + 1) % w];
+                const TargetPoint& up = target[(u - 1) * w + c];
+                const TargetPoint& down = target[(u + 1) * w + c];
+                if (!(valid(t) && valid(left) && valid(right) && valid(up) &&
+                      valid(down)))
+                    continue;
+
+                const Eigen::Vector3f p = pos(t);
+                const Eigen::Vector3f dx = pos(right) - pos(left);
+                const Eigen::Vector3f dy = pos(down) - pos(up);
+                const float limit = max_change * p.norm();
+                if (dx.squaredNorm() > limit * limit ||
+                    dy.squaredNorm() > limit * limit)
+                    continue;
+
+                Eigen::Vector3f nrm = dx.cross(dy);
+                const float len = nrm.norm();
+                if (!(len > 0.0f)) continue;
+                nrm /= nrm.dot(p) > 0.0f ? -len : len;
+                t.nx = nrm.x();
+                t.ny = nrm.y();
+                t.nz = nrm.z();
+            }
+        }
+    }
+    has_target_ = true;
+}
+
+IcpResult ProjectiveIcp::update_source(const mat4d& guess) {
+    if (!has_target_) throw std::logic_error("no ICP target set");
+
+    for (int l = 0; l < levels_; l++) {
+        const std::ptrdiff_t s = std::ptrdiff_t{1} << l;
+        auto& src = pyramid_[l].source;
+        for (auto& x : src) x.clear();
+        for (std::ptrdiff_t u = 0; u < h_; u += s)
+            for (std::ptrdiff_t v = 0; v < w_; v += s) {
+                const Eigen::Vector3f& p = points_[u * w_ + v];
+                if (p.isZero()) continue;
+                for (int k = 0; k < 3; k++) src[k].push_back(p[k]);
+            }
+    }
+
+    const auto n_bins = static_cast<float>(pyramid_[0].el_rows.size());
+    const Eigen::Matrix3f to_lidar_rot = to_lidar_rot_;
+    const Eigen::Vector3f to_lidar_trans = to_lidar_trans_;
+    const float beam_radius = beam_radius_, beam_height = beam_height_;
+    const float el_min = el_min_, inv_el_bin = inv_el_bin_;
+    const float inv_sq_scale = 1.0f / (robust_scale_ * robust_scale_);
+
+    IcpResult result{guess, 0, 0.0, 0, false};
+    Eigen::Matrix4d pose = guess;
+
+    for (int l = levels_ - 1; l >= 0; l--) {
+        const Level& lvl = pyramid_[l];
+        const std::ptrdiff_t w = lvl.w;
+        const TargetPoint* target = lvl.target.data();
+        const float* col_offset = lvl.col_offset.data();
+        const int16_t* el_rows = lvl.el_rows.data();
+        const float inv_az_res = lvl.inv_az_res;
+        const float* sx = lvl.source[0].data();
+        const float* sy = lvl.source[1].data();
+        const float* sz = lvl.source[2].data();
+        const auto n = static_cast<std::ptrdiff_t>(lvl.source[0].size());
+        const float gate = max_distance_ * static_cast<float>(1 << l);
+        const float sq_gate = gate * gate;
+        const int iterations = l == 0 ? max_fine_iterations_ : max_iterations_;
+        result.converged = false;
+
+        for (int it = 0; it < iterations; it++) {
+            const Eigen::Matrix3f rot =
+                pose.topLeftCorner<3, 3>().cast<float>();
+            const Eigen::Vector3f trans =
+                pose.topRightCorner<3, 1>().cast<float>();
+            // source to lidar frame of the target, for the projection
+            const Eigen::Matrix3f proj_rot = to_lidar_rot * rot;
+            const Eigen::Vector3f proj_trans =
+                to_lidar_rot * trans + to_lidar_trans;
+
+            double sums[n_sums] = {};
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel
+#endif
+            {
+                // projection of each point of a block, its elevation bin and
+                // column, then its target point, jacobian, residual and weight
+                float q[3][block], rho[block], col_pos[block];
+                int32_t bin[block], valid[block];
+                float tgt[6][block];
+                float jac[6][block], res[block], wt[block], inl[block];
+                double local[n_sums] = {};
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp for schedule(static) nowait
+#endif
+                for (std::ptrdiff_t b = 0; b < n; b += block) {
+                    const std::ptrdiff_t len =
+                        std::min<std::ptrdiff_t>(block, n - b);
+
+                    // project into the target image; the square root goes
+                    // through Eigen: std::sqrt sets errno, which keeps loops
+                    // scalar
+                    for (std::ptrdiff_t j = 0; j < len; j++) {
+                        const Eigen::Vector3f p{sx[b + j], sy[b + j],
+                                                sz[b + j]};
+                        const Eigen::Vector3f pq = proj_rot * p + proj_trans;
+                        q[0][j] = pq.x();
+                        q[1][j] = pq.y();
+                        q[2][j] = pq.z();
+                        rho[j] = pq.x() * pq.x() + pq.y() * pq.y();
+                    }
+                    Eigen::Map<Eigen::ArrayXf> rho_map(rho, len);
+                    rho_map = rho_map.sqrt() - beam_radius;
+                    for (std::ptrdiff_t j = 0; j < len; j++) {
+                        const float el =
+                            fast_atan2(q[2][j] - beam_height, rho[j]);
+                        const float az = fast_atan2(q[1][j], q[0][j]);
+                        const float bin_pos = (el - el_min) * inv_el_bin;
+                        // bin 0 where the point is behind the beam origin or
+                        // outside of the bins
+                        const int32_t ok =
+                            static_cast<int32_t>(rho[j] > 0.0f) &
+                            static_cast<int32_t>(bin_pos >= 0.0f) &
+                            static_cast<int32_t>(bin_pos < n_bins);
+                        bin[j] = static_cast<int32_t>(bin_pos *
+                                                      static_cast<float>(ok));
+                        valid[j] = ok;
+                        col_pos[j] = (2.0f * pi - az) * inv_az_res + 0.5f;
+                    }
+
+                    // look up the target points, zeroed where there are none;
+                    // without branches, as misses are unpredictable. Column
+                    // positions lie in [0, 3w): azimuths in (-pi, pi] put
+                    // them in [w / 2, 3w / 2), offsets in (-w / 2, w)
+                    for (std::ptrdiff_t j = 0; j < len; j++) {
+                        const int16_t row = el_rows[bin[j]];
+                        const int32_t ok = valid[j] & (row >= 0);
+                        const std::ptrdiff_t u = row * ok;
+                        auto c = static_cast<std::ptrdiff_t>(col_pos[j] +
+                                                             col_offset[u]);
+                        c -= w * (c >= w);
+                        c -= w * (c >= w);
+                        const TargetPoint& t = target[u * w + c];
+                        const auto m = static_cast<float>(ok);
+                        tgt[0][j] = t.x * m;
+                        tgt[1][j] = t.y * m;
+                        tgt[2][j] = t.z * m;
+                        tgt[3][j] = t.nx * m;
+                        tgt[4][j] = t.ny * m;
+                        tgt[5][j] = t.nz * m;
+                    }
+
+                    // point-to-plane residuals; zero normals and gated
+                    // associations get zero weight
+                    for (std::ptrdiff_t j = 0; j < len; j++) {
+                        const Eigen::Vector3f p{sx[b + j], sy[b + j],
+                                                sz[b + j]};
+                        const Eigen::Vector3f pt = rot * p + trans;
+                        const Eigen::Vector3f nrm{tgt[3][j], tgt[4][j],
+                                                  tgt[5][j]};
+                        const Eigen::Vector3f d =
+                            pt - Eigen::Vector3f{tgt[0][j], tgt[1][j],
+                                                 tgt[2][j]};
+                        const int32_t ok =
+                            static_cast<int32_t>(nrm.squaredNorm() > 0.0f) &
+                            static_cast<int32_t>(d.squaredNorm() <= sq_gate);
+                        const auto m = static_cast<float>(ok);
+                        const float r = nrm.dot(d) * m;
+                        const Eigen::Vector3f a = pt.cross(nrm) * m;
+                        jac[0][j] = a.x();
+                        jac[1][j] = a.y();
+                        jac[2][j] = a.z();
+                        jac[3][j] = nrm.x() * m;
+                        jac[4][j] = nrm.y() * m;
+                        jac[5][j] = nrm.z() * m;
+                        res[j] = r;
+                        wt[j] = m / (1.0f + r * r * inv_sq_scale);
+                        inl[j] = m;
+                    }
+                    for (std::ptrdiff_t j = len; j < block; j++) {
+                        for (int k = 0; k < 6; k++) jac[k][j] = 0.0f;
+                        res[j] = wt[j] = inl[j] = 0.0f;
+                    }
+
+                    // reductions over the block in independent lanes, which
+                    // vectorize without reassociating floating point sums
+                    auto reduce = [&](const float* x, const float* y,
+                                      const float* z) {
+                        float lane[lanes] = {};
+                        for (std::ptrdiff_t j = 0; j < block; j += lanes)
+                            for (std::ptrdiff_t k = 0; k < lanes; k++)
+                                lane[k] += x[j + k] * y[j + k] * z[j + k];
+                        float sum = 0.0f;
+                        for (std::ptrdiff_t k = 0; k < lanes; k++)
+                            sum += lane[k];
+                        return sum;
+                    };
+                    int e = 0;
+                    for (int r = 0; r < 6; r++)
+                        for (int c = r; c < 6; c++)
+                            local[e++] += reduce(wt, jac[r], jac[c]);
+                    for (int r = 0; r < 6; r++)
+                        local[e++] += reduce(wt, jac[r], res);
+                    local[e++] += reduce(inl, res, res);
+                    local[e++] += reduce(inl, inl, inl);
+                }
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp critical
+#endif
+                for (int e = 0; e < n_sums; e++) sums[e] += local[e];
+            }
+
+            Eigen::Matrix<double, 6, 6> hess;
+            Eigen::Matrix<double, 6, 1> grad;
+            int e = 0;
+            for (int r = 0; r < 6; r++)
+                for (int c = r; c < 6; c++) hess(r, c) = hess(c, r) = sums[e++];
+            for (int r = 0; r < 6; r++) grad(r) = sums[e++];
+            const double sq_res = sums[e++];
+            const double inliers = sums[e++];
+
+            result.iterations++;
+            result.inliers = static_cast<size_t>(inliers);
+            result.rms = inliers > 0 ? std::sqrt(sq_res / inliers) : 0.0;
+            if (inliers < 6) break;
+
+            // left-multiplied update: rotation vector then translation
+            const Eigen::Matrix<double, 6, 1> delta = hess.ldlt().solve(-grad);
+            const Eigen::Vector3d omega = delta.head<3>();
+            const double angle = omega.norm();
+            Eigen::Matrix4d step = Eigen::Matrix4d::Identity();
+            if (angle > 0.0)
+                step.topLeftCorner<3, 3>() =
+                    Eigen::AngleAxisd(angle, omega / angle).toRotationMatrix();
+            step.topRightCorner<3, 1>() = delta.tail<3>();
+            pose = step * pose;
+
+            if (angle < 1e-5 && delta.tail<3>().norm() < 1e-5) {
+                result.converged = true;
+                break;
+            }
+        }
+    }
+
+    result.transform = pose;
+    return result;
+}
+
+void ProjectiveIcp::set_target(const LidarScan& scan, const XYZLut& lut) {
+    load(scan, lut);
+    update_target();
+}
+
+void ProjectiveIcp::set_target(const LidarScan::Points& points) {
+    load(points);
+    update_target();
+}
+
+IcpResult ProjectiveIcp::align(const LidarScan& scan, const XYZLut& lut,
+                               const mat4d& guess) {
+    if (!has_target_) throw std::logic_error("no ICP target set");
+    load(scan, lut);
+    return update_source(guess);
+}
+
+IcpResult ProjectiveIcp::align(const LidarScan::Points& points,
+                               const mat4d& guess) {
+    if (!has_target_) throw std::logic_error("no ICP target set");
+    load(points);
+    return update_source(guess);
+}
+
+}  // namespace ouster
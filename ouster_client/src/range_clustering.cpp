@@ -0,0 +1,266 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/range_clustering.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#include <omp.h>
+#endif
+
+namespace ouster {
+
+using sensor::ChanField;
+using sensor::ChanFieldType;
+
+namespace {
+
+constexpr uint32_t invalid = UINT32_MAX;
+
+inline uint32_t find_root(uint32_t* parent, uint32_t i) {
+    // path halving
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+inline void unite(uint32_t* parent, uint32_t a, uint32_t b) {
+    a = find_root(parent, a);
+    b = find_root(parent, b);
+    // the lower index becomes the root so that labels are deterministic
+    if (a < b)
+        parent[b] = a;
+    else if (b < a)
+        parent[a] = b;
+}
+
+/*
+ * Angle criterion for returns at ranges r0 and r1 separated by angle a: the
+ * angle between the ray of the farther return and the line to the nearer one,
+ * atan2(near * sin a, far - near * cos a), must exceed the threshold.
+ */
+inline bool connected(float r0, float r1, float sin_a, float cos_a,
+                      float tan_threshold) {
+    const float near = std::min(r0, r1);
+    const float far = std::max(r0, r1);
+    const float den = far - near * cos_a;
+    return den <= 0.0f || near * sin_a > tan_threshold * den;
+}
+
+}  // namespace
+
+RangeClustering::RangeClustering(const sensor::sensor_info& info,
+                                 double angle_threshold_deg,
+                                 uint32_t min_points)
+    : w_{info.format.columns_per_frame},
+      h_{info.format.pixels_per_column},
+      tan_threshold_{
+          static_cast<float>(std::tan(angle_threshold_deg * M_PI / 180.0))},
+      min_points_{std::max<uint32_t>(min_points, 1)} {
+    const auto& shift = info.format.pixel_shift_by_row;
+    const auto& altitude = info.beam_altitude_angles;
+    if (shift.size() != h_ || altitude.size() != h_)
+        throw std::invalid_argument("unexpected scan dimensions");
+
+    const XYZLut lut = make_xyz_lut(info);
+
+    const size_t n = w_ * h_;
+    pixel_.resize(n);
+    dir_.resize(3 * n);
+    ofs_.resize(3 * n);
+    const int iw = static_cast<int>(w_);
+    for (size_t u = 0; u < h_; u++) {
+        const size_t s = (shift[u] % iw + iw) % iw;
+        for (size_t c = 0; c < w_; c++) {
+            const size_t px = u * w_ + (c + w_ - s) % w_;
+            const size_t e = u * w_ + c;
+            pixel_[e] = static_cast<uint32_t>(px);
+            for (int i = 0; i < 3; i++) {
+                dir_[3 * e + i] = static_cast<float>(lut.direction(px, i));
+                ofs_[3 * e + i] = static_cast<float>(lut.offset(px, i));
+            }
+        }
+    }
+
+    const double col_angle = 2.0 * M_PI / w_;
+    sin_col_ = static_cast<float>(std::sin(col_angle));
+    cos_col_ = static_cast<float>(std::cos(col_angle));
+    sin_row_.resize(h_);
+    cos_row_.resize(h_);
+    for (size_t u = 0; u + 1 < h_; u++) {
+        const double a = std::abs(altitude[u + 1] - altitude[u]) * M_PI / 180.0;
+        sin_row_[u] = static_cast<float>(std::sin(a));
+        cos_row_[u] = static_cast<float>(std::cos(a));
+    }
+
+    parent_.resize(n);
+    index_.resize(n);
+    ranges_.resize(n);
+}
+
+void RangeClustering::operator()(
+    const Eigen::Ref<const img_t<uint32_t>>& range,
+    const Eigen::Ref<const img_t<uint8_t>>& exclude,
+    Eigen::Ref<img_t<uint32_t>> labels, std::vector<RangeCluster>& clusters) {
+    if (static_cast<size_t>(range.rows()) != h_ ||
+        static_cast<size_t>(range.cols()) != w_ ||
+        labels.rows() != range.rows() || labels.cols() != range.cols())
+        throw std::invalid_argument("unexpected image dimensions");
+    const bool use_exclude = exclude.size() != 0;
+    if (use_exclude &&
+        (exclude.rows() != range.rows() || exclude.cols() != range.cols()))
+        throw std::invalid_argument("unexpected image dimensions");
+
+    const std::ptrdiff_t w = w_;
+    const std::ptrdiff_t h = h_;
+    const uint32_t* rng = range.data();
+    const uint8_t* excl = exclude.data();
+    uint32_t* out = labels.data();
+    uint32_t* parent = parent_.data();
+    float* ranges = ranges_.data();
+    const float tan_t = tan_threshold_;
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+    const int n_strips = static_cast<int>(
+        std::min<std::ptrdiff_t>(omp_get_max_threads(), h));
+#else
+    const int n_strips = 1;
+#endif
+
+    // link within strips of rows; roots never leave a strip in this phase
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel for schedule(static, 1) num_threads(n_strips)
+#endif
+    for (int t = 0; t < n_strips; t++) {
+        const std::ptrdiff_t u0 = h * t / n_strips;
+        const std::ptrdiff_t u1 = h * (t + 1) / n_strips;
+
+        for (std::ptrdiff_t e = u0 * w; e < u1 * w; e++) {
+            const uint32_t px = pixel_[e];
+            const bool valid = rng[px] != 0 && !(use_exclude && excl[px]);
+            ranges[e] = valid ? rng[px] * 0.001f : 0.0f;
+            parent[e] = valid ? static_cast<uint32_t>(e) : invalid;
+        }
+
+        for (std::ptrdiff_t u = u0; u < u1; u++) {
+            const bool down = u + 1 < u1;
+            const float sin_r = sin_row_[u];
+            const float cos_r = cos_row_[u];
+            for (std::ptrdiff_t c = 0; c < w; c++) {
+                const std::ptrdiff_t e = u * w + c;
+                const float r = ranges[e];
+                if (r == 0.0f) continue;
+
+                const std::ptrdiff_t right = c + 1 == w ? u * w : e + 1;
+                if (ranges[right] != 0.0f &&
+                    connected(r, ranges[right], sin_col_, cos_col_, tan_t))
+                    unite(parent, static_cast<uint32_t>(e),
+                          static_cast<uint32_t>(right));
+
+                if (down && ranges[e + w] != 0.0f &&
+                    connected(r, ranges[e + w], sin_r, cos_r, tan_t))
+                    unite(parent, static_cast<uint32_t>(e),
+                          static_cast<uint32_t>(e + w));
+            }
+        }
+    }
+
+    // merge across strip boundaries
+    for (int t = 1; t < n_strips; t++) {
+        const std::ptrdiff_t u = h * t / n_strips - 1;
+        for (std::ptrdiff_t c = 0; c < w; c++) {
+            const std::ptrdiff_t e = u * w + c;
+            if (ranges[e] != 0.0f && ranges[e + w] != 0.0f &&
+                connected(ranges[e], ranges[e + w], sin_row_[u], cos_row_[u],
+                          tan_t))
+                unite(parent, static_cast<uint32_t>(e),
+                      static_cast<uint32_t>(e + w));
+        }
+    }
+
+    // count pixels per root; roots precede their component in index order,
+    // so one forward pass resolves every pixel to its root
+    uint32_t* index = index_.data();
+    const std::ptrdiff_t n = w * h;
+    for (std::ptrdiff_t e = 0; e < n; e++) {
+        if (parent[e] == invalid) continue;
+        const uint32_t root = parent[parent[e]];
+        parent[e] = root;
+        if (root == static_cast<uint32_t>(e))
+            index[e] = 1;
+        else
+            index[root]++;
+    }
+
+    // label components in order of their root and accumulate statistics
+    clusters.clear();
+    sums_.clear();
+    for (std::ptrdiff_t e = 0; e < n; e++) {
+        const uint32_t px = pixel_[e];
+        const uint32_t root = parent[e];
+        if (root == invalid) {
+            out[px] = 0;
+            continue;
+        }
+
+        if (root == static_cast<uint32_t>(e)) {
+            // index now switches from the pixel count to the cluster index
+            if (index[e] < min_points_) {
+                index[e] = invalid;
+            } else {
+                const uint32_t count = index[e];
+                index[e] = static_cast<uint32_t>(clusters.size());
+                RangeCluster cl;
+                cl.label = index[e] + 1;
+                cl.count = count;
+                cl.min.setConstant(std::numeric_limits<float>::max());
+                cl.max.setConstant(std::numeric_limits<float>::lowest());
+                cl.centroid.setZero();
+                clusters.push_back(cl);
+                sums_.insert(sums_.end(), 3, 0.0);
+            }
+        }
+
+        const uint32_t k = index[root];
+        if (k == invalid) {
+            out[px] = 0;
+            continue;
+        }
+        out[px] = k + 1;
+
+        const float r = rng[px];
+        const Eigen::Vector3f p{r * dir_[3 * e] + ofs_[3 * e],
+                                r * dir_[3 * e + 1] + ofs_[3 * e + 1],
+                                r * dir_[3 * e + 2] + ofs_[3 * e + 2]};
+        RangeCluster& cl = clusters[k];
+        cl.min = cl.min.cwiseMin(p);
+        cl.max = cl.max.cwiseMax(p);
+        for (int i = 0; i < 3; i++) sums_[3 * k + i] += p[i];
+    }
+
+    for (size_t k = 0; k < clusters.size(); k++) {
+        RangeCluster& cl = clusters[k];
+        const double inv = 1.0 / cl.count;
+        for (int i = 0; i < 3; i++)
+            cl.centroid[i] = static_cast<float>(sums_[3 * k + i] * inv);
+    }
+}
+
+void RangeClustering::operator()(LidarScan& scan,
+                                 std::vector<RangeCluster>& clusters,
+                                 ChanField label_field) {
+    if (scan.field_type(label_field) != ChanFieldType::UINT32)
+        throw std::invalid_argument("cluster label field must be UINT32");
+    operator()(scan.field(ChanField::RANGE), img_t<uint8_t>{},
+               scan.field<uint32_t>(label_field), clusters);
+}
+
+}  // namespace ouster
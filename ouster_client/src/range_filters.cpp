@@ -0,0 +1,253 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/range_filters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace ouster {
+
+namespace {
+
+// columns per tile
+constexpr std::ptrdiff_t tile = 256;
+
+// y^256; exp(-x) is approximated by pow256(1 - x / 256) for x < 256, which
+// unlike std::exp vectorizes. The relative error stays below 3% where the
+// weight is above 2%.
+inline float pow256(float y) {
+    y *= y, y *= y, y *= y, y *= y;
+    y *= y, y *= y, y *= y, y *= y;
+    return y;
+}
+
+inline void sort2(uint32_t* a, uint32_t* b) {
+    for (std::ptrdiff_t j = 0; j < tile; j++) {
+        const uint32_t lo = std::min(a[j], b[j]);
+        const uint32_t hi = std::max(a[j], b[j]);
+        a[j] = lo;
+        b[j] = hi;
+    }
+}
+
+template <typename A, typename B>
+void check_dims(const A& a, const B& b) {
+    if (a.rows() != b.rows() || a.cols() != b.cols())
+        throw std::invalid_argument("unexpected image dimensions");
+}
+
+/*
+ * Bilateral filter, optionally with a guide image. The rows of the window
+ * around a tile are copied to a buffer of floats with zeros outside the image,
+ * so the inner loops run over contiguous memory without bounds checks.
+ */
+template <bool JOINT>
+void bilateral(const Eigen::Ref<const img_t<uint32_t>>& range,
+               const float* guide, Eigen::Ref<img_t<uint32_t>> out,
+               int radius, double sigma_space, double sigma_range,
+               double sigma_guide) {
+    if (radius < 0) throw std::invalid_argument("negative filter radius");
+
+    const std::ptrdiff_t h = range.rows();
+    const std::ptrdiff_t w = range.cols();
+    const std::ptrdiff_t r = radius;
+    const std::ptrdiff_t size = 2 * r + 1;
+    const std::ptrdiff_t stride = tile + 2 * r;
+    const uint32_t* rng = range.data();
+    uint32_t* dst = out.data();
+
+    std::vector<float> spatial(size * size);
+    for (std::ptrdiff_t dy = 0; dy < size; dy++)
+        for (std::ptrdiff_t dx = 0; dx < size; dx++)
+            spatial[dy * size + dx] = static_cast<float>(
+                std::exp(-((dy - r) * (dy - r) + (dx - r) * (dx - r)) /
+                         (2.0 * sigma_space * sigma_space)));
+
+    // ranges are in millimeters
+    const float k_range =
+        static_cast<float>(1.0 / (2.0e6 * sigma_range * sigma_range));
+    const float k_guide =
+        static_cast<float>(1.0 / (2.0 * sigma_guide * sigma_guide));
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel
+#endif
+    {
+        std::vector<float> rows(size * stride);
+        std::vector<float> grows(JOINT ? size * stride : 0);
+        float sum[tile], wsum[tile];
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp for schedule(static)
+#endif
+        for (std::ptrdiff_t u = 0; u < h; u++) {
+            for (std::ptrdiff_t c0 = 0; c0 < w; c0 += tile) {
+                const std::ptrdiff_t len = std::min(tile, w - c0);
+
+                for (std::ptrdiff_t dy = 0; dy < size; dy++) {
+                    const std::ptrdiff_t uu = u + dy - r;
+                    float* row = rows.data() + dy * stride;
+                    float* grow = JOINT ? grows.data() + dy * stride : nullptr;
+                    for (std::ptrdiff_t j = 0; j < len + 2 * r; j++) {
+                        const std::ptrdiff_t cc = c0 + j - r;
+                        const bool inside = uu >= 0 && uu < h && cc >= 0 &&
+                                            cc < w;
+                        row[j] = inside ? rng[uu * w + cc] : 0.0f;
+                        if (JOINT) grow[j] = inside ? guide[uu * w + cc] : 0.0f;
+                    }
+                }
+
+                const float* center = rows.data() + r * stride + r;
+                const float* gcenter =
+                    JOINT ? grows.data() + r * stride + r : nullptr;
+                std::fill(sum, sum + len, 0.0f);
+                std::fill(wsum, wsum + len, 0.0f);
+
+                for (std::ptrdiff_t dy = 0; dy < size; dy++) {
+                    for (std::ptrdiff_t dx = 0; dx < size; dx++) {
+                        const float ws = spatial[dy * size + dx];
+                        const float* src = rows.data() + dy * stride + dx;
+                        const float* gsrc =
+                            JOINT ? grows.data() + dy * stride + dx : nullptr;
+                        // conditions are combined before a single select;
+                        // separate selects keep GCC from vectorizing
+                        for (std::ptrdiff_t j = 0; j < len; j++) {
+                            const float v = src[j];
+                            const float d = v - center[j];
+                            float x = d * d * k_range;
+                            if (JOINT) {
+                                const float g = gsrc[j] - gcenter[j];
+                                x += g * g * k_guide;
+                            }
+                            const float y = 1.0f - x * (1.0f / 256.0f);
+                            const bool use = (v > 0.0f) & (y > 0.0f);
+                            const float wt = (use ? ws : 0.0f) * pow256(y);
+                            sum[j] += wt * v;
+                            wsum[j] += wt;
+                        }
+                    }
+                }
+
+                uint32_t* o = dst + u * w + c0;
+                for (std::ptrdiff_t j = 0; j < len; j++) {
+                    const float v = center[j] > 0.0f ? sum[j] / wsum[j] : 0.0f;
+                    o[j] = static_cast<uint32_t>(v + 0.5f);
+                }
+            }
+        }
+    }
+}
+
+}  // namespace
+
+void median_filter(const Eigen::Ref<const img_t<uint32_t>>& range,
+                   Eigen::Ref<img_t<uint32_t>> out) {
+    check_dims(range, out);
+    const std::ptrdiff_t h = range.rows();
+    const std::ptrdiff_t w = range.cols();
+    const uint32_t* rng = range.data();
+    uint32_t* dst = out.data();
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel for schedule(static)
+#endif
+    for (std::ptrdiff_t u = 0; u < h; u++) {
+        uint32_t rows[3][tile + 2];
+        uint32_t p[9][tile];
+
+        for (std::ptrdiff_t c0 = 0; c0 < w; c0 += tile) {
+            const std::ptrdiff_t len = std::min(tile, w - c0);
+
+            // replicate borders
+            for (int dy = 0; dy < 3; dy++) {
+                const std::ptrdiff_t uu =
+                    std::min(std::max<std::ptrdiff_t>(u + dy - 1, 0), h - 1);
+                for (std::ptrdiff_t j = 0; j < len + 2; j++) {
+                    const std::ptrdiff_t cc = std::min(
+                        std::max<std::ptrdiff_t>(c0 + j - 1, 0), w - 1);
+                    rows[dy][j] = rng[uu * w + cc];
+                }
+            }
+            for (int k = 0; k < 9; k++) {
+                std::copy(rows[k / 3] + k % 3, rows[k / 3] + k % 3 + len,
+                          p[k]);
+                std::fill(p[k] + len, p[k] + tile, 0);
+            }
+
+            // median of 9 with 19 compare-exchanges (Paeth)
+            sort2(p[1], p[2]), sort2(p[4], p[5]), sort2(p[7], p[8]);
+            sort2(p[0], p[1]), sort2(p[3], p[4]), sort2(p[6], p[7]);
+            sort2(p[1], p[2]), sort2(p[4], p[5]), sort2(p[7], p[8]);
+            sort2(p[0], p[3]), sort2(p[5], p[8]), sort2(p[4], p[7]);
+            sort2(p[3], p[6]), sort2(p[1], p[4]), sort2(p[2], p[5]);
+            sort2(p[4], p[7]), sort2(p[4], p[2]), sort2(p[6], p[4]);
+            sort2(p[4], p[2]);
+
+            std::copy(p[4], p[4] + len, dst + u * w + c0);
+        }
+    }
+}
+
+void bilateral_filter(const Eigen::Ref<const img_t<uint32_t>>& range,
+                      Eigen::Ref<img_t<uint32_t>> out, int radius,
+                      double sigma_space, double sigma_range) {
+    check_dims(range, out);
+    bilateral<false>(range, nullptr, out, radius, sigma_space, sigma_range,
+                     1.0);
+}
+
+void joint_bilateral_filter(const Eigen::Ref<const img_t<uint32_t>>& range,
+                            const Eigen::Ref<const img_t<float>>& guide,
+                            Eigen::Ref<img_t<uint32_t>> out, int radius,
+                            double sigma_space, double sigma_range,
+                            double sigma_guide) {
+    check_dims(range, out);
+    check_dims(range, guide);
+    bilateral<true>(range, guide.data(), out, radius, sigma_space,
+                    sigma_range, sigma_guide);
+}
+
+void fill_gaps(const Eigen::Ref<const img_t<uint32_t>>& range,
+               Eigen::Ref<img_t<uint32_t>> out, int max_gap,
+               double max_change) {
+    check_dims(range, out);
+    const std::ptrdiff_t h = range.rows();
+    const std::ptrdiff_t w = range.cols();
+    const uint32_t* rng = range.data();
+    uint32_t* dst = out.data();
+    const double max_rel = max_change;
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel for schedule(static)
+#endif
+    for (std::ptrdiff_t u = 0; u < h; u++) {
+        const uint32_t* src = rng + u * w;
+        uint32_t* o = dst + u * w;
+        if (o != src) std::copy(src, src + w, o);
+
+        // last return seen; gaps are filled in place behind the scan, which
+        // only ever reads returns
+        std::ptrdiff_t last = -1;
+        for (std::ptrdiff_t c = 0; c < w; c++) {
+            if (o[c] == 0) continue;
+            const std::ptrdiff_t gap = c - last - 1;
+            if (last >= 0 && gap > 0 && gap <= max_gap) {
+                const double a = o[last];
+                const double b = o[c];
+                if (std::abs(a - b) <= max_rel * std::min(a, b)) {
+                    for (std::ptrdiff_t j = 1; j <= gap; j++)
+                        o[last + j] = static_cast<uint32_t>(
+                            std::lround(a + (b - a) * j / (gap + 1)));
+                }
+            }
+            last = c;
+        }
+    }
+}
+
+}  // namespace ouster
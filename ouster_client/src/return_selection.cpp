@@ -0,0 +1,221 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/return_selection.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace ouster {
+
+using sensor::ChanField;
+using sensor::ChanFieldType;
+
+namespace {
+
+// whether to prefer the second return when both are valid, as 0 or 1
+struct Strongest {
+    int operator()(uint32_t, uint32_t, uint16_t s1, uint16_t s2, uint8_t,
+                   uint8_t) const {
+        return s2 > s1;
+    }
+};
+
+struct First {
+    int operator()(uint32_t r1, uint32_t r2, uint16_t, uint16_t, uint8_t,
+                   uint8_t) const {
+        return r2 < r1;
+    }
+};
+
+struct Last {
+    int operator()(uint32_t r1, uint32_t r2, uint16_t, uint16_t, uint8_t,
+                   uint8_t) const {
+        return r2 > r1;
+    }
+};
+
+struct NonGhost {
+    uint8_t mask;
+    int operator()(uint32_t, uint32_t, uint16_t s1, uint16_t s2, uint8_t f1,
+                   uint8_t f2) const {
+        const int g1 = (f1 & mask) != 0;
+        const int g2 = (f2 & mask) != 0;
+        return (g1 & (g2 ^ 1)) | (static_cast<int>(g1 == g2) & (s2 > s1));
+    }
+};
+
+// pixels per tile
+constexpr std::ptrdiff_t tile = 256;
+
+template <typename T>
+inline void select(const T* a, const T* b, const uint32_t* m,
+                   std::ptrdiff_t n, T* out) {
+    for (std::ptrdiff_t j = 0; j < n; j++)
+        out[j] = static_cast<T>(a[j] ^ ((a[j] ^ b[j]) & m[j]));
+}
+
+struct Fields {
+    const uint32_t *r1, *r2;
+    const uint16_t *s1, *s2;
+    const uint8_t *l1, *l2;  // reflectivity
+    const uint8_t *f1, *f2;
+    std::ptrdiff_t flags_stride;  // zero to read a row of zeros
+    uint32_t* r;
+    uint16_t* s;
+    uint8_t *l, *f, *which;
+};
+
+// rows of the output that don't exist are written to per-thread scratch rows,
+// so that a single loop without branches serves all outputs
+struct Scratch {
+    std::vector<uint32_t> r;
+    std::vector<uint16_t> s;
+    std::vector<uint8_t> l, f, which;
+};
+
+template <typename Pick>
+void merge(const Fields& fs, std::ptrdiff_t w, std::ptrdiff_t h, Pick pick) {
+    const bool has_r = fs.r, has_s = fs.s, has_l = fs.l, has_f = fs.f;
+    const bool has_which = fs.which;
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel
+#endif
+    {
+        Scratch scratch;
+        if (!has_r) scratch.r.resize(w);
+        if (!has_s) scratch.s.resize(w);
+        if (!has_l) scratch.l.resize(w);
+        if (!has_f) scratch.f.resize(w);
+        if (!has_which) scratch.which.resize(w);
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp for schedule(static)
+#endif
+        for (std::ptrdiff_t u = 0; u < h; u++) {
+            const std::ptrdiff_t i0 = u * w;
+            const uint32_t* r1 = fs.r1 + i0;
+            const uint32_t* r2 = fs.r2 + i0;
+            const uint16_t* s1 = fs.s1 + i0;
+            const uint16_t* s2 = fs.s2 + i0;
+            const uint8_t* l1 = fs.l1 + i0;
+            const uint8_t* l2 = fs.l2 + i0;
+            const uint8_t* f1 = fs.f1 + u * fs.flags_stride;
+            const uint8_t* f2 = fs.f2 + u * fs.flags_stride;
+            uint32_t* r = has_r ? fs.r + i0 : scratch.r.data();
+            uint16_t* s = has_s ? fs.s + i0 : scratch.s.data();
+            uint8_t* l = has_l ? fs.l + i0 : scratch.l.data();
+            uint8_t* f = has_f ? fs.f + i0 : scratch.f.data();
+            uint8_t* which = has_which ? fs.which + i0 : scratch.which.data();
+
+            // pixels are merged by tiles that stay in L1: the selection masks
+            // of a tile go to a local buffer, so that the compiler needs few
+            // alias checks and vectorizes each loop. Selects are written with
+            // masks and all inputs of a pixel are read before its outputs
+            // are written, so the output may be the input
+            for (std::ptrdiff_t v0 = 0; v0 < w; v0 += tile) {
+                const std::ptrdiff_t n = std::min(tile, w - v0);
+                uint32_t m[tile];
+                for (std::ptrdiff_t j = 0; j < n; j++) {
+                    const std::ptrdiff_t v = v0 + j;
+                    const uint32_t a = r1[v], b = r2[v];
+                    const int valid1 = a != 0;
+                    const int valid2 = b != 0;
+                    const int second =
+                        valid2 & ((valid1 ^ 1) |
+                                  pick(a, b, s1[v], s2[v], f1[v], f2[v]));
+                    m[j] = 0u - static_cast<uint32_t>(second);
+                    which[v] =
+                        static_cast<uint8_t>((valid1 | valid2) + second);
+                }
+                select(r1 + v0, r2 + v0, m, n, r + v0);
+                select(s1 + v0, s2 + v0, m, n, s + v0);
+                select(l1 + v0, l2 + v0, m, n, l + v0);
+                select(f1 + v0, f2 + v0, m, n, f + v0);
+            }
+        }
+    }
+}
+
+template <typename T>
+const T* input(const LidarScan& scan, ChanField f, ChanFieldType type) {
+    if (scan.field_type(f) != type)
+        throw std::invalid_argument("missing or unexpected dual return field " +
+                                    sensor::to_string(f));
+    return scan.field<T>(f).data();
+}
+
+// nullptr if the output has no such field
+template <typename T>
+T* output(LidarScan& scan, ChanField f, ChanFieldType type) {
+    const ChanFieldType t = scan.field_type(f);
+    if (t == ChanFieldType::VOID) return nullptr;
+    if (t != type)
+        throw std::invalid_argument("unexpected type of merged field " +
+                                    sensor::to_string(f));
+    return scan.field<T>(f).data();
+}
+
+}  // namespace
+
+void select_returns(const LidarScan& in, LidarScan& out, ReturnPolicy policy,
+                    ChanField which, uint8_t ghost_flags) {
+    if (in.w != out.w || in.h != out.h)
+        throw std::invalid_argument("unexpected scan dimensions");
+
+    Fields fs;
+    fs.r1 = input<uint32_t>(in, ChanField::RANGE, ChanFieldType::UINT32);
+    fs.r2 = input<uint32_t>(in, ChanField::RANGE2, ChanFieldType::UINT32);
+    fs.s1 = input<uint16_t>(in, ChanField::SIGNAL, ChanFieldType::UINT16);
+    fs.s2 = input<uint16_t>(in, ChanField::SIGNAL2, ChanFieldType::UINT16);
+    fs.l1 = input<uint8_t>(in, ChanField::REFLECTIVITY, ChanFieldType::UINT8);
+    fs.l2 = input<uint8_t>(in, ChanField::REFLECTIVITY2, ChanFieldType::UINT8);
+    fs.r = output<uint32_t>(out, ChanField::RANGE, ChanFieldType::UINT32);
+    fs.s = output<uint16_t>(out, ChanField::SIGNAL, ChanFieldType::UINT16);
+    fs.l = output<uint8_t>(out, ChanField::REFLECTIVITY, ChanFieldType::UINT8);
+    fs.which = output<uint8_t>(out, which, ChanFieldType::UINT8);
+
+    // flags aren't among the default fields of dual return scans
+    std::vector<uint8_t> no_flags;
+    const bool has_flags =
+        in.field_type(ChanField::FLAGS) != ChanFieldType::VOID ||
+        in.field_type(ChanField::FLAGS2) != ChanFieldType::VOID;
+    if (has_flags) {
+        fs.f1 = input<uint8_t>(in, ChanField::FLAGS, ChanFieldType::UINT8);
+        fs.f2 = input<uint8_t>(in, ChanField::FLAGS2, ChanFieldType::UINT8);
+        fs.flags_stride = in.w;
+        fs.f = output<uint8_t>(out, ChanField::FLAGS, ChanFieldType::UINT8);
+    } else if (policy == ReturnPolicy::NON_GHOST) {
+        throw std::invalid_argument("missing dual return field FLAGS");
+    } else {
+        no_flags.resize(in.w);
+        fs.f1 = fs.f2 = no_flags.data();
+        fs.flags_stride = 0;
+        fs.f = nullptr;
+    }
+
+    const std::ptrdiff_t w = in.w;
+    const std::ptrdiff_t h = in.h;
+    switch (policy) {
+        case ReturnPolicy::STRONGEST:
+            merge(fs, w, h, Strongest{});
+            break;
+        case ReturnPolicy::FIRST:
+            merge(fs, w, h, First{});
+            break;
+        case ReturnPolicy::LAST:
+            merge(fs, w, h, Last{});
+            break;
+        case ReturnPolicy::NON_GHOST:
+            merge(fs, w, h, NonGhost{ghost_flags});
+            break;
+        default:
+            throw std::invalid_argument("unknown return policy");
+    }
+}
+
+}  // namespace ouster
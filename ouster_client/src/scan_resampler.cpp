@@ -0,0 +1,365 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/scan_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+#include "ouster_client/impl/lidar_scan_impl.h"
+
+namespace ouster {
+
+using sensor::ChanField;
+using sensor::ChanFieldType;
+
+namespace {
+
+// fields holding bits rather than quantities, never averaged
+bool is_bitfield(ChanField f) {
+    return f == ChanField::FLAGS || f == ChanField::FLAGS2 ||
+           f == ChanField::RAW_HEADERS ||
+           (f >= ChanField::RAW32_WORD5 && f <= ChanField::RAW32_WORD9) ||
+           (f >= ChanField::RAW32_WORD1 && f <= ChanField::RAW32_WORD4);
+}
+
+// fields of the second return
+bool is_second_return(ChanField f) {
+    return f == ChanField::RANGE2 || f == ChanField::SIGNAL2 ||
+           f == ChanField::REFLECTIVITY2 || f == ChanField::FLAGS2;
+}
+
+// scale an index in [0, from) to the nearest in [0, to), wrapping around
+uint32_t scale_index(int64_t i, size_t from, size_t to) {
+    const auto f = static_cast<int64_t>(from), t = static_cast<int64_t>(to);
+    const int64_t s = (2 * i * t + f) / (2 * f);
+    return static_cast<uint32_t>(((s % t) + t) % t);
+}
+
+// copy the packed headers of the nearest input column; rows of RAW_HEADERS
+// hold header words rather than beams, so whole columns are copied
+struct copy_raw_headers {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> out, const LidarScan& in,
+                    const std::vector<uint32_t>& nearest) {
+        const auto src = in.field<T>(ChanField::RAW_HEADERS);
+        for (std::ptrdiff_t v = 0; v < out.cols(); v++)
+            out.col(v) = src.col(nearest[v]);
+    }
+};
+
+}  // namespace
+
+ScanResampler::ScanResampler(const sensor::sensor_info& info, size_t columns,
+                             const std::vector<size_t>& beams,
+                             ResampleMode mode, double max_depth_change)
+    : w_{info.format.columns_per_frame},
+      h_{info.format.pixels_per_column},
+      out_w_{columns},
+      out_h_{beams.empty() ? h_ : beams.size()},
+      mode_{mode},
+      max_depth_change_{static_cast<float>(max_depth_change)},
+      out_info_(info),
+      beams_(beams) {
+    if (w_ == 0 || h_ == 0 || info.format.pixel_shift_by_row.size() != h_ ||
+        info.beam_altitude_angles.size() != h_ ||
+        info.beam_azimuth_angles.size() != h_)
+        throw std::invalid_argument("unexpected scan dimensions");
+    if (columns == 0 || columns >= std::numeric_limits<uint32_t>::max())
+        throw std::invalid_argument("invalid number of output columns");
+    if (beams_.empty()) {
+        beams_.resize(h_);
+        std::iota(beams_.begin(), beams_.end(), 0);
+    }
+    for (size_t u : beams_)
+        if (u >= h_) throw std::invalid_argument("beam index out of range");
+
+    // input columns covered by each output column, in the staggered image:
+    // those nearer to its encoder angle than to its neighbours'
+    const double ratio = static_cast<double>(w_) / out_w_;
+    std::vector<int64_t> first(out_w_), count(out_w_);
+    nearest_.resize(out_w_);
+    n_taps_ = 1;
+    for (size_t v = 0; v < out_w_; v++) {
+        const auto lo = static_cast<int64_t>(std::ceil((v - 0.5) * ratio));
+        const auto hi = static_cast<int64_t>(std::ceil((v + 0.5) * ratio));
+        nearest_[v] = scale_index(static_cast<int64_t>(v), out_w_, w_);
+        first[v] = hi > lo ? lo : nearest_[v];
+        count[v] = std::max<int64_t>(hi - lo, 1);
+        n_taps_ = std::max(n_taps_, static_cast<size_t>(count[v]));
+    }
+    const auto iw = static_cast<int64_t>(w_);
+    taps_.resize(n_taps_ * out_w_);
+    tap_mask_.resize(n_taps_ * out_w_);
+    for (size_t j = 0; j < n_taps_; j++) {
+        for (size_t v = 0; v < out_w_; v++) {
+            const int64_t k = std::min<int64_t>(j, count[v] - 1);
+            taps_[j * out_w_ + v] =
+                static_cast<uint32_t>(((first[v] + k) % iw + iw) % iw);
+            tap_mask_[j * out_w_ + v] = static_cast<int64_t>(j) < count[v];
+        }
+    }
+
+    // metadata of a sensor producing the output
+    auto& fmt = out_info_.format;
+    fmt.columns_per_frame = static_cast<uint32_t>(out_w_);
+    fmt.pixels_per_column = static_cast<uint32_t>(out_h_);
+    fmt.pixel_shift_by_row.resize(out_h_);
+    out_info_.beam_altitude_angles.resize(out_h_);
+    out_info_.beam_azimuth_angles.resize(out_h_);
+    for (size_t k = 0; k < out_h_; k++) {
+        const size_t u = beams_[k];
+        fmt.pixel_shift_by_row[k] = static_cast<int>(std::lround(
+            info.format.pixel_shift_by_row[u] * (out_w_ / double(w_))));
+        out_info_.beam_altitude_angles[k] = info.beam_altitude_angles[u];
+        out_info_.beam_azimuth_angles[k] = info.beam_azimuth_angles[u];
+    }
+    // the window covers the output columns that overlap input columns of
+    // the window: its start is scaled down and its end up, without wrapping
+    const auto win_first =
+        static_cast<size_t>(info.format.column_window.first);
+    const auto win_second =
+        static_cast<size_t>(info.format.column_window.second);
+    fmt.column_window.first = static_cast<int>(win_first * out_w_ / w_);
+    fmt.column_window.second = static_cast<int>(std::min(
+        out_w_ - 1, ((win_second + 1) * out_w_ + w_ - 1) / w_ - 1));
+    out_info_.mode = sensor::MODE_UNSPEC;
+    if (info.mode != sensor::MODE_UNSPEC) {
+        const int freq = sensor::frequency_of_lidar_mode(info.mode);
+        for (auto m : {sensor::MODE_512x10, sensor::MODE_512x20,
+                       sensor::MODE_1024x10, sensor::MODE_1024x20,
+                       sensor::MODE_2048x10, sensor::MODE_4096x5})
+            if (sensor::n_cols_of_lidar_mode(m) == out_w_ &&
+                sensor::frequency_of_lidar_mode(m) == freq)
+                out_info_.mode = m;
+    }
+}
+
+const sensor::sensor_info& ScanResampler::output_info() const {
+    return out_info_;
+}
+
+XYZLut ScanResampler::output_lut() const { return make_xyz_lut(out_info_); }
+
+void ScanResampler::update_weights(const LidarScan& scan, ChanField range,
+                                   int ret) {
+    const auto rng = scan.field<uint32_t>(range);
+    const std::ptrdiff_t out_w = out_w_;
+    const std::ptrdiff_t out_h = out_h_;
+    const std::ptrdiff_t n_taps = n_taps_;
+    const std::ptrdiff_t n = n_taps * out_w;
+    const float tol = max_depth_change_;
+    const float none = std::numeric_limits<float>::infinity();
+    std::vector<float>& weights = weights_[ret];
+    std::vector<uint32_t>& reference = reference_[ret];
+    weights.resize(out_h * n);
+    reference.resize(out_h * out_w);
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel
+#endif
+    {
+        std::vector<float> taps(n), nearest(out_w);
+        std::vector<int32_t> nearest_tap(out_w);
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp for schedule(static)
+#endif
+        for (std::ptrdiff_t k = 0; k < out_h; k++) {
+            const uint32_t* row = rng.row(beams_[k]).data();
+            float* r = taps.data();
+            float* best = nearest.data();
+            int32_t* best_tap = nearest_tap.data();
+            float* wt = weights.data() + k * n;
+
+            // gather the taps; ranges fit in 31 bits and the signed
+            // conversion vectorizes in the loops below
+            for (std::ptrdiff_t i = 0; i < n; i++)
+                r[i] = static_cast<float>(static_cast<int32_t>(row[taps_[i]]));
+
+            // nearest return among the taps
+            for (std::ptrdiff_t v = 0; v < out_w; v++) {
+                best[v] = none;
+                best_tap[v] = -1;
+            }
+            for (std::ptrdiff_t j = 0; j < n_taps; j++) {
+                const float* rj = r + j * out_w;
+                for (std::ptrdiff_t v = 0; v < out_w; v++) {
+                    const bool nearer = (rj[v] > 0.0f) & (rj[v] < best[v]);
+                    best[v] = nearer ? rj[v] : best[v];
+                    best_tap[v] =
+                        nearer ? static_cast<int32_t>(j) : best_tap[v];
+                }
+            }
+            uint32_t* ref = reference.data() + k * out_w;
+            for (std::ptrdiff_t v = 0; v < out_w; v++)
+                ref[v] = best_tap[v] < 0 ? nearest_[v]
+                                         : taps_[best_tap[v] * out_w + v];
+
+            // taps at the depth of the reference; none without returns
+            for (std::ptrdiff_t j = 0; j < n_taps; j++) {
+                const float* rj = r + j * out_w;
+                const float* mask = tap_mask_.data() + j * out_w;
+                float* wj = wt + j * out_w;
+                // combined as integers: a combination of bools compiles to
+                // branches here
+                for (std::ptrdiff_t v = 0; v < out_w; v++) {
+                    const float x = rj[v], b = best[v];
+                    const float d = std::abs(x - b);
+                    const int near = static_cast<int>(x > 0.0f) &
+                                     static_cast<int>(d <= tol * b);
+                    wj[v] = mask[v] * static_cast<float>(near);
+                }
+            }
+        }
+    }
+}
+
+template <typename T>
+void ScanResampler::resample(Eigen::Ref<const img_t<T>> in,
+                             Eigen::Ref<img_t<T>> out, int ret,
+                             bool average) const {
+    const std::ptrdiff_t out_w = out_w_;
+    const std::ptrdiff_t out_h = out_h_;
+    const std::ptrdiff_t n_taps = n_taps_;
+    const std::ptrdiff_t n = n_taps * out_w;
+    const ResampleMode mode = mode_;
+    const float max_value = static_cast<float>(std::numeric_limits<T>::max());
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel
+#endif
+    {
+        // taps gathered per row, so that the loops over them vectorize
+        std::vector<T> taps(mode == ResampleMode::MAX_POOL ? n : 0);
+        std::vector<float> values(mode == ResampleMode::RANGE_AWARE ? n : 0);
+        std::vector<float> sum(out_w), count(out_w);
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp for schedule(static)
+#endif
+        for (std::ptrdiff_t k = 0; k < out_h; k++) {
+            const T* row = in.row(beams_[k]).data();
+            T* dst = &out(k, 0);
+
+            // bits are never pooled: they take the nearest column in
+            // MAX_POOL mode and the reference pixel in RANGE_AWARE mode
+            if (mode == ResampleMode::NEAREST ||
+                (!average && mode == ResampleMode::MAX_POOL)) {
+                const uint32_t* src = nearest_.data();
+                for (std::ptrdiff_t v = 0; v < out_w; v++) dst[v] = row[src[v]];
+            } else if (!average) {
+                const uint32_t* src = reference_[ret].data() + k * out_w;
+                for (std::ptrdiff_t v = 0; v < out_w; v++) dst[v] = row[src[v]];
+            } else if (mode == ResampleMode::MAX_POOL) {
+                // repeated taps don't change the maximum
+                T* t = taps.data();
+                for (std::ptrdiff_t i = 0; i < n; i++) t[i] = row[taps_[i]];
+                for (std::ptrdiff_t v = 0; v < out_w; v++) dst[v] = t[v];
+                for (std::ptrdiff_t j = 1; j < n_taps; j++) {
+                    const T* tj = t + j * out_w;
+                    for (std::ptrdiff_t v = 0; v < out_w; v++)
+                        dst[v] = std::max(dst[v], tj[v]);
+                }
+            } else {
+                float* t = values.data();
+                for (std::ptrdiff_t i = 0; i < n; i++)
+                    t[i] = static_cast<float>(row[taps_[i]]);
+                const float* wt = weights_[ret].data() + k * n;
+                for (std::ptrdiff_t v = 0; v < out_w; v++)
+                    sum[v] = count[v] = 0.0f;
+                for (std::ptrdiff_t j = 0; j < n_taps; j++) {
+                    const float* tj = t + j * out_w;
+                    const float* wj = wt + j * out_w;
+                    for (std::ptrdiff_t v = 0; v < out_w; v++) {
+                        sum[v] += wj[v] * tj[v];
+                        count[v] += wj[v];
+                    }
+                }
+                for (std::ptrdiff_t v = 0; v < out_w; v++) {
+                    const float c = count[v];
+                    const float mean = sum[v] / (c + (c == 0.0f)) + 0.5f;
+                    dst[v] = static_cast<T>(std::min(mean, max_value));
+                }
+                // pixels without returns keep the nearest column
+                for (std::ptrdiff_t v = 0; v < out_w; v++)
+                    if (count[v] == 0.0f) dst[v] = row[nearest_[v]];
+            }
+        }
+    }
+}
+
+void ScanResampler::operator()(const LidarScan& in, LidarScan& out) {
+    if (static_cast<size_t>(in.w) != w_ || static_cast<size_t>(in.h) != h_ ||
+        static_cast<size_t>(out.w) != out_w_ ||
+        static_cast<size_t>(out.h) != out_h_)
+        throw std::invalid_argument("unexpected scan dimensions");
+    for (const auto& ft : out)
+        if (in.field_type(ft.first) != ft.second)
+            throw std::invalid_argument("missing or mismatched field");
+    if (out.field_type(ChanField::RAW_HEADERS) != ChanFieldType::VOID &&
+        out_h_ != h_)
+        throw std::invalid_argument(
+            "RAW_HEADERS can't be resampled to a subset of beams");
+
+    const bool has_second =
+        in.field_type(ChanField::RANGE2) != ChanFieldType::VOID;
+    if (mode_ == ResampleMode::RANGE_AWARE) {
+        update_weights(in, ChanField::RANGE, 0);
+        if (has_second) update_weights(in, ChanField::RANGE2, 1);
+    }
+
+    for (const auto& ft : out) {
+        const ChanField f = ft.first;
+        if (f == ChanField::RAW_HEADERS) {
+            impl::visit_field(out, f, copy_raw_headers(), in, nearest_);
+            continue;
+        }
+        const int ret = has_second && is_second_return(f) ? 1 : 0;
+        const bool average = !is_bitfield(f);
+        switch (ft.second) {
+            case ChanFieldType::UINT8:
+                resample<uint8_t>(in.field<uint8_t>(f), out.field<uint8_t>(f),
+                                  ret, average);
+                break;
+            case ChanFieldType::UINT16:
+                resample<uint16_t>(in.field<uint16_t>(f),
+                                   out.field<uint16_t>(f), ret, average);
+                break;
+            case ChanFieldType::UINT32:
+                resample<uint32_t>(in.field<uint32_t>(f),
+                                   out.field<uint32_t>(f), ret, average);
+                break;
+            case ChanFieldType::UINT64:
+                resample<uint64_t>(in.field<uint64_t>(f),
+                                   out.field<uint64_t>(f), ret, average);
+                break;
+            default:
+                throw std::invalid_argument("invalid field for LidarScan");
+        }
+    }
+
+    // headers of the nearest column
+    for (size_t v = 0; v < out_w_; v++) {
+        const uint32_t src = nearest_[v];
+        out.timestamp()[v] = in.timestamp()[src];
+        out.status()[v] = in.status()[src];
+        out.measurement_id()[v] = static_cast<uint16_t>(
+            scale_index(in.measurement_id()[src], w_, out_w_));
+    }
+    out.frame_id = in.frame_id;
+    out.frame_status = in.frame_status;
+}
+
+LidarScan ScanResampler::operator()(const LidarScan& in) {
+    LidarScan out(out_w_, out_h_, in.begin(), in.end());
+    operator()(in, out);
+    return out;
+}
+
+}  // namespace ouster
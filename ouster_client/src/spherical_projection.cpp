@@ -0,0 +1,310 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/spherical_projection.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "ouster_client/impl/lidar_scan_impl.h"
+
+namespace ouster {
+
+using sensor::ChanField;
+
+namespace {
+
+constexpr uint64_t empty_pixel = std::numeric_limits<uint64_t>::max();
+
+constexpr float pi = static_cast<float>(M_PI);
+
+// points per block
+constexpr std::ptrdiff_t block = 256;
+
+// atan2 within 1e-5 radians, much cheaper than std::atan2; quadrants are
+// fixed up in arithmetic so that loops calling it vectorize
+inline float fast_atan2(float y, float x) {
+    const float ax = std::abs(x);
+    const float ay = std::abs(y);
+    const float mx = std::max(ax, ay);
+    const float a = std::min(ax, ay) / (mx + static_cast<float>(mx == 0.0f));
+    const float s = a * a;
+    float r = ((((-0.01172120f * s + 0.05265332f) * s - 0.11643287f) * s +
+                0.19354346f) *
+                   s -
+               0.33262347f) *
+                  s * a +
+              0.99997726f * a;
+    r += static_cast<float>(ay > ax) * (0.5f * pi - 2.0f * r);
+    r += static_cast<float>(x < 0.0f) * (pi - 2.0f * r);
+    return std::copysign(r, y);
+}
+
+// cast values of points to a field through the index image
+struct gather_values {
+    template <typename T>
+    void operator()(Eigen::Ref<img_t<T>> dest,
+                    const Eigen::Ref<const Eigen::ArrayXd>& values,
+                    const img_t<uint32_t>& index) {
+        const double max = static_cast<double>(std::numeric_limits<T>::max());
+        const uint32_t* idx = index.data();
+        const double* val = values.data();
+        T* out = dest.data();
+        const std::ptrdiff_t n = index.size();
+        for (std::ptrdiff_t i = 0; i < n; i++) {
+            const double v = idx[i] == SphericalProjection::no_point
+                                 ? 0.0
+                                 : val[idx[i]];
+            // NaN maps to zero
+            out[i] = static_cast<T>(v > 0.0 ? std::min(v, max) : 0.0);
+        }
+    }
+};
+
+}  // namespace
+
+constexpr uint32_t SphericalProjection::no_point;
+
+SphericalProjection::SphericalProjection(const sensor::sensor_info& info)
+    : w_{static_cast<std::ptrdiff_t>(info.format.columns_per_frame)},
+      h_{static_cast<std::ptrdiff_t>(info.format.pixels_per_column)} {
+    const auto& altitude = info.beam_altitude_angles;
+    const auto& azimuth = info.beam_azimuth_angles;
+    if (w_ <= 0 || h_ <= 0 ||
+        static_cast<std::ptrdiff_t>(altitude.size()) != h_ ||
+        static_cast<std::ptrdiff_t>(azimuth.size()) != h_)
+        throw std::invalid_argument("unexpected scan dimensions");
+
+    // the lut maps ranges to meters in the sensor frame
+    const mat4d& to_sensor = info.lidar_to_sensor_transform;
+    const Eigen::Matrix3d rot = to_sensor.topLeftCorner<3, 3>().transpose();
+    to_lidar_rot_ = rot.cast<float>();
+    to_lidar_trans_ = (-rot * to_sensor.topRightCorner<3, 1>() *
+                       sensor::range_unit)
+                          .cast<float>();
+    const double radius = info.beam_to_lidar_transform(0, 3);
+    const double height = info.beam_to_lidar_transform(2, 3);
+    beam_radius_ = static_cast<float>(radius * sensor::range_unit);
+    beam_height_ = static_cast<float>(height * sensor::range_unit);
+    // as in make_xyz_lut
+    beam_distance_ = static_cast<float>(
+        (height != 0 ? std::sqrt(radius * radius + height * height)
+                     : radius) *
+        sensor::range_unit);
+
+    // column v has an encoder angle of 2 pi (1 - v / w), rotated by minus
+    // the beam azimuth
+    inv_az_res_ = static_cast<float>(w_ / (2.0 * M_PI));
+    col_offset_.resize(h_);
+    az_cos_.resize(h_);
+    az_sin_.resize(h_);
+    alt_cos_.resize(h_);
+    alt_sin_.resize(h_);
+    for (std::ptrdiff_t u = 0; u < h_; u++) {
+        col_offset_[u] = static_cast<float>(-azimuth[u] * w_ / 360.0);
+        const double az = -azimuth[u] * M_PI / 180.0;
+        const double alt = altitude[u] * M_PI / 180.0;
+        az_cos_[u] = static_cast<float>(std::cos(az));
+        az_sin_[u] = static_cast<float>(std::sin(az));
+        alt_cos_[u] = static_cast<float>(std::cos(alt));
+        alt_sin_[u] = static_cast<float>(std::sin(alt));
+    }
+    enc_cos_.resize(w_);
+    enc_sin_.resize(w_);
+    for (std::ptrdiff_t v = 0; v < w_; v++) {
+        const double enc = 2.0 * M_PI - v * 2.0 * M_PI / w_;
+        enc_cos_[v] = static_cast<float>(std::cos(enc));
+        enc_sin_[v] = static_cast<float>(std::sin(enc));
+    }
+
+    // nearest row by elevation, in bins of an eighth of the smallest gap
+    // between beams, extending half the largest gap beyond the outermost
+    std::vector<double> sorted(altitude);
+    std::sort(sorted.begin(), sorted.end());
+    double gap = 0.0, max_gap = 0.0;
+    for (size_t i = 1; i < sorted.size(); i++) {
+        const double d = sorted[i] - sorted[i - 1];
+        if (d > 0.0 && (gap == 0.0 || d < gap)) gap = d;
+        max_gap = std::max(max_gap, d);
+    }
+    if (gap == 0.0) gap = max_gap = 360.0 / w_;
+    const double bin = gap / 8.0;
+    const double lo = sorted.front() - max_gap / 2.0;
+    const double hi = sorted.back() + max_gap / 2.0;
+    el_rows_.resize(static_cast<size_t>(std::ceil((hi - lo) / bin)));
+    for (size_t b = 0; b < el_rows_.size(); b++) {
+        const double el = lo + (b + 0.5) * bin;
+        std::ptrdiff_t best = 0;
+        for (std::ptrdiff_t u = 1; u < h_; u++)
+            if (std::abs(altitude[u] - el) < std::abs(altitude[best] - el))
+                best = u;
+        el_rows_[b] = static_cast<int16_t>(best);
+    }
+    el_min_ = static_cast<float>(lo * M_PI / 180.0);
+    inv_el_bin_ = static_cast<float>(180.0 / (M_PI * bin));
+
+    zbuf_.reset(new std::atomic<uint64_t>[w_ * h_]);
+}
+
+SphericalProjection::~SphericalProjection() = default;
+
+template <typename T>
+void SphericalProjection::project(const PointsT<T>& points,
+                                  Eigen::Ref<img_t<uint32_t>> range,
+                                  Eigen::Ref<img_t<uint32_t>> index) {
+    if (range.rows() != h_ || range.cols() != w_ || index.rows() != h_ ||
+        index.cols() != w_)
+        throw std::invalid_argument("unexpected image dimensions");
+    if (static_cast<uint64_t>(points.rows()) >= no_point)
+        throw std::invalid_argument("too many points to project");
+
+    const std::ptrdiff_t w = w_;
+    const std::ptrdiff_t n_pixels = w_ * h_;
+    const std::ptrdiff_t n = points.rows();
+    const T* px = points.data();
+    const T* py = px + n;
+    const T* pz = py + n;
+    std::atomic<uint64_t>* zbuf = zbuf_.get();
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel for schedule(static)
+#endif
+    for (std::ptrdiff_t i = 0; i < n_pixels; i++)
+        zbuf[i].store(empty_pixel, std::memory_order_relaxed);
+
+    const Eigen::Matrix3f& rot = to_lidar_rot_;
+    const Eigen::Vector3f& trans = to_lidar_trans_;
+    const float radius = beam_radius_, height = beam_height_;
+    const float distance = beam_distance_;
+    const float inv_az_res = inv_az_res_;
+    const float el_min = el_min_, inv_el_bin = inv_el_bin_;
+    const auto n_bins = static_cast<float>(el_rows_.size());
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel
+#endif
+    {
+        // the arithmetic of a block is done in a first pass that vectorizes,
+        // leaving table lookups and the atomic updates to a second one
+        float qx[block], qy[block], qz[block], bin[block], col[block];
+        int32_t valid[block];
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp for schedule(static)
+#endif
+        for (std::ptrdiff_t b = 0; b < n; b += block) {
+            const std::ptrdiff_t len = std::min(block, n - b);
+
+            for (std::ptrdiff_t j = 0; j < len; j++) {
+                const auto x = static_cast<float>(px[b + j]);
+                const auto y = static_cast<float>(py[b + j]);
+                const auto z = static_cast<float>(pz[b + j]);
+                const float lx = rot(0, 0) * x + rot(0, 1) * y +
+                                 rot(0, 2) * z + trans(0);
+                const float ly = rot(1, 0) * x + rot(1, 1) * y +
+                                 rot(1, 2) * z + trans(1);
+                const float lz = rot(2, 0) * x + rot(2, 1) * y +
+                                 rot(2, 2) * z + trans(2);
+                // elevation from the beam origin, azimuth from the origin;
+                // non-finite points fail the range checks of the second pass
+                const float rho = std::sqrt(lx * lx + ly * ly) - radius;
+                const float el = fast_atan2(lz - height, rho);
+                const float az = fast_atan2(ly, lx);
+                qx[j] = lx;
+                qy[j] = ly;
+                qz[j] = lz;
+                bin[j] = (el - el_min) * inv_el_bin;
+                col[j] = (2.0f * pi - az) * inv_az_res + 0.5f;
+                valid[j] = ((x != 0.0f) | (y != 0.0f) | (z != 0.0f)) &
+                           (rho > 0.0f);
+            }
+
+            for (std::ptrdiff_t j = 0; j < len; j++) {
+                if (!valid[j] || !(bin[j] >= 0.0f && bin[j] < n_bins))
+                    continue;
+                const std::ptrdiff_t u = el_rows_[static_cast<size_t>(bin[j])];
+
+                // staggered column, in [-w / 2, 3 w / 2) before wrapping;
+                // avoids integer division
+                const float c = col[j] + col_offset_[u];
+                if (!(std::abs(c) < 4.0f * w)) continue;
+                auto v = static_cast<std::ptrdiff_t>(std::floor(c));
+                while (v >= w) v -= w;
+                while (v < 0) v += w;
+
+                // range along the ray of the pixel
+                const float ec = enc_cos_[v], es = enc_sin_[v];
+                const float rc = ec * az_cos_[u] - es * az_sin_[u];
+                const float rs = es * az_cos_[u] + ec * az_sin_[u];
+                const float r = (qx[j] - radius * ec) * rc * alt_cos_[u] +
+                                (qy[j] - radius * es) * rs * alt_cos_[u] +
+                                (qz[j] - height) * alt_sin_[u] + distance;
+                const float mm = std::round(r * 1000.0f);
+                if (!(mm >= 1.0f && mm < 2147483648.0f)) continue;
+
+                // keep the nearest point, then the lowest index
+                const uint64_t key = static_cast<uint64_t>(mm) << 32 |
+                                     static_cast<uint64_t>(b + j);
+                std::atomic<uint64_t>& slot = zbuf[u * w + v];
+                uint64_t cur = slot.load(std::memory_order_relaxed);
+                while (key < cur &&
+                       !slot.compare_exchange_weak(cur, key,
+                                                   std::memory_order_relaxed))
+                    ;
+            }
+        }
+    }
+
+    uint32_t* rng = range.data();
+    uint32_t* idx = index.data();
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel for schedule(static)
+#endif
+    for (std::ptrdiff_t i = 0; i < n_pixels; i++) {
+        const uint64_t key = zbuf[i].load(std::memory_order_relaxed);
+        const bool hit = key != empty_pixel;
+        rng[i] = hit ? static_cast<uint32_t>(key >> 32) : 0;
+        idx[i] = hit ? static_cast<uint32_t>(key) : no_point;
+    }
+}
+
+void SphericalProjection::operator()(const PointsD& points,
+                                     Eigen::Ref<img_t<uint32_t>> range,
+                                     Eigen::Ref<img_t<uint32_t>> index) {
+    project(points, range, index);
+}
+
+void SphericalProjection::operator()(const PointsF& points,
+                                     Eigen::Ref<img_t<uint32_t>> range,
+                                     Eigen::Ref<img_t<uint32_t>> index) {
+    project(points, range, index);
+}
+
+void SphericalProjection::operator()(const PointsD& points, LidarScan& scan) {
+    index_.resize(h_, w_);
+    project(points, scan.field(ChanField::RANGE), index_);
+    n_points_ = points.rows();
+}
+
+void SphericalProjection::operator()(const PointsF& points, LidarScan& scan) {
+    index_.resize(h_, w_);
+    project(points, scan.field(ChanField::RANGE), index_);
+    n_points_ = points.rows();
+}
+
+void SphericalProjection::gather(const Eigen::Ref<const Eigen::ArrayXd>& values,
+                                 LidarScan& scan, ChanField field) const {
+    if (static_cast<size_t>(values.size()) != n_points_)
+        throw std::invalid_argument("expected a value for each point");
+    if (scan.h != h_ || scan.w != w_ || index_.rows() != h_)
+        throw std::invalid_argument("unexpected scan dimensions");
+    impl::visit_field(scan, field, gather_values(), values, index_);
+}
+
+const img_t<uint32_t>& SphericalProjection::index() const { return index_; }
+
+}  // namespace ouster
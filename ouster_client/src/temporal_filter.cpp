@@ -0,0 +1,121 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/temporal_filter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace ouster {
+
+using sensor::ChanField;
+using sensor::ChanFieldType;
+
+namespace {
+
+// pixels per block; K blocks of values fit comfortably in L1
+constexpr std::ptrdiff_t block = 256;
+
+// sort rows a and b of a block element-wise
+inline void compare_exchange(uint32_t* a, uint32_t* b) {
+    for (std::ptrdiff_t j = 0; j < block; j++) {
+        const uint32_t lo = std::min(a[j], b[j]);
+        const uint32_t hi = std::max(a[j], b[j]);
+        a[j] = lo;
+        b[j] = hi;
+    }
+}
+
+}  // namespace
+
+constexpr size_t TemporalFilter::max_scans;
+
+TemporalFilter::TemporalFilter(size_t w, size_t h, size_t k, double tolerance,
+                               double min_delta)
+    : w_{w},
+      h_{h},
+      k_{k},
+      tolerance_{static_cast<float>(tolerance)},
+      min_delta_{static_cast<uint32_t>(std::lround(min_delta * 1000.0))},
+      ring_(w * h * k) {
+    if (k == 0 || k > max_scans)
+        throw std::invalid_argument("unsupported number of scans");
+}
+
+void TemporalFilter::operator()(const Eigen::Ref<const img_t<uint32_t>>& range,
+                                Eigen::Ref<img_t<uint32_t>> filtered,
+                                Eigen::Ref<img_t<uint8_t>> noise) {
+    if (static_cast<size_t>(range.rows()) != h_ ||
+        static_cast<size_t>(range.cols()) != w_ ||
+        filtered.rows() != range.rows() || filtered.cols() != range.cols() ||
+        noise.rows() != range.rows() || noise.cols() != range.cols())
+        throw std::invalid_argument("unexpected image dimensions");
+
+    const std::ptrdiff_t n = w_ * h_;
+    const uint32_t* in = range.data();
+    uint32_t* out = filtered.data();
+    uint8_t* mask = noise.data();
+    uint32_t* ring = ring_.data();
+
+    const size_t slot = next_;
+    next_ = (next_ + 1) % k_;
+    count_ = std::min(count_ + 1, k_);
+    const std::ptrdiff_t m = count_;
+    const float tolerance = tolerance_;
+    const uint32_t min_delta = min_delta_;
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel for schedule(static)
+#endif
+    for (std::ptrdiff_t b = 0; b < n; b += block) {
+        const std::ptrdiff_t len = std::min(block, n - b);
+        uint32_t vals[max_scans * block];
+        uint32_t cur[block];
+
+        // read the block before writing outputs, which may alias the input
+        std::copy(in + b, in + b + len, cur);
+        std::fill(cur + len, cur + block, 0);
+        std::copy(cur, cur + len, ring + slot * n + b);
+        for (std::ptrdiff_t s = 0; s < m; s++) {
+            uint32_t* v = vals + s * block;
+            std::copy(ring + s * n + b, ring + s * n + b + len, v);
+            std::fill(v + len, v + block, 0);
+        }
+
+        // odd-even transposition sort: m rounds sort any m rows
+        for (std::ptrdiff_t round = 0; round < m; round++)
+            for (std::ptrdiff_t s = round % 2; s + 1 < m; s += 2)
+                compare_exchange(vals + s * block, vals + (s + 1) * block);
+
+        const uint32_t* med = vals + (m / 2) * block;
+        for (std::ptrdiff_t j = 0; j < len; j++) {
+            const uint32_t r = cur[j];
+            const uint32_t d = r > med[j] ? r - med[j] : med[j] - r;
+            const uint32_t tol = std::max(
+                min_delta, static_cast<uint32_t>(tolerance * med[j]));
+            mask[b + j] = (r != 0) & (d > tol);
+            out[b + j] = med[j];
+        }
+    }
+}
+
+void TemporalFilter::operator()(LidarScan& scan, ChanField filtered_field,
+                                ChanField mask_field) {
+    if (scan.field_type(filtered_field) != ChanFieldType::UINT32)
+        throw std::invalid_argument("filtered range field must be UINT32");
+    if (scan.field_type(mask_field) != ChanFieldType::UINT8)
+        throw std::invalid_argument("noise mask field must be UINT8");
+    operator()(scan.field(ChanField::RANGE),
+               scan.field<uint32_t>(filtered_field),
+               scan.field<uint8_t>(mask_field));
+}
+
+void TemporalFilter::reset() {
+    next_ = 0;
+    count_ = 0;
+}
+
+}  // namespace ouster
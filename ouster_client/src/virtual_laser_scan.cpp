@@ -0,0 +1,189 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/virtual_laser_scan.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#include <omp.h>
+#endif
+
+namespace ouster {
+
+namespace {
+
+// value of pixels without a return to keep; finite, so that it can be
+// selected arithmetically
+constexpr float no_return = std::numeric_limits<float>::max();
+
+}  // namespace
+
+VirtualLaserScan::VirtualLaserScan(const XYZLut& lut, size_t w, size_t h,
+                                   size_t n_bins, double z_min, double z_max,
+                                   const std::vector<size_t>& beams,
+                                   double range_min, double range_max)
+    : w_{w}, h_{h}, n_bins_{n_bins ? n_bins : w} {
+    const size_t n = w * h;
+    if (n == 0 || static_cast<size_t>(lut.direction.rows()) != n ||
+        static_cast<size_t>(lut.offset.rows()) != n)
+        throw std::invalid_argument("unexpected scan dimensions");
+    if (!(z_max >= z_min) || !(range_max >= range_min))
+        throw std::invalid_argument("empty laser scan bounds");
+
+    std::vector<bool> selected(h, beams.empty());
+    for (size_t b : beams) {
+        if (b >= h) throw std::invalid_argument("beam index out of range");
+        selected[b] = true;
+    }
+
+    range_lo_.resize(n);
+    range_hi_.resize(n);
+    slope_.resize(n);
+    offset_.resize(n);
+    bin_.resize(n);
+
+    // raw ranges fit in 32 bits; clamping keeps the float conversions finite
+    const double max_raw = 4294967296.0;
+    const double inv_increment = n_bins_ / (2.0 * M_PI);
+    const auto n_bins_i = static_cast<long>(n_bins_);
+
+    for (size_t u = 0; u < h; u++) {
+        bool active = false;
+        for (size_t v = 0; v < w; v++) {
+            const size_t i = u * w + v;
+            const double dx = lut.direction(i, 0), dy = lut.direction(i, 1);
+            const double dz = lut.direction(i, 2);
+            const double ox = lut.offset(i, 0), oy = lut.offset(i, 1);
+            const double oz = lut.offset(i, 2);
+
+            // the horizontal distance is the distance along the horizontal
+            // part of the ray, up to the tiny offset across it
+            const double hs = std::hypot(dx, dy);
+            const double ho = hs > 0.0 ? (ox * dx + oy * dy) / hs : 0.0;
+
+            // a zero range is no return
+            double lo = 0.5, hi = max_raw;
+            bool empty = !selected[u] || hs == 0.0;
+            if (dz > 0.0) {
+                lo = std::max(lo, (z_min - oz) / dz);
+                hi = std::min(hi, (z_max - oz) / dz);
+            } else if (dz < 0.0) {
+                lo = std::max(lo, (z_max - oz) / dz);
+                hi = std::min(hi, (z_min - oz) / dz);
+            } else {
+                empty |= oz < z_min || oz > z_max;
+            }
+            if (!empty) {
+                lo = std::max(lo, (range_min - ho) / hs);
+                hi = std::min(hi, (range_max - ho) / hs);
+            }
+            empty |= !(lo <= hi);
+
+            range_lo_[i] = empty ? static_cast<float>(max_raw)
+                                 : static_cast<float>(std::min(lo, max_raw));
+            range_hi_[i] = empty ? 0.0f : static_cast<float>(std::max(hi, 0.0));
+            slope_[i] = static_cast<float>(hs);
+            offset_[i] = static_cast<float>(ho);
+            active |= !empty;
+
+            const long b = std::lround(std::atan2(dy, dx) * inv_increment);
+            bin_[i] =
+                static_cast<uint32_t>((b % n_bins_i + n_bins_i) % n_bins_i);
+        }
+        if (active) rows_.push_back(u);
+    }
+}
+
+size_t VirtualLaserScan::n_bins() const { return n_bins_; }
+
+double VirtualLaserScan::angle_increment() const {
+    return 2.0 * M_PI / n_bins_;
+}
+
+void VirtualLaserScan::operator()(
+    const Eigen::Ref<const img_t<uint32_t>>& range,
+    Eigen::Ref<Eigen::ArrayXf> ranges) {
+    if (static_cast<size_t>(range.rows()) != h_ ||
+        static_cast<size_t>(range.cols()) != w_)
+        throw std::invalid_argument("unexpected image dimensions");
+    if (static_cast<size_t>(ranges.size()) != n_bins_)
+        throw std::invalid_argument("unexpected laser scan size");
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+    const int n_threads = omp_get_max_threads();
+#else
+    const int n_threads = 1;
+#endif
+    const std::ptrdiff_t w = w_;
+    const std::ptrdiff_t nb = n_bins_;
+    const auto n_rows = static_cast<std::ptrdiff_t>(rows_.size());
+    values_.resize(n_threads * w);
+    bins_.assign(n_threads * nb, no_return);
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel num_threads(n_threads)
+#endif
+    {
+#ifdef __OUSTER_UTILIZE_OPENMP__
+        const int t = omp_get_thread_num();
+#else
+        const int t = 0;
+#endif
+        float* val = values_.data() + t * w;
+        float* acc = bins_.data() + t * nb;
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp for schedule(static)
+#endif
+        for (std::ptrdiff_t k = 0; k < n_rows; k++) {
+            const std::ptrdiff_t i0 = rows_[k] * w;
+            const uint32_t* rng = range.row(rows_[k]).data();
+            const float* lo = range_lo_.data() + i0;
+            const float* hi = range_hi_.data() + i0;
+            const float* slope = slope_.data() + i0;
+            const float* offset = offset_.data() + i0;
+            const uint32_t* bin = bin_.data() + i0;
+
+            // horizontal distances of the returns to keep, no_return for
+            // the others; selected in arithmetic with the comparisons
+            // combined as integers so that the loop vectorizes. Ranges fit
+            // in 31 bits and the signed conversion vectorizes
+            for (std::ptrdiff_t v = 0; v < w; v++) {
+                const auto r = static_cast<float>(static_cast<int32_t>(rng[v]));
+                const auto keep =
+                    static_cast<float>(static_cast<int>(r >= lo[v]) &
+                                       static_cast<int>(r <= hi[v]));
+                val[v] = keep * (slope[v] * r + offset[v]) +
+                         (1.0f - keep) * no_return;
+            }
+            for (std::ptrdiff_t v = 0; v < w; v++)
+                acc[bin[v]] = std::min(acc[bin[v]], val[v]);
+        }
+    }
+
+    const float inf = std::numeric_limits<float>::infinity();
+    for (std::ptrdiff_t b = 0; b < nb; b++) {
+        float m = bins_[b];
+        for (int t = 1; t < n_threads; t++) m = std::min(m, bins_[t * nb + b]);
+        ranges[b] = m < no_return ? m : inf;
+    }
+}
+
+void VirtualLaserScan::operator()(const LidarScan& scan,
+                                  Eigen::Ref<Eigen::ArrayXf> ranges) {
+    operator()(scan.field(sensor::ChanField::RANGE), ranges);
+}
+
+Eigen::ArrayXf VirtualLaserScan::operator()(const LidarScan& scan) {
+    Eigen::ArrayXf ranges(n_bins_);
+    operator()(scan, ranges);
+    return ranges;
+}
+
+}  // namespace ouster
@@ -0,0 +1,331 @@
+/**
+ * Copyright (c) 2023, Ouster, Inc.
+ * All rights reserved.
+ */
+
+#include "ouster_client/voxel_grid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "ouster_client/impl/lidar_scan_impl.h"
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#include <omp.h>
+#endif
+
+namespace ouster {
+
+namespace {
+
+constexpr uint64_t empty_key = ~uint64_t{0};
+
+// voxel coordinates are packed into 21 bits each
+constexpr int64_t key_bias = int64_t{1} << 20;
+constexpr uint64_t key_mask = (uint64_t{1} << 21) - 1;
+
+size_t next_pow2(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+// std::floor may compile to a library call without SSE4.1
+inline int64_t fast_floor(float v) {
+    const auto i = static_cast<int64_t>(v);
+    return i - (v < i);
+}
+
+inline uint64_t voxel_key(float x, float y, float z, float inv_leaf) {
+    const auto ix = fast_floor(x * inv_leaf) + key_bias;
+    const auto iy = fast_floor(y * inv_leaf) + key_bias;
+    const auto iz = fast_floor(z * inv_leaf) + key_bias;
+    return (static_cast<uint64_t>(ix) & key_mask) |
+           ((static_cast<uint64_t>(iy) & key_mask) << 21) |
+           ((static_cast<uint64_t>(iz) & key_mask) << 42);
+}
+
+inline uint64_t hash_key(uint64_t k) {
+    // splitmix64 finalizer
+    k ^= k >> 30;
+    k *= 0xbf58476d1ce4e5b9ull;
+    k ^= k >> 27;
+    k *= 0x94d049bb133111ebull;
+    k ^= k >> 31;
+    return k;
+}
+
+/*
+ * Open addressing table of voxel accumulators with linear probing. Slots are
+ * kept to half a cache line; averaged fields live in a parallel array. Storage
+ * only ever grows; reset() clears the prefix in use for the current frame and
+ * the table doubles whenever it becomes three quarters full.
+ */
+struct VoxelSlot {
+    uint64_t key;
+    uint32_t count;
+    uint32_t first;
+    float sum[3];
+    uint32_t pad;
+};
+
+struct VoxelTable {
+    size_t mask{0};
+    size_t n_fields{0};
+    size_t size{0};
+    std::vector<VoxelSlot> slots;
+    std::vector<float> fsums;  // n_fields per slot
+
+    // most recently used slot; consecutive pixels often share a voxel
+    uint64_t last_key{empty_key};
+    size_t last_slot{0};
+
+    void reset(size_t expected, size_t nf) {
+        const size_t cap = next_pow2(expected + expected / 2 + 1);
+        mask = cap - 1;
+        n_fields = nf;
+        size = 0;
+        last_key = empty_key;
+        if (slots.size() < cap) slots.resize(cap);
+        if (fsums.size() < nf * cap) fsums.resize(nf * cap);
+        for (size_t s = 0; s < cap; s++) slots[s].key = empty_key;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    void grow() {
+        const size_t old_cap = capacity();
+        std::vector<VoxelSlot> old_slots(slots.begin(),
+                                         slots.begin() + old_cap);
+        std::vector<float> old_fsums(fsums.begin(),
+                                     fsums.begin() + n_fields * old_cap);
+        reset(old_cap, n_fields);
+        for (size_t s = 0; s < old_cap; s++) {
+            if (old_slots[s].key == empty_key) continue;
+            const size_t h = insert(old_slots[s].key);
+            slots[h] = old_slots[s];
+            for (size_t f = 0; f < n_fields; f++)
+                fsums[n_fields * h + f] = old_fsums[n_fields * s + f];
+        }
+    }
+
+    // find or insert the slot for key, initializing new accumulators
+    inline size_t insert(uint64_t key) {
+        size_t h = hash_key(key) & mask;
+        while (slots[h].key != key) {
+            if (slots[h].key == empty_key) {
+                VoxelSlot& slot = slots[h];
+                slot.key = key;
+                slot.count = 0;
+                slot.first = UINT32_MAX;
+                slot.sum[0] = slot.sum[1] = slot.sum[2] = 0.0f;
+                for (size_t f = 0; f < n_fields; f++)
+                    fsums[n_fields * h + f] = 0.0f;
+                size++;
+                break;
+            }
+            h = (h + 1) & mask;
+        }
+        return h;
+    }
+
+    inline size_t slot(uint64_t key) {
+        if (key == last_key) return last_slot;
+        if (4 * (size + 1) > 3 * capacity()) grow();
+        last_key = key;
+        last_slot = insert(key);
+        return last_slot;
+    }
+
+    inline void add(uint64_t key, uint32_t px, float x, float y, float z,
+                    const float* const* fields) {
+        const size_t h = slot(key);
+        VoxelSlot& slot = slots[h];
+        slot.count++;
+        slot.first = std::min(slot.first, px);
+        slot.sum[0] += x;
+        slot.sum[1] += y;
+        slot.sum[2] += z;
+        for (size_t f = 0; f < n_fields; f++)
+            fsums[n_fields * h + f] += fields[f][px];
+    }
+
+    void merge(const VoxelTable& o) {
+        for (size_t s = 0; s < o.capacity(); s++) {
+            const VoxelSlot& src = o.slots[s];
+            if (src.key == empty_key) continue;
+            const size_t h = slot(src.key);
+            VoxelSlot& dst = slots[h];
+            dst.count += src.count;
+            dst.first = std::min(dst.first, src.first);
+            for (int k = 0; k < 3; k++) dst.sum[k] += src.sum[k];
+            for (size_t f = 0; f < n_fields; f++)
+                fsums[n_fields * h + f] += o.fsums[n_fields * s + f];
+        }
+    }
+};
+
+}  // namespace
+
+struct VoxelGrid::Impl {
+    float inv_leaf;
+    VoxelGridMode mode;
+    std::vector<sensor::ChanField> fields;
+
+    std::vector<VoxelTable> tables;  // one per thread
+    VoxelTable merged;
+    size_t last_size{0};  // voxels in the previous frame, to size tables
+    std::vector<img_t<float>> field_imgs;
+    std::vector<const float*> field_ptrs;
+
+    /*
+     * Bin all points i in [0, n) for which valid(i) holds, reading positions
+     * with pos(i, x, y, z), then emit one point per voxel.
+     */
+    template <typename VALID, typename POS>
+    void run(size_t n, VALID&& valid, POS&& pos, VoxelCloud& out);
+};
+
+template <typename VALID, typename POS>
+void VoxelGrid::Impl::run(size_t n, VALID&& valid, POS&& pos,
+                          VoxelCloud& out) {
+    const size_t nf = field_ptrs.size();
+    const float* const* fptrs = field_ptrs.data();
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+    const int n_threads = omp_get_max_threads();
+#else
+    const int n_threads = 1;
+#endif
+    if (tables.size() < static_cast<size_t>(n_threads))
+        tables.resize(n_threads);
+
+#ifdef __OUSTER_UTILIZE_OPENMP__
+#pragma omp parallel num_threads(n_threads)
+#endif
+    {
+#ifdef __OUSTER_UTILIZE_OPENMP__
+        const int t = omp_get_thread_num();
+#else
+        const int t = 0;
+#endif
+        const size_t begin = n * t / n_threads;
+        const size_t end = n * (t + 1) / n_threads;
+
+        // size by the previous frame; tables grow if the scene changed
+        const size_t expected =
+            last_size ? last_size / n_threads + 1 : (end - begin) / 4;
+
+        VoxelTable& table = tables[t];
+        table.reset(expected, nf);
+        float x, y, z;
+        for (size_t i = begin; i < end; i++) {
+            if (!valid(i)) continue;
+            pos(i, x, y, z);
+            table.add(voxel_key(x, y, z, inv_leaf), static_cast<uint32_t>(i),
+                      x, y, z, fptrs);
+        }
+    }
+
+    const VoxelTable* result = &tables[0];
+    if (n_threads > 1) {
+        size_t total = 0;
+        for (int t = 0; t < n_threads; t++) total += tables[t].size;
+        merged.reset(total, nf);
+        for (int t = 0; t < n_threads; t++) merged.merge(tables[t]);
+        result = &merged;
+    }
+
+    const size_t m = result->size;
+    last_size = m;
+    out.points.resize(m, 3);
+    out.fields.resize(m, nf);
+    out.counts.resize(m);
+    out.pixels.resize(m);
+
+    size_t j = 0;
+    for (size_t s = 0; s < result->capacity(); s++) {
+        const VoxelSlot& slot = result->slots[s];
+        if (slot.key == empty_key) continue;
+        const uint32_t c = slot.count;
+        const float inv_c = 1.0f / c;
+        const uint32_t first = slot.first;
+        out.counts(j) = c;
+        out.pixels(j) = first;
+        if (mode == VOXEL_FIRST_POINT) {
+            float x, y, z;
+            pos(first, x, y, z);
+            out.points(j, 0) = x;
+            out.points(j, 1) = y;
+            out.points(j, 2) = z;
+        } else {
+            for (int k = 0; k < 3; k++)
+                out.points(j, k) = slot.sum[k] * inv_c;
+        }
+        for (size_t f = 0; f < nf; f++)
+            out.fields(j, f) = result->fsums[nf * s + f] * inv_c;
+        j++;
+    }
+}
+
+VoxelGrid::VoxelGrid(double leaf_size, VoxelGridMode mode,
+                     std::vector<sensor::ChanField> fields)
+    : impl_{new Impl{}} {
+    if (!(leaf_size > 0.0))
+        throw std::invalid_argument("voxel leaf size must be positive");
+    impl_->inv_leaf = static_cast<float>(1.0 / leaf_size);
+    impl_->mode = mode;
+    impl_->fields = std::move(fields);
+}
+
+VoxelGrid::~VoxelGrid() = default;
+
+void VoxelGrid::operator()(const LidarScan& scan, const XYZLut& lut,
+                           VoxelCloud& out) {
+    const auto range = scan.field(sensor::ChanField::RANGE);
+    const size_t n = range.size();
+    if (static_cast<size_t>(lut.direction.rows()) != n)
+        throw std::invalid_argument("unexpected image dimensions");
+
+    auto& imgs = impl_->field_imgs;
+    imgs.resize(impl_->fields.size());
+    impl_->field_ptrs.clear();
+    for (size_t f = 0; f < impl_->fields.size(); f++) {
+        impl::visit_field(scan, impl_->fields[f], impl::read_and_cast(),
+                          imgs[f]);
+        impl_->field_ptrs.push_back(imgs[f].data());
+    }
+
+    const uint32_t* rng = range.data();
+    const double* dir = lut.direction.data();
+    const double* ofs = lut.offset.data();
+    auto pos = [=](size_t i, float& x, float& y, float& z) {
+        const double r = rng[i];
+        x = static_cast<float>(r * dir[i] + ofs[i]);
+        y = static_cast<float>(r * dir[n + i] + ofs[n + i]);
+        z = static_cast<float>(r * dir[2 * n + i] + ofs[2 * n + i]);
+    };
+    auto valid = [=](size_t i) { return rng[i] != 0; };
+
+    impl_->run(n, valid, pos, out);
+}
+
+void VoxelGrid::operator()(const LidarScan::Points& points, VoxelCloud& out) {
+    impl_->field_ptrs.clear();
+
+    const size_t n = points.rows();
+    const double* p = points.data();
+    auto pos = [=](size_t i, float& x, float& y, float& z) {
+        x = static_cast<float>(p[i]);
+        y = static_cast<float>(p[n + i]);
+        z = static_cast<float>(p[2 * n + i]);
+    };
+    auto valid = [=](size_t i) {
+        return p[i] != 0.0 || p[n + i] != 0.0 || p[2 * n + i] != 0.0;
+    };
+
+    impl_->run(n, valid, pos, out);
+}
+
+}  // namespace ouster
@@ -79,6 +79,7 @@ struct IndexedPcapReader : public PcapReader {
     static bool frame_id_rolled_over(uint16_t previous, uint16_t current);
 
     std::vector<ouster::sensor::sensor_info> sensor_infos_;         ///< A vector of sensor_info that correspond to the provided metadata files
+    std::vector<const ouster::sensor::packet_format*> packet_formats_;  ///< interned packet format of each sensor, resolved once
     std::shared_ptr<stream_info> stream_info_;                      ///< TODO: move to parent class
     std::vector<frame_index> frame_indices_;                        ///< frame index for each sensor
     std::vector<nonstd::optional<uint16_t>> previous_frame_ids_;  ///< previous frame id for each sensor
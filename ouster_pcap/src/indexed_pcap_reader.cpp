@@ -15,11 +15,12 @@ IndexedPcapReader::IndexedPcapReader(
         sensor_infos_.push_back(
             ouster::sensor::metadata_from_json(metadata_filename)
         );
+        packet_formats_.push_back(&ouster::sensor::get_format(sensor_infos_.back()));
     }
     stream_info_ = ouster::sensor_utils::get_stream_info(*this, progress_callback, 256, -1);
     if(sensor_infos_.size() == 1 && sensor_infos_[0].udp_port_lidar == 0) {
         // guess lidar port for a single sensor if it is unspecified in sensor info
-        const ouster::sensor::packet_format& pf = ouster::sensor::packet_format(sensor_infos_[0]);
+        const ouster::sensor::packet_format& pf = *packet_formats_[0];
         std::vector<guessed_ports> ports = guess_ports(
             *stream_info_,
             pf.lidar_packet_size, pf.imu_packet_size,
@@ -47,10 +48,7 @@ nonstd::optional<size_t> IndexedPcapReader::sensor_idx_for_current_packet() cons
 
 nonstd::optional<uint16_t> IndexedPcapReader::current_frame_id() const {
     if(nonstd::optional<size_t> sensor_idx = sensor_idx_for_current_packet()) {
-        const ouster::sensor::packet_format& pf = ouster::sensor::packet_format(
-            sensor_infos_[*sensor_idx]
-        );
-        return pf.frame_id(current_data());
+        return packet_formats_[*sensor_idx]->frame_id(current_data());
     }
     return nonstd::nullopt;
 }
@@ -62,14 +60,13 @@ bool IndexedPcapReader::frame_id_rolled_over(uint16_t previous, uint16_t current
 
 void IndexedPcapReader::update_index_for_current_packet() {
     if(nonstd::optional<size_t> sensor_info_idx = sensor_idx_for_current_packet()) {
-        if(nonstd::optional<uint16_t> frame_id = current_frame_id()) {
-            if(!previous_frame_ids_[*sensor_info_idx]
-                || *previous_frame_ids_[*sensor_info_idx] < *frame_id  // frame_id is greater than previous
-                || frame_id_rolled_over(*previous_frame_ids_[*sensor_info_idx], *frame_id)
-            ) {
-                frame_indices_[*sensor_info_idx].push_back(current_info().file_offset);
-                previous_frame_ids_[*sensor_info_idx] = *frame_id;
-            }
+        const uint16_t frame_id = packet_formats_[*sensor_info_idx]->frame_id(current_data());
+        if(!previous_frame_ids_[*sensor_info_idx]
+            || *previous_frame_ids_[*sensor_info_idx] < frame_id  // frame_id is greater than previous
+            || frame_id_rolled_over(*previous_frame_ids_[*sensor_info_idx], frame_id)
+        ) {
+            frame_indices_[*sensor_info_idx].push_back(current_info().file_offset);
+            previous_frame_ids_[*sensor_info_idx] = frame_id;
         }
     }
 }
@@ -130,7 +130,8 @@ class PointViz {
     /**
      * Update visualization state
      *
-     * Send state updates to be rendered on the next frame
+     * Send state updates to be rendered on the next frame. State is copied
+     * without waiting for a frame being drawn.
      *
      * @return whether state was successfully sent. If not, will be sent on next
      *         call to update(). This can happen if update() is called more
@@ -277,6 +277,48 @@ static const std::string image_fragment_shader_code =
                 color = vec4((m.rgb * m.a + img_color * (1.0 - m.a)) / color_a, color_a);
             })SHADER";
 
+/*
+ * Labels are batched: vertices of all glyph quads carry the label anchor and
+ * the offset of the vertex from it in text units, already scaled by scale.
+ * 3D labels face the camera: billboard maps offsets in view space to clip
+ * space. 2D anchors are relative to the viewport, with y pointing down.
+ */
+static const std::string label_vertex_shader_code =
+    R"SHADER(
+            #version 330 core
+            in vec3 anchor;
+            in vec2 offset;
+            in vec2 glyph_uv;
+            in vec4 glyph_rgba;
+            in vec2 scale_3d;
+            uniform mat4 proj_view;
+            uniform mat4 billboard;
+            uniform vec2 viewport;
+            out vec2 uv;
+            out vec4 rgba;
+            void main() {
+                vec2 d = offset * scale_3d.x;
+                if (scale_3d.y > 0.5) {
+                    gl_Position = proj_view * vec4(anchor, 1.0) +
+                                  billboard * vec4(d, 0.0, 0.0);
+                } else {
+                    vec2 p = (anchor.xy * viewport + d) / viewport;
+                    gl_Position = vec4(2.0 * p.x - 1.0, 1.0 - 2.0 * p.y, 0, 1);
+                }
+                uv = glyph_uv;
+                rgba = glyph_rgba;
+            })SHADER";
+static const std::string label_fragment_shader_code =
+    R"SHADER(
+            #version 330 core
+            in vec2 uv;
+            in vec4 rgba;
+            uniform sampler2D atlas;
+            out vec4 color;
+            void main() {
+                color = texture(atlas, uv) * rgba;
+            })SHADER";
+
 }  // namespace impl
 }  // namespace viz
 }  // namespace ouster
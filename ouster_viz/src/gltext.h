@@ -7,6 +7,7 @@
 // Modified from the original for use in ouster_viz:
 // - inline api functions to avoid unused warnings
 // - hacked to always initialize on gltInit
+// - access to the font texture and text vertices for batched drawing
 
 // In one C or C++ file, define GLT_IMPLEMENTATION prior to inclusion to create
 // the implementation.
@@ -143,6 +144,11 @@ GLT_API GLfloat gltGetLineHeight(GLfloat scale);
 GLT_API GLfloat gltGetTextWidth(const GLTtext* text, GLfloat scale);
 GLT_API GLfloat gltGetTextHeight(const GLTtext* text, GLfloat scale);
 
+GLT_API GLuint gltGetFontTexture(void);
+GLT_API GLsizei gltCountTextVertices(const char* str);
+GLT_API GLsizei gltTextVertices(const char* str, GLfloat* vertices);
+GLT_API GLfloat gltGetStringWidth(const char* str, GLfloat scale);
+
 GLT_API GLboolean gltIsCharacterSupported(const char c);
 GLT_API GLint gltCountSupportedCharacters(const char* str);
 
@@ -498,12 +504,8 @@ GLT_API void gltGetColor(GLfloat* r, GLfloat* g, GLfloat* b, GLfloat* a) {
     if (a) (*a) = color[3];
 }
 
-GLT_API GLfloat gltGetLineHeight(GLfloat scale) {
-    return (GLfloat)_gltFontGlyphHeight * scale;
-}
-
-GLT_API GLfloat gltGetTextWidth(const GLTtext* text, GLfloat scale) {
-    if (!text || !text->_text) return 0.0f;
+GLT_API GLfloat gltGetStringWidth(const char* str, GLfloat scale) {
+    if (!str) return 0.0f;
 
     GLfloat maxWidth = 0.0f;
     GLfloat width = 0.0f;
@@ -512,8 +514,8 @@ GLT_API GLfloat gltGetTextWidth(const GLTtext* text, GLfloat scale) {
 
     char c;
     int i;
-    for (i = 0; i < text->_textLength; i++) {
-        c = text->_text[i];
+    for (i = 0; str[i] != '\0'; i++) {
+        c = str[i];
 
         if ((c == '\n') || (c == '\r')) {
             if (width > maxWidth) maxWidth = width;
@@ -542,6 +544,16 @@ GLT_API GLfloat gltGetTextWidth(const GLTtext* text, GLfloat scale) {
     return maxWidth * scale;
 }
 
+GLT_API GLfloat gltGetLineHeight(GLfloat scale) {
+    return (GLfloat)_gltFontGlyphHeight * scale;
+}
+
+GLT_API GLfloat gltGetTextWidth(const GLTtext* text, GLfloat scale) {
+    if (!text || !text->_text) return 0.0f;
+
+    return gltGetStringWidth(text->_text, scale);
+}
+
 GLT_API GLfloat gltGetTextHeight(const GLTtext* text, GLfloat scale) {
     if (!text || !text->_text) return 0.0f;
 
@@ -648,23 +660,45 @@ GLT_API void _gltUpdateBuffers(GLTtext* text) {
         return;
     }
 
-    const GLsizei countDrawable = gltCountDrawableCharacters(text->_text);
+    const GLsizei vertexCount = gltCountTextVertices(text->_text);
 
-    if (!countDrawable) {
+    if (!vertexCount) {
         text->_dirty = GL_FALSE;
         return;
     }
 
-    const GLsizei vertexCount =
-        countDrawable * 2 *
-        3;  // 3 vertices in a triangle, 2 triangles in a quad
-
     const GLsizei vertexSize = _GLT_TEXT2D_VERTEX_SIZE;
     GLfloat* vertices =
         (GLfloat*)malloc(vertexCount * vertexSize * sizeof(GLfloat));
 
     if (!vertices) return;
 
+    gltTextVertices(text->_text, vertices);
+
+    text->vertexCount = vertexCount;
+    text->_vertices = vertices;
+
+    glBindBuffer(GL_ARRAY_BUFFER, text->_vbo);
+    glBufferData(GL_ARRAY_BUFFER,
+                 vertexCount * _GLT_TEXT2D_VERTEX_SIZE * sizeof(GLfloat),
+                 vertices, GL_DYNAMIC_DRAW);
+
+    text->_dirty = GL_FALSE;
+}
+
+GLT_API GLuint gltGetFontTexture(void) { return _gltText2DFontTexture; }
+
+GLT_API GLsizei gltCountTextVertices(const char* str) {
+    // 3 vertices in a triangle, 2 triangles in a quad
+    return gltCountDrawableCharacters(str) * 2 * 3;
+}
+
+// Writes the vertices of the glyph quads of a string, in text units and with
+// y pointing down, as position and texture coordinates. Returns the number of
+// vertices written, at most gltCountTextVertices(str)
+GLT_API GLsizei gltTextVertices(const char* str, GLfloat* vertices) {
+    if (!str || !vertices) return 0;
+
     GLsizei vertexElementIndex = 0;
 
     GLfloat glyphX = 0.0f;
@@ -680,8 +714,8 @@ GLT_API void _gltUpdateBuffers(GLTtext* text) {
 
     char c;
     int i;
-    for (i = 0; i < text->_textLength; i++) {
-        c = text->_text[i];
+    for (i = 0; str[i] != '\0'; i++) {
+        c = str[i];
 
         if (c == '\n') {
             glyphX = 0.0f;
@@ -742,15 +776,7 @@ GLT_API void _gltUpdateBuffers(GLTtext* text) {
         glyphX += glyphWidth + glyphAdvanceX;
     }
 
-    text->vertexCount = vertexCount;
-    text->_vertices = vertices;
-
-    glBindBuffer(GL_ARRAY_BUFFER, text->_vbo);
-    glBufferData(GL_ARRAY_BUFFER,
-                 vertexCount * _GLT_TEXT2D_VERTEX_SIZE * sizeof(GLfloat),
-                 vertices, GL_DYNAMIC_DRAW);
-
-    text->_dirty = GL_FALSE;
+    return vertexElementIndex / _GLT_TEXT2D_VERTEX_SIZE;
 }
 
 GLT_API GLboolean gltInit(void) {
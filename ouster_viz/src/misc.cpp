@@ -7,6 +7,7 @@
 
 #include <Eigen/Core>
 #include <Eigen/Geometry>
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <stdexcept>
@@ -240,19 +241,104 @@ void GLCuboid::endDraw() {
 /*
  * Label3d
  */
-GLLabel::GLLabel() : gltext{gltCreateText()}, text_position{0, 0, 0} {
-    assert(gltext != GLT_NULL);
-}
+bool GLLabel::initialized = false;
+GLuint GLLabel::label_program_id;
+GLuint GLLabel::label_anchor_id;
+GLuint GLLabel::label_offset_id;
+GLuint GLLabel::label_uv_id;
+GLuint GLLabel::label_rgba_id;
+GLuint GLLabel::label_scale_3d_id;
+GLuint GLLabel::label_proj_view_id;
+GLuint GLLabel::label_billboard_id;
+GLuint GLLabel::label_viewport_id;
+GLuint GLLabel::label_atlas_id;
+
+GLuint GLLabel::vertex_buffer{0};
+size_t GLLabel::buffer_size{0};
+std::vector<GLfloat> GLLabel::vertices;
+std::vector<std::pair<const GLLabel*, size_t>> GLLabel::slots;
+
+size_t GLLabel::n_slots{0};
+size_t GLLabel::n_floats{0};
+size_t GLLabel::dirty_begin{0};
+size_t GLLabel::dirty_end{0};
+bool GLLabel::shifted{false};
+Eigen::Matrix4f GLLabel::proj_view;
+Eigen::Matrix4f GLLabel::billboard;
+std::array<GLfloat, 2> GLLabel::viewport;
+
+namespace {
+
+// floats per vertex: anchor, offset, uv, rgba, scale and whether 3d
+constexpr size_t label_vertex_size = 3 + 2 + 2 + 4 + 2;
+
+// floats per vertex of glText: position and uv
+constexpr size_t glt_vertex_size = 4;
+
+}  // namespace
+
+GLLabel::GLLabel()
+    : text_position{0, 0, 0},
+      is_3d{false},
+      scale{1},
+      halign{GLT_LEFT},
+      valign{GLT_BOTTOM},
+      rgba{1, 1, 1, 1} {}
 
 // for Indexed<T, U>
 GLLabel::GLLabel(const Label&) : GLLabel{} {}
 
-GLLabel::~GLLabel() { gltDeleteText(gltext); }
+void GLLabel::update_vertices() {
+    std::vector<GLfloat> glyphs(gltCountTextVertices(text.c_str()) *
+                                glt_vertex_size);
+    const size_t n = gltTextVertices(text.c_str(), glyphs.data());
+
+    // same placement as gltDrawText() with the model of 3d labels, and as
+    // gltDrawText2DAligned() for 2d labels
+    GLfloat dx = 0, dy = 0, flip = 1, s = scale;
+    if (is_3d) {
+        // text rendered +z direction, needs to be flipped
+        flip = -1;
+        // scale text, could make this configurable
+        s *= 0.02f;
+    } else {
+        const GLfloat width = gltGetStringWidth(text.c_str(), 1);
+        const GLfloat height =
+            (gltCountNewLines(text.c_str()) + 1) * gltGetLineHeight(1);
+        if (halign == GLT_RIGHT) dx = -width;
+        if (valign == GLT_BOTTOM) dy = -height;
+#ifdef __APPLE__
+        // TODO: maybe try turning GLFW_COCOA_RETINA_FRAMEBUFFER off
+        // TODO[pb]: Also we can start using GLFW window_content_scale for this
+        s *= 2.0f;
+#endif
+    }
+
+    label_vertices.resize(n * label_vertex_size);
+    GLfloat* v = label_vertices.data();
+    for (size_t i = 0; i < n; i++, v += label_vertex_size) {
+        const GLfloat* g = glyphs.data() + i * glt_vertex_size;
+        v[0] = static_cast<GLfloat>(text_position.x());
+        v[1] = static_cast<GLfloat>(text_position.y());
+        v[2] = static_cast<GLfloat>(text_position.z());
+        v[3] = g[0] + dx;
+        v[4] = flip * (g[1] + dy);
+        v[5] = g[2];
+        v[6] = g[3];
+        std::copy(rgba.begin(), rgba.end(), v + 7);
+        v[11] = s;
+        v[12] = is_3d ? 1.0f : 0.0f;
+    }
+}
 
 void GLLabel::draw(const WindowCtx& ctx, const CameraData& camera,
                    Label& label) {
+    if (!GLLabel::initialized)
+        throw std::logic_error("GLLabel not initialized");
+
     if (label.text_changed_) {
-        gltSetText(gltext, label.text_.c_str());
+        text = label.text_;
+        vertices_changed = true;
         label.text_changed_ = false;
     }
 
@@ -262,58 +348,145 @@ void GLLabel::draw(const WindowCtx& ctx, const CameraData& camera,
         is_3d = label.is_3d_;
         halign = label.align_right_ ? GLT_RIGHT : GLT_LEFT;
         valign = label.align_top_ ? GLT_TOP : GLT_BOTTOM;
+        vertices_changed = true;
         label.pos_changed_ = false;
     }
 
     if (label.scale_changed_) {
         scale = label.scale_;
+        vertices_changed = true;
         label.scale_changed_ = false;
     }
 
     if (label.rgba_changed_) {
         rgba = label.rgba_;
+        vertices_changed = true;
         label.rgba_changed_ = false;
     }
 
-    gltColor(rgba[0], rgba[1], rgba[2], rgba[3]);
+    if (vertices_changed) update_vertices();
+
+    // camera and viewport are the same for all labels of a frame
+    if (n_slots == 0) {
+        const Eigen::Matrix4d pvt = camera.proj * camera.view * camera.target;
+        // make text face the camera
+        Eigen::Matrix4d facing = Eigen::Matrix4d::Zero();
+        facing.block<3, 3>(0, 0) = camera.view.block<3, 3>(0, 0).inverse();
+        proj_view = pvt.cast<float>();
+        billboard = (pvt * facing).cast<float>();
+        viewport = {static_cast<GLfloat>(ctx.viewport_width),
+                    static_cast<GLfloat>(ctx.viewport_height)};
+    }
 
-    if (is_3d) {
-        Eigen::Matrix4d model =
-            (Eigen::Translation3d{text_position.cast<double>()} *
-             // make text face the camera
-             Eigen::Affine3d{camera.view.block<3, 3>(0, 0).inverse()} *
-             // text rendered +z direction, needs to be flipped
-             Eigen::AngleAxisd{M_PI, Eigen::Vector3d::UnitX()} *
-             // scale text, could make this configurable
-             Eigen::Scaling(0.02 * scale))
-                .matrix();
-
-        Eigen::Matrix4f mvp =
-            (camera.proj * camera.view * camera.target * model).cast<float>();
-
-        gltDrawText(gltext, mvp.data());
-    } else {
-        float x = text_position.x() * ctx.viewport_width;
-        float y = text_position.y() * ctx.viewport_height;
-        float scale2d = scale;
-#ifdef __APPLE__
-        // TODO: maybe try turning GLFW_COCOA_RETINA_FRAMEBUFFER off
-        // TODO[pb]: Also we can start using GLFW window_content_scale for this
-        scale2d *= 2.0;
-#endif
-        gltDrawText2DAligned(gltext, x, y, scale2d, halign, valign);
+    // vertices are written to the batch unless the same label was in the same
+    // slot last frame and didn't change. Labels after a slot that changed
+    // size move in the buffer and are all written
+    const size_t slot = n_slots++;
+    const size_t size = label_vertices.size();
+    const bool resized = slot >= slots.size() || slots[slot].second != size;
+    if (vertices_changed || shifted || resized || slots[slot].first != this) {
+        if (slot >= slots.size()) slots.resize(slot + 1);
+        slots[slot] = {this, size};
+        if (vertices.size() < n_floats + size)
+            vertices.resize(n_floats + size);
+        std::copy(label_vertices.begin(), label_vertices.end(),
+                  vertices.begin() + n_floats);
+        if (dirty_begin == dirty_end) dirty_begin = n_floats;
+        dirty_end = n_floats + size;
+        shifted = shifted || resized;
     }
+    n_floats += size;
+    vertices_changed = false;
+}
+
+void GLLabel::initialize() {
+    GLLabel::label_program_id =
+        load_shaders(label_vertex_shader_code, label_fragment_shader_code);
+    GLLabel::label_anchor_id =
+        glGetAttribLocation(label_program_id, "anchor");
+    GLLabel::label_offset_id =
+        glGetAttribLocation(label_program_id, "offset");
+    GLLabel::label_uv_id = glGetAttribLocation(label_program_id, "glyph_uv");
+    GLLabel::label_rgba_id =
+        glGetAttribLocation(label_program_id, "glyph_rgba");
+    GLLabel::label_scale_3d_id =
+        glGetAttribLocation(label_program_id, "scale_3d");
+    GLLabel::label_proj_view_id =
+        glGetUniformLocation(label_program_id, "proj_view");
+    GLLabel::label_billboard_id =
+        glGetUniformLocation(label_program_id, "billboard");
+    GLLabel::label_viewport_id =
+        glGetUniformLocation(label_program_id, "viewport");
+    GLLabel::label_atlas_id = glGetUniformLocation(label_program_id, "atlas");
+    glGenBuffers(1, &GLLabel::vertex_buffer);
+    GLLabel::buffer_size = 0;
+    GLLabel::initialized = true;
+}
+
+void GLLabel::uninitialize() {
+    GLLabel::initialized = false;
+    glDeleteBuffers(1, &GLLabel::vertex_buffer);
+    glDeleteProgram(GLLabel::label_program_id);
 }
 
 void GLLabel::beginDraw() {
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glBlendEquation(GL_FUNC_ADD);
-    gltBeginDraw();
+    n_slots = 0;
+    n_floats = 0;
+    dirty_begin = dirty_end = 0;
+    shifted = false;
 }
 
 void GLLabel::endDraw() {
-    gltEndDraw();
+    // drop slots of labels no longer drawn
+    slots.resize(n_slots);
+    vertices.resize(n_floats);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    if (n_floats > buffer_size) {
+        // grow with some headroom to avoid reallocating for each new label
+        buffer_size = std::max(n_floats, 2 * buffer_size);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * buffer_size, nullptr,
+                     GL_DYNAMIC_DRAW);
+        dirty_begin = 0;
+        dirty_end = n_floats;
+    }
+    if (dirty_begin < dirty_end)
+        glBufferSubData(GL_ARRAY_BUFFER, sizeof(GLfloat) * dirty_begin,
+                        sizeof(GLfloat) * (dirty_end - dirty_begin),
+                        vertices.data() + dirty_begin);
+
+    if (n_floats > 0) {
+        glUseProgram(label_program_id);
+        glUniformMatrix4fv(label_proj_view_id, 1, GL_FALSE, proj_view.data());
+        glUniformMatrix4fv(label_billboard_id, 1, GL_FALSE, billboard.data());
+        glUniform2fv(label_viewport_id, 1, viewport.data());
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, gltGetFontTexture());
+        glUniform1i(label_atlas_id, 0);
+
+        const std::array<std::pair<GLuint, size_t>, 5> attribs{
+            {{label_anchor_id, 3},
+             {label_offset_id, 2},
+             {label_uv_id, 2},
+             {label_rgba_id, 4},
+             {label_scale_3d_id, 2}}};
+        size_t offset = 0;
+        for (const auto& a : attribs) {
+            glEnableVertexAttribArray(a.first);
+            glVertexAttribPointer(a.first, a.second, GL_FLOAT, GL_FALSE,
+                                  sizeof(GLfloat) * label_vertex_size,
+                                  (void*)(sizeof(GLfloat) * offset));
+            offset += a.second;
+        }
+
+        glDrawArrays(GL_TRIANGLES, 0, n_floats / label_vertex_size);
+
+        for (const auto& a : attribs) glDisableVertexAttribArray(a.first);
+    }
+
     glDisable(GL_BLEND);
 }
 
@@ -8,6 +8,9 @@
 #include <Eigen/Core>
 #include <array>
 #include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "camera.h"
 #include "glfw.h"
@@ -107,8 +110,44 @@ class GLCuboid {
     static void endDraw();
 };
 
+/*
+ * Manages opengl state for drawing labels
+ *
+ * Labels are batched: the glyph quads of all labels drawn in a frame are kept
+ * in one vertex buffer, textured with the glyph atlas of the font and drawn
+ * with a single draw call in endDraw(). Only the vertices of labels that
+ * changed, or moved in the buffer, are uploaded.
+ */
 class GLLabel {
-    GLTtext* gltext;
+    static bool initialized;
+    static GLuint label_program_id;
+    static GLuint label_anchor_id;
+    static GLuint label_offset_id;
+    static GLuint label_uv_id;
+    static GLuint label_rgba_id;
+    static GLuint label_scale_3d_id;
+    static GLuint label_proj_view_id;
+    static GLuint label_billboard_id;
+    static GLuint label_viewport_id;
+    static GLuint label_atlas_id;
+
+    // vertices of the labels drawn in the current frame, mirrored by the
+    // vertex buffer, and the label and number of floats of each slot
+    static GLuint vertex_buffer;
+    static size_t buffer_size;
+    static std::vector<GLfloat> vertices;
+    static std::vector<std::pair<const GLLabel*, size_t>> slots;
+
+    // state of the frame being drawn
+    static size_t n_slots;
+    static size_t n_floats;
+    static size_t dirty_begin, dirty_end;
+    static bool shifted;
+    static Eigen::Matrix4f proj_view;
+    static Eigen::Matrix4f billboard;
+    static std::array<GLfloat, 2> viewport;
+
+    std::string text;
     Eigen::Vector3d text_position;
     bool is_3d;
     float scale;
@@ -117,6 +156,11 @@ class GLLabel {
 
     std::array<float, 4> rgba;
 
+    std::vector<GLfloat> label_vertices;
+    bool vertices_changed{true};
+
+    void update_vertices();
+
    public:
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
@@ -127,12 +171,20 @@ class GLLabel {
 
     GLLabel(const GLLabel&) = delete;
 
-    ~GLLabel();
-
     GLLabel& operator=(const GLLabel&) = delete;
 
+    /*
+     * Adds the label to the batch drawn by endDraw()
+     */
     void draw(const WindowCtx& ctx, const CameraData& camera, Label& label);
 
+    /*
+     * Initializes shader program, vertex buffer and handles
+     */
+    static void initialize();
+
+    static void uninitialize();
+
     static void beginDraw();
 
     static void endDraw();
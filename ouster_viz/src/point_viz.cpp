@@ -35,6 +35,11 @@ namespace {
 
 /*
  * Helper for addable / removable drawable objects
+ *
+ * State is triple buffered: the back is modified by the user, swap() copies it
+ * to the pending state under the update lock and publish() exchanges pending
+ * and front states under the same lock, so that the front is drawn without
+ * holding it
  */
 template <typename GL, typename T>
 class Indexed {
@@ -42,13 +47,15 @@ class Indexed {
         std::unique_ptr<GL> gl;
         std::unique_ptr<T> state;
     };
+    using Pending = std::unique_ptr<T>;
     using Back = std::shared_ptr<T>;
 
     std::vector<Front> front;
+    std::vector<Pending> pending;
     std::vector<Back> back;
 
    public:
-    Indexed() : front{}, back{} {}
+    Indexed() : front{}, pending{}, back{} {}
 
     void add(const std::shared_ptr<T>& t) {
         // find and use first empty slot, or grow
@@ -81,23 +88,37 @@ class Indexed {
     }
 
     void swap() {
-        assert(front.size() <= back.size());
+        assert(pending.size() <= back.size());
 
         // in case back grew
-        if (front.size() < back.size()) front.resize(back.size());
-
-        // send updated, added or deleted state to the front
-        for (size_t i = 0; i < front.size(); i++) {
-            if (back[i] && front[i].state) {
-                *front[i].state = *back[i];
-            } else if (back[i] && !front[i].state) {
-                front[i].state = std::make_unique<T>(*back[i]);
+        if (pending.size() < back.size()) pending.resize(back.size());
+
+        // send updated, added or deleted state to pending. Pending holds the
+        // state of the front after the last publish(), or nothing if the
+        // object wasn't drawn
+        for (size_t i = 0; i < pending.size(); i++) {
+            if (back[i] && pending[i]) {
+                *pending[i] = *back[i];
+            } else if (back[i] && !pending[i]) {
+                pending[i] = std::make_unique<T>(*back[i]);
                 back[i]->clear();
-            } else if (!back[i] && front[i].state) {
-                front[i].state.reset();
+            } else if (!back[i] && pending[i]) {
+                pending[i].reset();
             }
         }
     }
+
+    void publish() {
+        assert(front.size() <= pending.size());
+
+        // in case pending grew
+        if (front.size() < pending.size()) front.resize(pending.size());
+
+        // exchange pointers only, leaving the last drawn state to be
+        // overwritten by the next swap()
+        for (size_t i = 0; i < front.size(); i++)
+            std::swap(front[i].state, pending[i]);
+    }
 };
 
 }  // namespace
@@ -109,13 +130,13 @@ struct PointViz::Impl {
     std::unique_ptr<GLFWContext> glfw;
     GLuint vao;
 
-    // state for drawing
+    // state for drawing; update_mx guards pending state only
     std::mutex update_mx;
     bool front_changed{false};
 
-    Camera camera_back, camera_front;
+    Camera camera_back, camera_pending, camera_front;
 
-    TargetDisplay target;
+    TargetDisplay target, target_pending;
     impl::GLRings rings;
 
     Indexed<impl::GLCloud, Cloud> clouds;
@@ -168,6 +189,7 @@ PointViz::PointViz(const std::string& name, bool fix_aspect, int window_width,
     impl::GLImage::initialize();
     impl::GLRings::initialize();
     impl::GLCuboid::initialize();
+    impl::GLLabel::initialize();
 
     // release context in case subsequent calls are done from another thread
     glfwMakeContextCurrent(nullptr);
@@ -228,17 +250,17 @@ void PointViz::visible(bool state) { pimpl->glfw->visible(state); }
 bool PointViz::update() {
     std::lock_guard<std::mutex> guard{pimpl->update_mx};
 
-    // last frame hasn't been drawn yet
+    // last frame hasn't been picked up for drawing yet
     if (pimpl->front_changed) return false;
 
     // propagate camera changes
-    pimpl->camera_front = pimpl->camera_back;
+    pimpl->camera_pending = pimpl->camera_back;
 
     pimpl->clouds.swap();
     pimpl->cuboids.swap();
     pimpl->labels.swap();
     pimpl->images.swap();
-    pimpl->rings.update(pimpl->target);
+    pimpl->target_pending = pimpl->target;
 
     pimpl->front_changed = true;
 
@@ -265,47 +287,56 @@ void PointViz::draw() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glBindVertexArray(pimpl->vao);
 
-    // draw images
+    // take the pending state, if any, so that update() only waits for the
+    // exchange of pointers and not for the draw calls
     {
         std::lock_guard<std::mutex> guard{pimpl->update_mx};
-        const auto& ctx = pimpl->glfw->window_context;
+        if (pimpl->front_changed) {
+            pimpl->camera_front = pimpl->camera_pending;
+            pimpl->clouds.publish();
+            pimpl->cuboids.publish();
+            pimpl->labels.publish();
+            pimpl->images.publish();
+            pimpl->rings.update(pimpl->target_pending);
+
+            // mark front buffers no longer dirty
+            pimpl->front_changed = false;
+        }
+    }
 
-        // calculate camera matrices
-        auto camera_data =
-            pimpl->camera_front.matrices(impl::window_aspect(ctx));
+    const auto& ctx = pimpl->glfw->window_context;
 
-        // draw clouds
-        impl::GLCloud::beginDraw();
-        pimpl->clouds.draw(ctx, camera_data);
-        impl::GLCloud::endDraw();
+    // calculate camera matrices
+    auto camera_data = pimpl->camera_front.matrices(impl::window_aspect(ctx));
 
-        // draw rings
-        pimpl->rings.draw(ctx, camera_data);
+    // draw clouds
+    impl::GLCloud::beginDraw();
+    pimpl->clouds.draw(ctx, camera_data);
+    impl::GLCloud::endDraw();
 
-        // draw cuboids
-        impl::GLCuboid::beginDraw();
-        pimpl->cuboids.draw(ctx, camera_data);
-        impl::GLCuboid::endDraw();
+    // draw rings
+    pimpl->rings.draw(ctx, camera_data);
 
-        // draw labels and images on top of everything
-        glClear(GL_DEPTH_BUFFER_BIT);
+    // draw cuboids
+    impl::GLCuboid::beginDraw();
+    pimpl->cuboids.draw(ctx, camera_data);
+    impl::GLCuboid::endDraw();
 
-        // draw image
-        impl::GLImage::beginDraw();
-        pimpl->images.draw(ctx, camera_data);
-        impl::GLImage::endDraw();
+    // draw labels and images on top of everything
+    glClear(GL_DEPTH_BUFFER_BIT);
 
-        // draw labels
-        impl::GLLabel::beginDraw();
-        pimpl->labels.draw(ctx, camera_data);
-        impl::GLLabel::endDraw();
+    // draw image
+    impl::GLImage::beginDraw();
+    pimpl->images.draw(ctx, camera_data);
+    impl::GLImage::endDraw();
 
-        // switch back to point viz vao
-        glBindVertexArray(pimpl->vao);
+    // draw labels
+    impl::GLLabel::beginDraw();
+    pimpl->labels.draw(ctx, camera_data);
+    impl::GLLabel::endDraw();
 
-        // mark front buffers no longer dirty
-        pimpl->front_changed = false;
-    }
+    // switch back to point viz vao
+    glBindVertexArray(pimpl->vao);
 
     if (!pimpl->frame_buffer_handlers.empty()) {
         int width = viewport_width();